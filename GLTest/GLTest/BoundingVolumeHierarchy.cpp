@@ -0,0 +1,335 @@
+#include "BoundingVolumeHierarchy.h"
+#include <assert.h>
+#include <float.h>
+#include <algorithm>
+#include "Frustum.h"
+
+struct SAHBin
+{
+	SAHBin() :
+		Count(0)
+	{
+	}
+
+	BoundingBox Bounds;
+	unsigned int Count;
+};
+
+// Orders primitive indices by one component of their centers
+struct CenterLess
+{
+	CenterLess(const std::vector<glm::vec3>& centers, int axis) :
+		Centers(centers), Axis(axis)
+	{
+	}
+
+	bool operator()(unsigned int lhs, unsigned int rhs) const
+	{
+		return Centers[lhs][Axis] < Centers[rhs][Axis];
+	}
+
+	const std::vector<glm::vec3>& Centers;
+	int Axis;
+};
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() :
+	mVisitedNodeCount(0)
+{
+}
+
+void BoundingVolumeHierarchy::build(const BoundingBoxArray& boxes)
+{
+	clear();
+	const unsigned int count = boxes.size();
+	if (!count) {
+		return;
+	}
+
+	std::vector<glm::vec3> centers(count);
+	mPrimitiveBounds.resize(count);
+	mPrimitives.resize(count);
+	for (unsigned int i=0; i < count; ++i) {
+		mPrimitiveBounds[i] = boxes.get(i);
+		centers[i] = mPrimitiveBounds[i].getCenter();
+		mPrimitives[i] = i;
+	}
+	// The build reads mPrimitiveBounds by primitive index, refit() then stores them in leaf order
+	mNodes.reserve(2 * count);
+	buildNode(centers, 0, count, 0);
+	refit(boxes);
+}
+
+unsigned int BoundingVolumeHierarchy::buildNode(const std::vector<glm::vec3>& centers, unsigned int first,
+	unsigned int count, unsigned int depth)
+{
+	const unsigned int nodeIndex = static_cast<unsigned int>(mNodes.size());
+	Node node;
+	node.FirstPrimitive = first;
+	node.PrimitiveCount = count;
+	node.RightChild = 0;
+	mNodes.push_back(node);
+	if (count <= kMaxLeafSize) {
+		return nodeIndex;
+	}
+
+	unsigned int* const pPrimitives = &mPrimitives[first];
+	BoundingBox centerBounds(centers[pPrimitives[0]], centers[pPrimitives[0]]);
+	for (unsigned int i=1; i < count; ++i) {
+		centerBounds.Min = glm::min(centerBounds.Min, centers[pPrimitives[i]]);
+		centerBounds.Max = glm::max(centerBounds.Max, centers[pPrimitives[i]]);
+	}
+	const glm::vec3 centerSize = centerBounds.Max - centerBounds.Min;
+	int largestAxis = 0;
+	for (int axis=1; axis < 3; ++axis) {
+		if (centerSize[axis] > centerSize[largestAxis]) {
+			largestAxis = axis;
+		}
+	}
+
+	unsigned int leftCount = 0;
+	if (depth < kMaxSAHDepth && centerSize[largestAxis] > 0.0f) {
+		// Bin the centers along every axis and sweep the split planes between bins, the cost of a split is
+		// the surface area of each side times its primitive count
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		unsigned int bestSplit = 0;
+		for (int axis=0; axis < 3; ++axis) {
+			if (centerSize[axis] <= 0.0f) {
+				continue;
+			}
+			const float binScale = kBinCount / centerSize[axis];
+			SAHBin bins[kBinCount];
+			for (unsigned int i=0; i < count; ++i) {
+				const unsigned int primitive = pPrimitives[i];
+				const unsigned int bin = std::min(static_cast<unsigned int>((centers[primitive][axis] - centerBounds.Min[axis]) * binScale),
+					kBinCount - 1);
+				if (bins[bin].Count++) {
+					bins[bin].Bounds.merge(mPrimitiveBounds[primitive]);
+				}
+				else {
+					bins[bin].Bounds = mPrimitiveBounds[primitive];
+				}
+			}
+
+			float rightAreas[kBinCount];
+			unsigned int rightCounts[kBinCount];
+			BoundingBox rightBounds;
+			unsigned int rightCount = 0;
+			for (unsigned int bin=kBinCount; bin-- > 1;) {
+				if (bins[bin].Count) {
+					if (rightCount) {
+						rightBounds.merge(bins[bin].Bounds);
+					}
+					else {
+						rightBounds = bins[bin].Bounds;
+					}
+					rightCount += bins[bin].Count;
+				}
+				rightAreas[bin] = rightCount ? rightBounds.getSurfaceArea() : 0.0f;
+				rightCounts[bin] = rightCount;
+			}
+
+			BoundingBox leftBounds;
+			unsigned int binLeftCount = 0;
+			for (unsigned int split=1; split < kBinCount; ++split) {
+				const SAHBin& bin = bins[split - 1];
+				if (bin.Count) {
+					if (binLeftCount) {
+						leftBounds.merge(bin.Bounds);
+					}
+					else {
+						leftBounds = bin.Bounds;
+					}
+					binLeftCount += bin.Count;
+				}
+				if (!binLeftCount || !rightCounts[split]) {
+					continue;
+				}
+				const float cost = leftBounds.getSurfaceArea() * binLeftCount + rightAreas[split] * rightCounts[split];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		if (bestAxis >= 0) {
+			const float binScale = kBinCount / centerSize[bestAxis];
+			unsigned int* const pMiddle = std::partition(pPrimitives, pPrimitives + count, [&](unsigned int primitive) {
+				// Same binning as the sweep, so rounding cannot move a primitive across the split
+				const unsigned int bin = std::min(static_cast<unsigned int>((centers[primitive][bestAxis] - centerBounds.Min[bestAxis]) * binScale),
+					kBinCount - 1);
+				return bin < bestSplit;
+			});
+			leftCount = static_cast<unsigned int>(pMiddle - pPrimitives);
+		}
+	}
+
+	if (leftCount == 0 || leftCount == count) {
+		// Identical centers or too deep, halve at the median of the widest axis
+		leftCount = count / 2;
+		std::nth_element(pPrimitives, pPrimitives + leftCount, pPrimitives + count, CenterLess(centers, largestAxis));
+	}
+
+	buildNode(centers, first, leftCount, depth + 1);
+	const unsigned int rightChild = buildNode(centers, first + leftCount, count - leftCount, depth + 1);
+	mNodes[nodeIndex].RightChild = rightChild;
+	return nodeIndex;
+}
+
+void BoundingVolumeHierarchy::refit(const BoundingBoxArray& boxes)
+{
+	assert(boxes.size() == getPrimitiveCount());
+	for (unsigned int i=0; i < getPrimitiveCount(); ++i) {
+		mPrimitiveBounds[i] = boxes.get(mPrimitives[i]);
+	}
+
+	// Children are stored after their parent
+	for (unsigned int i=getNodeCount(); i-- > 0;) {
+		Node& node = mNodes[i];
+		if (node.RightChild) {
+			node.Bounds = mNodes[i + 1].Bounds;
+			node.Bounds.merge(mNodes[node.RightChild].Bounds);
+		}
+		else {
+			node.Bounds = mPrimitiveBounds[node.FirstPrimitive];
+			for (unsigned int p=1; p < node.PrimitiveCount; ++p) {
+				node.Bounds.merge(mPrimitiveBounds[node.FirstPrimitive + p]);
+			}
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+	mNodes.clear();
+	mPrimitives.clear();
+	mPrimitiveBounds.clear();
+	mVisitedNodeCount = 0;
+}
+
+void BoundingVolumeHierarchy::addSubtree(unsigned int node, std::vector<unsigned int>& results) const
+{
+	const unsigned int* const pFirst = &mPrimitives[mNodes[node].FirstPrimitive];
+	results.insert(results.end(), pFirst, pFirst + mNodes[node].PrimitiveCount);
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const
+{
+	results.clear();
+	mVisitedNodeCount = 0;
+	if (mNodes.empty()) {
+		return;
+	}
+
+	// Planes a node lies inside are not tested again below it
+	unsigned int stack[kMaxStackSize], planeMasks[kMaxStackSize];
+	unsigned int stackSize = 0;
+	stack[stackSize] = 0;
+	planeMasks[stackSize++] = Frustum::kAllPlanes;
+	while (stackSize) {
+		--stackSize;
+		const unsigned int nodeIndex = stack[stackSize];
+		const Node& node = mNodes[nodeIndex];
+		unsigned int planeMask = planeMasks[stackSize];
+		++mVisitedNodeCount;
+
+		const Containment containment = frustum.test(node.Bounds, planeMask);
+		if (containment == Containment::OUTSIDE) {
+			continue;
+		}
+		if (containment == Containment::INSIDE) {
+			addSubtree(nodeIndex, results);
+		}
+		else if (node.RightChild) {
+			assert(stackSize + 2 <= kMaxStackSize);
+			stack[stackSize] = node.RightChild;
+			planeMasks[stackSize++] = planeMask;
+			stack[stackSize] = nodeIndex + 1;
+			planeMasks[stackSize++] = planeMask;
+		}
+		else {
+			for (unsigned int i=0; i < node.PrimitiveCount; ++i) {
+				unsigned int primitiveMask = planeMask;
+				if (frustum.test(mPrimitiveBounds[node.FirstPrimitive + i], primitiveMask) != Containment::OUTSIDE) {
+					results.push_back(mPrimitives[node.FirstPrimitive + i]);
+				}
+			}
+		}
+	}
+}
+
+template<typename OverlapTest>
+void BoundingVolumeHierarchy::query(const OverlapTest& overlaps, std::vector<unsigned int>& results) const
+{
+	results.clear();
+	mVisitedNodeCount = 0;
+	if (mNodes.empty()) {
+		return;
+	}
+
+	unsigned int stack[kMaxStackSize];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize) {
+		const unsigned int nodeIndex = stack[--stackSize];
+		const Node& node = mNodes[nodeIndex];
+		++mVisitedNodeCount;
+		if (!overlaps(node.Bounds)) {
+			continue;
+		}
+		if (node.RightChild) {
+			assert(stackSize + 2 <= kMaxStackSize);
+			stack[stackSize++] = node.RightChild;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+		else {
+			for (unsigned int i=0; i < node.PrimitiveCount; ++i) {
+				if (overlaps(mPrimitiveBounds[node.FirstPrimitive + i])) {
+					results.push_back(mPrimitives[node.FirstPrimitive + i]);
+				}
+			}
+		}
+	}
+}
+
+struct SphereOverlap
+{
+	explicit SphereOverlap(const BoundingSphere& sphere) :
+		Sphere(sphere)
+	{
+	}
+
+	bool operator()(const BoundingBox& box) const
+	{
+		return Sphere.overlaps(box);
+	}
+
+	const BoundingSphere& Sphere;
+};
+
+struct BoxOverlap
+{
+	explicit BoxOverlap(const BoundingBox& box) :
+		Box(box)
+	{
+	}
+
+	bool operator()(const BoundingBox& box) const
+	{
+		return Box.overlaps(box);
+	}
+
+	const BoundingBox& Box;
+};
+
+void BoundingVolumeHierarchy::querySphere(const BoundingSphere& sphere, std::vector<unsigned int>& results) const
+{
+	query(SphereOverlap(sphere), results);
+}
+
+void BoundingVolumeHierarchy::queryBox(const BoundingBox& box, std::vector<unsigned int>& results) const
+{
+	query(BoxOverlap(box), results);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include "Bounds.h"
+
+class Frustum;
+
+// Binary tree of boxes over a BoundingBoxArray, built top-down with the binned surface area heuristic.
+// Nodes are stored depth-first, the left child directly follows its parent, so refit() is a single backward
+// pass. Queries return indices into the array the tree was built from.
+class BoundingVolumeHierarchy
+{
+public:
+	BoundingVolumeHierarchy();
+
+	void build(const BoundingBoxArray& boxes);
+	// Recomputes the node boxes after primitives moved. The topology is kept, so the tree degrades when
+	// primitives move far, build again then.
+	void refit(const BoundingBoxArray& boxes);
+	void clear();
+
+	unsigned int getNodeCount() const { return static_cast<unsigned int>(mNodes.size()); }
+	unsigned int getPrimitiveCount() const { return static_cast<unsigned int>(mPrimitives.size()); }
+
+	// Each query clears results, then adds the primitives overlapping the volume. Subtrees entirely inside the
+	// frustum are added without testing their nodes.
+	void queryFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const;
+	void querySphere(const BoundingSphere& sphere, std::vector<unsigned int>& results) const;
+	void queryBox(const BoundingBox& box, std::vector<unsigned int>& results) const;
+
+	// Nodes visited by the last query
+	unsigned int getVisitedNodeCount() const { return mVisitedNodeCount; }
+
+private:
+	struct Node
+	{
+		BoundingBox Bounds;
+		// Every subtree covers a contiguous range of mPrimitives
+		unsigned int FirstPrimitive;
+		unsigned int PrimitiveCount;
+		// 0 for leaves, the left child is the next node
+		unsigned int RightChild;
+	};
+
+	std::vector<Node> mNodes;
+	std::vector<unsigned int> mPrimitives;
+	// Primitive boxes in mPrimitives order, so leaves read them sequentially
+	std::vector<BoundingBox> mPrimitiveBounds;
+	mutable unsigned int mVisitedNodeCount;
+
+	unsigned int buildNode(const std::vector<glm::vec3>& centers, unsigned int first, unsigned int count, unsigned int depth);
+	void addSubtree(unsigned int node, std::vector<unsigned int>& results) const;
+	template<typename OverlapTest>
+	void query(const OverlapTest& overlaps, std::vector<unsigned int>& results) const;
+
+	static const unsigned int kMaxLeafSize = 4;
+	static const unsigned int kBinCount = 12;
+	// Past this depth nodes split at the median, which bounds the traversal stack
+	static const unsigned int kMaxSAHDepth = 32;
+	static const unsigned int kMaxStackSize = 64;
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include <math.h>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+struct BoundingBox
+{
+public:
+	BoundingBox()
+	{
+	}
+
+	BoundingBox(const glm::vec3& min, const glm::vec3& max) :
+		Min(min), Max(max)
+	{
+	}
+
+	glm::vec3 getCenter() const { return (Min + Max) * 0.5f; }
+	glm::vec3 getExtents() const { return (Max - Min) * 0.5f; }
+
+	float getSurfaceArea() const
+	{
+		const glm::vec3 size = Max - Min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	void merge(const BoundingBox& box)
+	{
+		Min = glm::min(Min, box.Min);
+		Max = glm::max(Max, box.Max);
+	}
+
+	bool overlaps(const BoundingBox& box) const
+	{
+		return Min.x <= box.Max.x && Max.x >= box.Min.x && Min.y <= box.Max.y && Max.y >= box.Min.y &&
+			Min.z <= box.Max.z && Max.z >= box.Min.z;
+	}
+
+	// Box around the transformed box, the extents are projected onto the absolute matrix axes
+	BoundingBox transformed(const glm::mat4& matrix) const
+	{
+		const glm::vec3 center(matrix * glm::vec4(getCenter(), 1.0f));
+		const glm::vec3 extents = getExtents();
+		glm::vec3 newExtents;
+		for (int row=0; row < 3; ++row) {
+			newExtents[row] = fabsf(matrix[0][row]) * extents.x + fabsf(matrix[1][row]) * extents.y +
+				fabsf(matrix[2][row]) * extents.z;
+		}
+		return BoundingBox(center - newExtents, center + newExtents);
+	}
+
+	glm::vec3 Min;
+	glm::vec3 Max;
+};
+
+struct BoundingSphere
+{
+public:
+	BoundingSphere() :
+		Radius(0.0f)
+	{
+	}
+
+	// Compares against the squared distance to the closest point of the box
+	bool overlaps(const BoundingBox& box) const
+	{
+		const glm::vec3 offset = glm::clamp(Center, box.Min, box.Max) - Center;
+		return glm::dot(offset, offset) <= Radius * Radius;
+	}
+
+	glm::vec3 Center;
+	float Radius;
+};
+
+// Boxes as centers and half extents split by component, so SIMD code loads the same component of several
+// boxes at once
+struct BoundingBoxArray
+{
+public:
+	unsigned int size() const { return static_cast<unsigned int>(CenterX.size()); }
+
+	void resize(unsigned int size)
+	{
+		CenterX.resize(size);
+		CenterY.resize(size);
+		CenterZ.resize(size);
+		ExtentX.resize(size);
+		ExtentY.resize(size);
+		ExtentZ.resize(size);
+	}
+
+	void set(unsigned int index, const BoundingBox& box)
+	{
+		const glm::vec3 center = box.getCenter(), extents = box.getExtents();
+		CenterX[index] = center.x;
+		CenterY[index] = center.y;
+		CenterZ[index] = center.z;
+		ExtentX[index] = extents.x;
+		ExtentY[index] = extents.y;
+		ExtentZ[index] = extents.z;
+	}
+
+	BoundingBox get(unsigned int index) const
+	{
+		const glm::vec3 center(CenterX[index], CenterY[index], CenterZ[index]);
+		const glm::vec3 extents(ExtentX[index], ExtentY[index], ExtentZ[index]);
+		return BoundingBox(center - extents, center + extents);
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+	std::vector<float> CenterX, CenterY, CenterZ;
+	std::vector<float> ExtentX, ExtentY, ExtentZ;
+};
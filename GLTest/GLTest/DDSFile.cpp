@@ -0,0 +1,163 @@
+#include "DDSFile.h"
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include "MappedFile.h"
+#include "TextureData.h"
+
+const unsigned int kDDSMagic = 0x20534444; // "DDS "
+// Marks the reserved fields as ours, other tools write their own signature there (NVTT uses "NVTT")
+const unsigned int kGeneratorSignature = 0x43544C47; // "GLTC"
+const unsigned int kSignatureField = 9;
+const unsigned int kTagField = 10;
+
+const unsigned int DDSD_CAPS = 0x1;
+const unsigned int DDSD_HEIGHT = 0x2;
+const unsigned int DDSD_WIDTH = 0x4;
+const unsigned int DDSD_PIXELFORMAT = 0x1000;
+const unsigned int DDSD_MIPMAPCOUNT = 0x20000;
+const unsigned int DDSD_LINEARSIZE = 0x80000;
+const unsigned int DDPF_FOURCC = 0x4;
+const unsigned int DDSCAPS_COMPLEX = 0x8;
+const unsigned int DDSCAPS_TEXTURE = 0x1000;
+const unsigned int DDSCAPS_MIPMAP = 0x400000;
+
+struct DDSPixelFormat
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int RBitMask;
+	unsigned int GBitMask;
+	unsigned int BBitMask;
+	unsigned int ABitMask;
+};
+
+struct DDSHeader
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	unsigned int Caps;
+	unsigned int Caps2;
+	unsigned int Caps3;
+	unsigned int Caps4;
+	unsigned int Reserved2;
+};
+
+static unsigned int makeFourCC(const char* pCode)
+{
+	return pCode[0] | (pCode[1] << 8) | (pCode[2] << 16) | (pCode[3] << 24);
+}
+
+static unsigned int getFourCC(GLenum internalFormat)
+{
+	switch (internalFormat) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return makeFourCC("DXT1");
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return makeFourCC("DXT5");
+		case GL_COMPRESSED_RED_RGTC1: return makeFourCC("BC4U");
+		case GL_COMPRESSED_RG_RGTC2: return makeFourCC("ATI2");
+	}
+	return 0;
+}
+
+static GLenum getInternalFormat(unsigned int fourCC)
+{
+	if (fourCC == makeFourCC("DXT1")) return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	if (fourCC == makeFourCC("DXT5")) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	if (fourCC == makeFourCC("BC4U") || fourCC == makeFourCC("ATI1")) return GL_COMPRESSED_RED_RGTC1;
+	if (fourCC == makeFourCC("ATI2") || fourCC == makeFourCC("BC5U")) return GL_COMPRESSED_RG_RGTC2;
+	return GL_NONE;
+}
+
+static size_t getLevelSize(GLenum internalFormat, unsigned int width, unsigned int height)
+{
+	const size_t blockSize = internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+bool DDSFile::save(const std::string& fileName, const TextureData& texture, unsigned int generatorTag)
+{
+	const unsigned int fourCC = getFourCC(texture.InternalFormat);
+	if (!fourCC || texture.Levels.empty()) {
+		return false;
+	}
+
+	DDSHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.Height = texture.getHeight();
+	header.Width = texture.getWidth();
+	header.PitchOrLinearSize = static_cast<unsigned int>(texture.Levels[0].Data.size());
+	header.MipMapCount = static_cast<unsigned int>(texture.Levels.size());
+	header.Reserved1[kSignatureField] = kGeneratorSignature;
+	header.Reserved1[kTagField] = generatorTag;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = fourCC;
+	header.Caps = DDSCAPS_TEXTURE | (texture.Levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&kDDSMagic), sizeof(kDDSMagic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const MipLevel& level : texture.Levels) {
+		file.write(reinterpret_cast<const char*>(&level.Data[0]), level.Data.size());
+	}
+	return file.good();
+}
+
+bool DDSFile::load(const std::string& fileName, TextureData& texture, unsigned int& generatorTag)
+{
+	MappedFile file;
+	if (!file.open(fileName)) {
+		return false;
+	}
+
+	const unsigned char* pData = file.getData();
+	const unsigned char* const pEnd = pData + file.getSize();
+	unsigned int magic = 0;
+	DDSHeader header;
+	if (file.getSize() < sizeof(magic) + sizeof(header)) {
+		return false;
+	}
+	memcpy(&magic, pData, sizeof(magic));
+	memcpy(&header, pData + sizeof(magic), sizeof(header));
+	pData += sizeof(magic) + sizeof(header);
+
+	const GLenum internalFormat = getInternalFormat(header.PixelFormat.FourCC);
+	if (magic != kDDSMagic || !(header.PixelFormat.Flags & DDPF_FOURCC) || internalFormat == GL_NONE) {
+		fprintf(stderr, "Unsupported DDS file: %s\n", fileName.c_str());
+		return false;
+	}
+
+	generatorTag = header.Reserved1[kSignatureField] == kGeneratorSignature ? header.Reserved1[kTagField] : 0;
+	texture.InternalFormat = internalFormat;
+	texture.Levels.resize(header.MipMapCount ? header.MipMapCount : 1);
+	unsigned int width = header.Width, height = header.Height;
+	for (MipLevel& level : texture.Levels) {
+		const size_t size = getLevelSize(internalFormat, width, height);
+		if (static_cast<size_t>(pEnd - pData) < size) {
+			fprintf(stderr, "Truncated DDS file: %s\n", fileName.c_str());
+			texture.Levels.clear();
+			return false;
+		}
+		level.Width = width;
+		level.Height = height;
+		level.Data.assign(pData, pData + size);
+		pData += size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return true;
+}
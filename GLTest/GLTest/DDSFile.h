@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+struct TextureData;
+
+// Reads and writes block-compressed mip chains as DDS files, using the legacy FourCC codes so the
+// files open in common image tools
+class DDSFile
+{
+public:
+	// The generator tag is stored in the reserved header fields, identifying how the data was produced.
+	// Files written by other tools load with a tag of 0.
+	static bool save(const std::string& fileName, const TextureData& texture, unsigned int generatorTag);
+	static bool load(const std::string& fileName, TextureData& texture, unsigned int& generatorTag);
+};
@@ -0,0 +1,173 @@
+#include "Frustum.h"
+#include <math.h>
+#include <xmmintrin.h>
+#include "Bounds.h"
+
+// Builds with -mavx test eight boxes per instruction. The v110 project enables no enhanced instruction set,
+// so Visual Studio builds ship the four-wide SSE kernel.
+#if defined(__AVX2__) || defined(__AVX__)
+#define FRUSTUM_AVX
+#include <immintrin.h>
+#endif
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// glm is column-major, row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+	glm::vec4 rows[4];
+	for (int r=0; r < 4; ++r) {
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+	}
+	// Left, right, bottom, top, near, far for GL clip space, -w <= x, y, z <= w
+	mPlanes[0] = rows[3] + rows[0];
+	mPlanes[1] = rows[3] - rows[0];
+	mPlanes[2] = rows[3] + rows[1];
+	mPlanes[3] = rows[3] - rows[1];
+	mPlanes[4] = rows[3] + rows[2];
+	mPlanes[5] = rows[3] - rows[2];
+	for (unsigned int i=0; i < kPlaneCount; ++i) {
+		const float length = sqrtf(mPlanes[i].x * mPlanes[i].x + mPlanes[i].y * mPlanes[i].y + mPlanes[i].z * mPlanes[i].z);
+		mPlanes[i] /= length;
+	}
+}
+
+bool Frustum::intersects(const BoundingBox& box) const
+{
+	const glm::vec3 center = box.getCenter(), extents = box.getExtents();
+	for (unsigned int i=0; i < kPlaneCount; ++i) {
+		const glm::vec4& plane = mPlanes[i];
+		// Distance of the box corner farthest along the plane normal
+		const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w +
+			fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (distance < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const
+{
+	for (unsigned int i=0; i < kPlaneCount; ++i) {
+		const glm::vec4& plane = mPlanes[i];
+		if (plane.x * sphere.Center.x + plane.y * sphere.Center.y + plane.z * sphere.Center.z + plane.w < -sphere.Radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Containment Frustum::test(const BoundingBox& box, unsigned int& planeMask) const
+{
+	const glm::vec3 center = box.getCenter(), extents = box.getExtents();
+	for (unsigned int i=0; i < kPlaneCount; ++i) {
+		if (!(planeMask & (1 << i))) {
+			continue;
+		}
+		const glm::vec4& plane = mPlanes[i];
+		const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		const float radius = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (distance + radius < 0.0f) {
+			return Containment::OUTSIDE;
+		}
+		if (distance - radius >= 0.0f) {
+			planeMask &= ~(1 << i);
+		}
+	}
+	return planeMask ? Containment::INTERSECTS : Containment::INSIDE;
+}
+
+static void addVisibleIndices(unsigned int first, int mask, std::vector<unsigned int>& visibleIndices)
+{
+	while (mask) {
+		unsigned int bit = 0;
+		while (!(mask & (1 << bit))) {
+			++bit;
+		}
+		visibleIndices.push_back(first + bit);
+		mask &= mask - 1;
+	}
+}
+
+unsigned int Frustum::cullBoxes(const BoundingBoxArray& boxes, std::vector<unsigned int>& visibleIndices) const
+{
+	visibleIndices.clear();
+	const unsigned int count = boxes.size();
+	if (!count) {
+		return 0;
+	}
+	const float* const pCenterX = &boxes.CenterX[0];
+	const float* const pCenterY = &boxes.CenterY[0];
+	const float* const pCenterZ = &boxes.CenterZ[0];
+	const float* const pExtentX = &boxes.ExtentX[0];
+	const float* const pExtentY = &boxes.ExtentY[0];
+	const float* const pExtentZ = &boxes.ExtentZ[0];
+
+	unsigned int i = 0;
+#if defined(FRUSTUM_AVX)
+	__m256 planes8[kPlaneCount][7];
+	for (unsigned int p=0; p < kPlaneCount; ++p) {
+		const glm::vec4& plane = mPlanes[p];
+		planes8[p][0] = _mm256_set1_ps(plane.x);
+		planes8[p][1] = _mm256_set1_ps(plane.y);
+		planes8[p][2] = _mm256_set1_ps(plane.z);
+		planes8[p][3] = _mm256_set1_ps(plane.w);
+		planes8[p][4] = _mm256_set1_ps(fabsf(plane.x));
+		planes8[p][5] = _mm256_set1_ps(fabsf(plane.y));
+		planes8[p][6] = _mm256_set1_ps(fabsf(plane.z));
+	}
+	const __m256 zero8 = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		const __m256 centerX = _mm256_loadu_ps(pCenterX + i), centerY = _mm256_loadu_ps(pCenterY + i);
+		const __m256 centerZ = _mm256_loadu_ps(pCenterZ + i), extentX = _mm256_loadu_ps(pExtentX + i);
+		const __m256 extentY = _mm256_loadu_ps(pExtentY + i), extentZ = _mm256_loadu_ps(pExtentZ + i);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (unsigned int p=0; p < kPlaneCount; ++p) {
+			__m256 distance = _mm256_add_ps(_mm256_mul_ps(planes8[p][0], centerX), planes8[p][3]);
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes8[p][1], centerY));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes8[p][2], centerZ));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes8[p][4], extentX));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes8[p][5], extentY));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes8[p][6], extentZ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero8, _CMP_GE_OQ));
+		}
+		addVisibleIndices(i, _mm256_movemask_ps(inside), visibleIndices);
+	}
+#endif
+
+	// Plane coefficients broadcast once: normal, distance and absolute normal
+	__m128 planes[kPlaneCount][7];
+	for (unsigned int p=0; p < kPlaneCount; ++p) {
+		const glm::vec4& plane = mPlanes[p];
+		planes[p][0] = _mm_set1_ps(plane.x);
+		planes[p][1] = _mm_set1_ps(plane.y);
+		planes[p][2] = _mm_set1_ps(plane.z);
+		planes[p][3] = _mm_set1_ps(plane.w);
+		planes[p][4] = _mm_set1_ps(fabsf(plane.x));
+		planes[p][5] = _mm_set1_ps(fabsf(plane.y));
+		planes[p][6] = _mm_set1_ps(fabsf(plane.z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		const __m128 centerX = _mm_loadu_ps(pCenterX + i), centerY = _mm_loadu_ps(pCenterY + i);
+		const __m128 centerZ = _mm_loadu_ps(pCenterZ + i), extentX = _mm_loadu_ps(pExtentX + i);
+		const __m128 extentY = _mm_loadu_ps(pExtentY + i), extentZ = _mm_loadu_ps(pExtentZ + i);
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (unsigned int p=0; p < kPlaneCount; ++p) {
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planes[p][0], centerX), planes[p][3]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][1], centerY));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][2], centerZ));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][4], extentX));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][5], extentY));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][6], extentZ));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+		}
+		addVisibleIndices(i, _mm_movemask_ps(inside), visibleIndices);
+	}
+
+	for (; i < count; ++i) {
+		if (intersects(boxes.get(i))) {
+			visibleIndices.push_back(i);
+		}
+	}
+	return static_cast<unsigned int>(visibleIndices.size());
+}
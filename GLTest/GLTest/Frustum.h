@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+struct BoundingBox;
+struct BoundingSphere;
+struct BoundingBoxArray;
+
+enum class Containment
+{
+	OUTSIDE,
+	INTERSECTS,
+	INSIDE
+};
+
+// View frustum as six planes pointing inwards, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+class Frustum
+{
+public:
+	// Extracts the planes from the rows of the matrix, boxes and spheres are then tested in the matrix's source space
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	bool intersects(const BoundingBox& box) const;
+	bool intersects(const BoundingSphere& sphere) const;
+	// Only tests the planes set in planeMask and clears the planes the box lies entirely inside, so the
+	// children of a box inside a plane skip it. INSIDE once the mask is empty.
+	Containment test(const BoundingBox& box, unsigned int& planeMask) const;
+	// Clears visibleIndices and adds the index of every box at least partially inside. Tests 8 boxes per
+	// instruction with AVX, 4 with SSE. Returns the number of visible boxes.
+	unsigned int cullBoxes(const BoundingBoxArray& boxes, std::vector<unsigned int>& visibleIndices) const;
+
+	const glm::vec4& getPlane(unsigned int index) const { return mPlanes[index]; }
+
+	static const unsigned int kPlaneCount = 6;
+	static const unsigned int kAllPlanes = (1 << kPlaneCount) - 1;
+
+private:
+	glm::vec4 mPlanes[kPlaneCount];
+};
@@ -0,0 +1,183 @@
+#include "GLState.h"
+#include <assert.h>
+
+// Never a valid object name, so the first call after invalidate() is always issued
+const GLuint kUnknown = ~0u;
+
+// Zero matches a fresh context, where every binding is 0 and GL_TEXTURE0 is active
+GLuint GLState::sProgram = 0;
+GLuint GLState::sVertexArray = 0;
+GLuint GLState::sArrayBuffer = 0;
+GLuint GLState::sElementBuffer = 0;
+GLuint GLState::sUniformBuffer = 0;
+GLuint GLState::sPixelUnpackBuffer = 0;
+GLuint GLState::sDrawIndirectBuffer = 0;
+GLuint GLState::sTextureBuffer = 0;
+GLState::BufferRange GLState::sUniformBufferRanges[GLState::kMaxUniformBufferBindings];
+unsigned int GLState::sActiveTextureUnit = 0;
+GLenum GLState::sTextureTargets[GLState::kMaxTextureUnits];
+GLuint GLState::sTextures[GLState::kMaxTextureUnits];
+GLStateStatistics GLState::sStatistics;
+
+void GLState::useProgram(GLuint program)
+{
+	if (sProgram == program) {
+		countCall(false);
+		return;
+	}
+	glUseProgram(program);
+	sProgram = program;
+	countCall(true);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (sVertexArray == vertexArray) {
+		countCall(false);
+		return;
+	}
+	glBindVertexArray(vertexArray);
+	sVertexArray = vertexArray;
+	sElementBuffer = kUnknown;
+	countCall(true);
+}
+
+GLuint* GLState::getBufferBinding(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER: return &sArrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER: return &sElementBuffer;
+	case GL_UNIFORM_BUFFER: return &sUniformBuffer;
+	case GL_PIXEL_UNPACK_BUFFER: return &sPixelUnpackBuffer;
+	case GL_DRAW_INDIRECT_BUFFER: return &sDrawIndirectBuffer;
+	case GL_TEXTURE_BUFFER: return &sTextureBuffer;
+	default: return nullptr;
+	}
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint* const pBinding = getBufferBinding(target);
+	if (pBinding && *pBinding == buffer) {
+		countCall(false);
+		return;
+	}
+	glBindBuffer(target, buffer);
+	if (pBinding) {
+		*pBinding = buffer;
+	}
+	countCall(true);
+}
+
+void GLState::bindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (binding < kMaxUniformBufferBindings) {
+		BufferRange& range = sUniformBufferRanges[binding];
+		if (range.Buffer == buffer && range.Offset == offset && range.Size == size) {
+			countCall(false);
+			return;
+		}
+		range.Buffer = buffer;
+		range.Offset = offset;
+		range.Size = size;
+	}
+	// Also binds the generic uniform buffer binding point
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+	sUniformBuffer = buffer;
+	countCall(true);
+}
+
+void GLState::bindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+	assert(unit < kMaxTextureUnits);
+	if (sTextures[unit] == texture && sTextureTargets[unit] == target) {
+		countCall(false);
+		return;
+	}
+	if (sActiveTextureUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		sActiveTextureUnit = unit;
+	}
+	glBindTexture(target, texture);
+	sTextures[unit] = texture;
+	sTextureTargets[unit] = target;
+	countCall(true);
+}
+
+void GLState::forgetProgram(GLuint program)
+{
+	// A deleted program stays in use until another one is installed
+	if (sProgram == program) {
+		sProgram = kUnknown;
+	}
+}
+
+void GLState::forgetVertexArray(GLuint vertexArray)
+{
+	if (sVertexArray == vertexArray) {
+		sVertexArray = 0;
+		sElementBuffer = kUnknown;
+	}
+}
+
+void GLState::forgetBuffer(GLuint buffer)
+{
+	GLuint* const bindings[] = { &sArrayBuffer, &sElementBuffer, &sUniformBuffer, &sPixelUnpackBuffer,
+		&sDrawIndirectBuffer, &sTextureBuffer };
+	for (GLuint* pBinding : bindings) {
+		if (*pBinding == buffer) {
+			*pBinding = 0;
+		}
+	}
+	for (unsigned int i=0; i < kMaxUniformBufferBindings; ++i) {
+		if (sUniformBufferRanges[i].Buffer == buffer) {
+			sUniformBufferRanges[i].Buffer = kUnknown;
+		}
+	}
+}
+
+void GLState::forgetTexture(GLuint texture)
+{
+	for (unsigned int i=0; i < kMaxTextureUnits; ++i) {
+		if (sTextures[i] == texture) {
+			sTextures[i] = kUnknown;
+		}
+	}
+}
+
+void GLState::invalidate()
+{
+	sProgram = kUnknown;
+	sVertexArray = kUnknown;
+	sArrayBuffer = kUnknown;
+	sElementBuffer = kUnknown;
+	sUniformBuffer = kUnknown;
+	sPixelUnpackBuffer = kUnknown;
+	sDrawIndirectBuffer = kUnknown;
+	sTextureBuffer = kUnknown;
+	for (unsigned int i=0; i < kMaxUniformBufferBindings; ++i) {
+		sUniformBufferRanges[i].Buffer = kUnknown;
+		sUniformBufferRanges[i].Offset = 0;
+		sUniformBufferRanges[i].Size = 0;
+	}
+	sActiveTextureUnit = kUnknown;
+	for (unsigned int i=0; i < kMaxTextureUnits; ++i) {
+		sTextureTargets[i] = GL_NONE;
+		sTextures[i] = kUnknown;
+	}
+}
+
+void GLState::countCall(bool issued)
+{
+	if (issued) {
+		++sStatistics.IssuedCalls;
+	}
+	else {
+		++sStatistics.ElidedCalls;
+	}
+}
+
+void GLState::resetStatistics()
+{
+	sStatistics = GLStateStatistics();
+}
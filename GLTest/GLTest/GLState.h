@@ -0,0 +1,69 @@
+#pragma once
+#include <GL/glew.h>
+
+struct GLStateStatistics
+{
+public:
+	GLStateStatistics() :
+		IssuedCalls(0), ElidedCalls(0)
+	{
+	}
+
+	unsigned int IssuedCalls;
+	unsigned int ElidedCalls;
+};
+
+// Shadow of the GL binding state, calls that would not change anything never reach the driver.
+// Everything that binds programs, vertex arrays, buffers or textures has to go through here, otherwise
+// the shadow goes stale. Deleted objects are reported with the forget functions, GL drops their bindings.
+class GLState
+{
+public:
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	// The element array binding belongs to the bound vertex array, it is tracked until the vertex array changes
+	static void bindBuffer(GLenum target, GLuint buffer);
+	static void bindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+
+	static void forgetProgram(GLuint program);
+	static void forgetVertexArray(GLuint vertexArray);
+	static void forgetBuffer(GLuint buffer);
+	static void forgetTexture(GLuint texture);
+	// After GL calls that bypass this class
+	static void invalidate();
+
+	// Lets caches elsewhere, like the uniform values of GPUProgram, show up in the counters
+	static void countCall(bool issued);
+	static const GLStateStatistics& getStatistics() { return sStatistics; }
+	static void resetStatistics();
+
+	static const unsigned int kMaxTextureUnits = 16;
+	// Texture creation and uploads bind here so they never disturb the units materials use
+	static const unsigned int kScratchTextureUnit = kMaxTextureUnits - 1;
+	static const unsigned int kMaxUniformBufferBindings = 8;
+
+private:
+	struct BufferRange
+	{
+		GLuint Buffer;
+		GLintptr Offset;
+		GLsizeiptr Size;
+	};
+
+	static GLuint sProgram;
+	static GLuint sVertexArray;
+	static GLuint sArrayBuffer;
+	static GLuint sElementBuffer;
+	static GLuint sUniformBuffer;
+	static GLuint sPixelUnpackBuffer;
+	static GLuint sDrawIndirectBuffer;
+	static GLuint sTextureBuffer;
+	static BufferRange sUniformBufferRanges[kMaxUniformBufferBindings];
+	static unsigned int sActiveTextureUnit;
+	static GLenum sTextureTargets[kMaxTextureUnits];
+	static GLuint sTextures[kMaxTextureUnits];
+	static GLStateStatistics sStatistics;
+
+	static GLuint* getBufferBinding(GLenum target);
+};
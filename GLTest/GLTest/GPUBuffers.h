@@ -1,25 +1,169 @@
 #pragma once
 #include <vector>
 #include <GL/glew.h>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+// Attribute locations match the layout qualifiers in basic.vert
+enum class VertexAttribute
+{
+	POSITION = 0,
+	TEX_COORDS = 1,
+	NORMAL = 2,
+	TANGENT = 3,
+	BITANGENT = 4,
+	DRAW_INDEX = 5		// Per instance, only used with merged geometry
+};
+
+enum class VertexFormat
+{
+	FLOAT,		// 32-bit float attributes
+	COMPACT		// Quantized positions, octahedral normals, packed tangents and 16-bit UVs
+};
+
+struct VertexAttributeFormat
+{
+	VertexAttribute Attribute;
+	GLint ComponentCount;
+	GLenum Type;
+	GLboolean Normalized;
+	GLuint Offset;
+};
+
+// Describes a single interleaved vertex stream
+struct VertexLayout
+{
+public:
+	VertexLayout() :
+		Stride(0)
+	{
+	}
+
+	void addAttribute(VertexAttribute attribute, GLint componentCount, GLenum type, GLboolean normalized = GL_FALSE)
+	{
+		VertexAttributeFormat format;
+		format.Attribute = attribute;
+		format.ComponentCount = componentCount;
+		format.Type = type;
+		format.Normalized = normalized;
+		format.Offset = Stride;
+		Attributes.push_back(format);
+		Stride += isPackedType(type) ? 4 : componentCount * getTypeSize(type);
+	}
+
+	const VertexAttributeFormat* findAttribute(VertexAttribute attribute) const
+	{
+		for (const VertexAttributeFormat& format : Attributes) {
+			if (format.Attribute == attribute) {
+				return &format;
+			}
+		}
+		return nullptr;
+	}
+
+	void clear()
+	{
+		Attributes.clear();
+		Stride = 0;
+	}
+
+	// Points the attributes of the bound vertex array at the bound GL_ARRAY_BUFFER
+	void setAttributePointers() const
+	{
+		for (const VertexAttributeFormat& format : Attributes) {
+			const GLuint location = static_cast<GLuint>(format.Attribute);
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, format.ComponentCount, format.Type, format.Normalized, Stride,
+				reinterpret_cast<const void*>(static_cast<size_t>(format.Offset)));
+		}
+	}
+
+	bool operator==(const VertexLayout& rhs) const
+	{
+		if (Stride != rhs.Stride || Attributes.size() != rhs.Attributes.size()) {
+			return false;
+		}
+		for (size_t i=0; i < Attributes.size(); ++i) {
+			const VertexAttributeFormat& a = Attributes[i];
+			const VertexAttributeFormat& b = rhs.Attributes[i];
+			if (a.Attribute != b.Attribute || a.ComponentCount != b.ComponentCount || a.Type != b.Type ||
+				a.Normalized != b.Normalized || a.Offset != b.Offset) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool isPackedType(GLenum type)
+	{
+		return type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV;
+	}
+
+	static GLsizei getTypeSize(GLenum type)
+	{
+		switch (type) {
+			case GL_BYTE:
+			case GL_UNSIGNED_BYTE:
+				return 1;
+			case GL_SHORT:
+			case GL_UNSIGNED_SHORT:
+			case GL_HALF_FLOAT:
+				return 2;
+		}
+		return 4;
+	}
+
+	std::vector<VertexAttributeFormat> Attributes;
+	GLsizei Stride;
+};
+
+// Maps normalized 16-bit positions and UVs back to their original range
+struct VertexQuantization
+{
+public:
+	VertexQuantization() :
+		PositionOffset(0.0f), PositionScale(1.0f),
+		TexCoordOffset(0.0f), TexCoordScale(1.0f)
+	{
+	}
+
+	glm::vec3 PositionOffset;
+	glm::vec3 PositionScale;
+	glm::vec2 TexCoordOffset;
+	glm::vec2 TexCoordScale;
+};
 
 struct VertexBuffer
 {
 public:
 	VertexBuffer() :
-		VAO(0), VertexCount(0)
+		VBO(0), VAO(0), VertexCount(0), BaseVertex(0)
 	{
 	}
 
-	void clear() 
+	void clear()
 	{
-		VBOs.clear();
+		Layout.clear();
+		Quantization = VertexQuantization();
+		VBO = 0;
 		VAO = 0;
 		VertexCount = 0;
+		BaseVertex = 0;
 	}
 
-	std::vector<GLuint> VBOs;
+	bool hasOctahedralNormals() const
+	{
+		const VertexAttributeFormat* const pNormal = Layout.findAttribute(VertexAttribute::NORMAL);
+		return pNormal && pNormal->ComponentCount == 2;
+	}
+
+	VertexLayout Layout;
+	VertexQuantization Quantization;
+	GLuint VBO;
 	GLuint VAO;
 	unsigned int VertexCount;
+	// First vertex of the mesh when the buffer is shared, see GeometryPool
+	GLint BaseVertex;
 };
 
 struct IndexBuffer
@@ -27,7 +171,9 @@ struct IndexBuffer
 public:
 	IndexBuffer() :
 		ElementBuffer(0),
-		IndexCount(0)
+		IndexCount(0),
+		IndexType(GL_UNSIGNED_INT),
+		FirstIndex(0)
 	{
 	}
 
@@ -35,8 +181,39 @@ public:
 	{
 		ElementBuffer = 0;
 		IndexCount = 0;
+		IndexType = GL_UNSIGNED_INT;
+		FirstIndex = 0;
+	}
+
+	GLsizei getIndexSize() const
+	{
+		return IndexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	}
+
+	// Byte offset of an index of the mesh, the indices argument of glDrawElements
+	const void* getIndexOffset(unsigned int index = 0) const
+	{
+		return reinterpret_cast<const void*>(static_cast<size_t>(FirstIndex + index) * getIndexSize());
+	}
+
+	// 16-bit indices are used whenever every vertex can be addressed with them
+	static GLenum selectIndexType(unsigned int vertexCount)
+	{
+		return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 	}
 
 	GLuint ElementBuffer;
 	unsigned int IndexCount;
+	GLenum IndexType;
+	unsigned int FirstIndex;
+};
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	GLuint Count;
+	GLuint InstanceCount;
+	GLuint FirstIndex;
+	GLint BaseVertex;
+	GLuint BaseInstance;
 };
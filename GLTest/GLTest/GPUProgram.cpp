@@ -1,8 +1,10 @@
 #include "GPUProgram.h"
 #include <fstream>
 #include <assert.h>
+#include <string.h>
+#include "GLState.h"
 
-std::string loadShaderAsString(const char* fileName)
+static std::string loadShaderAsString(const char* fileName)
 {
 	std::string line, result;
 	std::ifstream file;
@@ -29,11 +31,12 @@ GPUProgram::~GPUProgram()
 {
 	if (mHandle) {
 		glDeleteProgram(mHandle);
+		GLState::forgetProgram(mHandle);
 		mHandle = 0;
 	}
 }
 
-bool GPUProgram::compileShader(const char* fileName, ShaderType type)
+bool GPUProgram::compileShader(const char* fileName, ShaderType type, const char* defines)
 {
 	assert(fileName);
 	if (!mHandle) {
@@ -68,7 +71,11 @@ bool GPUProgram::compileShader(const char* fileName, ShaderType type)
 		return false;
 	}
 
-	const std::string shaderCode = loadShaderAsString(fileName);
+	std::string shaderCode = loadShaderAsString(fileName);
+	if (defines) {
+		const size_t versionEnd = shaderCode.compare(0, 8, "#version") == 0 ? shaderCode.find('\n') + 1 : 0;
+		shaderCode.insert(versionEnd, defines);
+	}
 	const GLchar* const codeArray[] = { shaderCode.c_str() };
 	glShaderSource(shader, 1, codeArray, nullptr);
 	glCompileShader(shader);
@@ -117,6 +124,10 @@ bool GPUProgram::link()
 		}
 	}
 	
+	if (mLinked) {
+		reflectUniforms();
+	}
+
 	for (GLuint shader : mShaderHandles) {
 		assert(shader);
 		glDetachShader(mHandle, shader);
@@ -131,7 +142,7 @@ bool GPUProgram::link()
 void GPUProgram::use() const
 {
 	assert(mHandle);
-	glUseProgram(mHandle);
+	GLState::useProgram(mHandle);
 }
 
 std::string GPUProgram::getLog() const
@@ -163,52 +174,111 @@ void GPUProgram::bindFragDataLocation(GLuint location, const char* name) const
 	glBindFragDataLocation(mHandle, location, name);
 }
 
+void GPUProgram::bindUniformBlock(const char* name, GLuint binding) const
+{
+	assert(mHandle);
+	assert(name);
+	const GLuint blockIndex = glGetUniformBlockIndex(mHandle, name);
+	if (blockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(mHandle, blockIndex, binding);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const glm::vec2& v) const
+{
+	if (updateUniformValue(id, &v, sizeof(v))) {
+		glUniform2f(getUniformLocation(id), v.x, v.y);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const glm::vec3& v) const
+{
+	if (updateUniformValue(id, &v, sizeof(v))) {
+		glUniform3f(getUniformLocation(id), v.x, v.y, v.z);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const glm::vec4& v) const
+{
+	if (updateUniformValue(id, &v, sizeof(v))) {
+		glUniform4f(getUniformLocation(id), v.x, v.y, v.z, v.w);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const glm::mat3& m) const
+{
+	if (updateUniformValue(id, &m, sizeof(m))) {
+		glUniformMatrix3fv(getUniformLocation(id), 1, GL_FALSE, &m[0][0]);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const glm::mat4& m) const
+{
+	if (updateUniformValue(id, &m, sizeof(m))) {
+		glUniformMatrix4fv(getUniformLocation(id), 1, GL_FALSE, &m[0][0]);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const float val) const
+{
+	if (updateUniformValue(id, &val, sizeof(val))) {
+		glUniform1f(getUniformLocation(id), val);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const int val) const
+{
+	if (updateUniformValue(id, &val, sizeof(val))) {
+		glUniform1i(getUniformLocation(id), val);
+	}
+}
+
+void GPUProgram::setUniform(const UniformId& id, const bool val) const
+{
+	const GLint value = static_cast<GLint>(val);
+	if (updateUniformValue(id, &value, sizeof(value))) {
+		glUniform1i(getUniformLocation(id), value);
+	}
+}
+
 void GPUProgram::setUniform(const char* name, const glm::vec2& v) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform2f(location, v.x, v.y);
+	setUniform(UniformId(name), v);
 }
 
 void GPUProgram::setUniform(const char* name, const glm::vec3& v) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform3f(location, v.x, v.y, v.z);
+	setUniform(UniformId(name), v);
 }
 
 void GPUProgram::setUniform(const char* name, const glm::vec4& v) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform4f(location, v.x, v.y, v.z, v.w);
+	setUniform(UniformId(name), v);
 }
 
-void GPUProgram::setUniform(const char* name, const glm::mat3& m) const	
+void GPUProgram::setUniform(const char* name, const glm::mat3& m) const
 {
-	GLint location = getUniformLocation(name);
-	glUniformMatrix3fv(location, 1, GL_FALSE, &m[0][0]);
+	setUniform(UniformId(name), m);
 }
 
 void GPUProgram::setUniform(const char* name, const glm::mat4& m) const
 {
-	GLint location = getUniformLocation(name);
-	glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]);
+	setUniform(UniformId(name), m);
 }
 
 void GPUProgram::setUniform(const char* name, const float val) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform1f(location, val);
+	setUniform(UniformId(name), val);
 }
 
 void GPUProgram::setUniform(const char* name, const int val) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform1i(location, val);
+	setUniform(UniformId(name), val);
 }
 
 void GPUProgram::setUniform(const char* name, const bool val) const
 {
-	GLint location = getUniformLocation(name);
-	glUniform1i(location, static_cast<GLint>(val));
+	setUniform(UniformId(name), val);
 }
 
 void GPUProgram::printActiveUniforms() const
@@ -251,9 +321,62 @@ void GPUProgram::printActiveAttribs() const
 	delete[] name;
 }
 
-GLint GPUProgram::getUniformLocation(const char* name) const
+void GPUProgram::reflectUniforms()
 {
 	assert(mHandle);
-	assert(name);
-	return glGetUniformLocation(mHandle, name);
+	GLint uniformCount = 0, maxLength = 0;
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	glGetProgramiv(mHandle, GL_ACTIVE_UNIFORMS, &uniformCount);
+	std::vector<GLchar> name(maxLength + 1);
+	std::vector<std::pair<unsigned int, GLint> > locations;
+	for (GLint i=0; i < uniformCount; ++i) {
+		GLint size;
+		GLsizei length;
+		GLenum type;
+		glGetActiveUniform(mHandle, i, static_cast<GLsizei>(name.size()), &length, &size, &type, &name[0]);
+		const GLint location = glGetUniformLocation(mHandle, &name[0]);
+		if (location < 0) {
+			// Uniform block member
+			continue;
+		}
+		// Arrays are reported as "name[0]", also register them by their plain name
+		std::string uniformName(&name[0], length);
+		const size_t arraySuffix = uniformName.find("[0]");
+		if (arraySuffix != std::string::npos && arraySuffix + 3 == uniformName.size()) {
+			uniformName.erase(arraySuffix);
+		}
+		locations.push_back(std::make_pair(UniformId(uniformName).getIndex(), location));
+	}
+
+	mUniformLocations.assign(UniformId::getCount(), -1);
+	for (const auto& location : locations) {
+		mUniformLocations[location.first] = location.second;
+	}
+	// Relinking resets every uniform
+	mUniformValues.assign(UniformId::getCount(), UniformValue());
+}
+
+GLint GPUProgram::getUniformLocation(const UniformId& id) const
+{
+	assert(mHandle);
+	// Ids interned after linking are not used by this program
+	return id.getIndex() < mUniformLocations.size() ? mUniformLocations[id.getIndex()] : -1;
+}
+
+bool GPUProgram::updateUniformValue(const UniformId& id, const void* pValue, size_t size) const
+{
+	assert(size <= sizeof(UniformValue::Data));
+	if (getUniformLocation(id) < 0) {
+		return false;
+	}
+
+	UniformValue& value = mUniformValues[id.getIndex()];
+	if (value.Size == size && memcmp(value.Data, pValue, size) == 0) {
+		GLState::countCall(false);
+		return false;
+	}
+	memcpy(value.Data, pValue, size);
+	value.Size = size;
+	GLState::countCall(true);
+	return true;
 }
@@ -3,6 +3,7 @@
 #include <GL\glew.h>
 #include <glm\glm.hpp>
 #include <vector>
+#include "UniformId.h"
 
 enum class ShaderType {
 	VERTEX,
@@ -18,14 +19,28 @@ public:
 	GPUProgram();
 	~GPUProgram();
 
-	bool compileShader(const char* fileName, ShaderType type);
+	// defines, e.g. "#define FOO\n", are inserted right after the #version line
+	bool compileShader(const char* fileName, ShaderType type, const char* defines = nullptr);
 	bool link();
+	// Uniform values are shadowed per program, setting the value a uniform already holds costs no GL call.
+	// The setters still require the program to be in use.
 	void use() const;
 	std::string getLog() const;
 	GLuint getHandle() const;
 	bool isLinked() const;
 	void bindAttribLocation(GLuint location, const char* name) const;
 	void bindFragDataLocation(GLuint location, const char* name) const;
+	// Assigns a uniform block to a binding point, blocks the program does not use are ignored
+	void bindUniformBlock(const char* name, GLuint binding) const;
+	void setUniform(const UniformId& id, const glm::vec2& v) const;
+	void setUniform(const UniformId& id, const glm::vec3& v) const;
+	void setUniform(const UniformId& id, const glm::vec4& v) const;
+	void setUniform(const UniformId& id, const glm::mat3& m) const;
+	void setUniform(const UniformId& id, const glm::mat4& m) const;
+	void setUniform(const UniformId& id, const float val) const;
+	void setUniform(const UniformId& id, const int val) const;
+	void setUniform(const UniformId& id, const bool val) const;
+	// Convenience overloads, they intern the name on every call
 	void setUniform(const char* name, const glm::vec2& v) const;
 	void setUniform(const char* name, const glm::vec3& v) const;
 	void setUniform(const char* name, const glm::vec4& v) const;
@@ -42,7 +57,26 @@ private:
 	bool mLinked;
 	std::string mLogString;
 	std::vector<GLuint> mShaderHandles;
+	// Location of every active uniform indexed by UniformId, filled in at link time
+	std::vector<GLint> mUniformLocations;
 
-	GLint getUniformLocation(const char* name) const;
+	struct UniformValue
+	{
+	public:
+		UniformValue() :
+			Size(0)
+		{
+		}
+
+		// Big enough for a mat4
+		unsigned char Data[64];
+		size_t Size;
+	};
+	mutable std::vector<UniformValue> mUniformValues;
+
+	void reflectUniforms();
+	GLint getUniformLocation(const UniformId& id) const;
+	// Records the value and returns whether it differs from the last one set, inactive uniforms never do
+	bool updateUniformValue(const UniformId& id, const void* pValue, size_t size) const;
 };
 
@@ -0,0 +1,115 @@
+#include "GeometryPool.h"
+#include <assert.h>
+#include "Mesh.h"
+#include "SceneData.h"
+#include "GLState.h"
+
+// Sizes the buffer once, the meshes are then copied into their ranges
+static void allocateBuffer(GLenum target, GLsizeiptr size)
+{
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(target, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+	else {
+		glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+	}
+}
+
+GeometryPool::GeometryPool(const VertexLayout& layout, GLenum indexType) :
+	mLayout(layout),
+	mIndexType(indexType),
+	mVBO(0),
+	mElementBuffer(0),
+	mVAO(0)
+{
+}
+
+GeometryPool::~GeometryPool()
+{
+	destroy();
+}
+
+bool GeometryPool::accepts(const MeshData& meshData) const
+{
+	return meshData.IndexType == mIndexType && meshData.Layout == mLayout;
+}
+
+void GeometryPool::add(Mesh& mesh)
+{
+	assert(!mVAO);
+	assert(accepts(mesh.getMeshData()));
+	mMeshes.push_back(&mesh);
+}
+
+bool GeometryPool::create(GLuint drawIndexBuffer)
+{
+	assert(!mVAO);
+	GLsizeiptr vertexDataSize = 0, indexDataSize = 0;
+	for (const Mesh* pMesh : mMeshes) {
+		const MeshData& meshData = pMesh->getMeshData();
+		assert(meshData.VertexData.Size == meshData.VertexCount * mLayout.Stride);
+		vertexDataSize += meshData.VertexData.Size;
+		indexDataSize += meshData.IndexData.Size;
+	}
+	if (!vertexDataSize || !indexDataSize) {
+		return false;
+	}
+
+	glGenVertexArrays(1, &mVAO);
+	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mElementBuffer);
+	if (!mVAO || !mVBO || !mElementBuffer) {
+		destroy();
+		return false;
+	}
+
+	GLState::bindVertexArray(mVAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVBO);
+	allocateBuffer(GL_ARRAY_BUFFER, vertexDataSize);
+	mLayout.setAttributePointers();
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElementBuffer);
+	allocateBuffer(GL_ELEMENT_ARRAY_BUFFER, indexDataSize);
+
+	if (drawIndexBuffer) {
+		// Advances once per instance, so the base instance of an indirect draw picks the per-draw data
+		const GLuint location = static_cast<GLuint>(VertexAttribute::DRAW_INDEX);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+		glEnableVertexAttribArray(location);
+		glVertexAttribIPointer(location, 1, GL_INT, 0, nullptr);
+		glVertexAttribDivisor(location, 1);
+	}
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVBO);
+	const GLintptr indexSize = mIndexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	unsigned int vertexCount = 0, indexCount = 0;
+	for (Mesh* pMesh : mMeshes) {
+		const MeshData& meshData = pMesh->getMeshData();
+		glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(vertexCount) * mLayout.Stride,
+			meshData.VertexData.Size, meshData.VertexData.pData);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, meshData.IndexData.Size, meshData.IndexData.pData);
+		pMesh->createBuffers(*this, static_cast<GLint>(vertexCount), indexCount);
+		vertexCount += meshData.VertexCount;
+		indexCount += meshData.IndexCount;
+	}
+	mMeshes.clear();
+	return true;
+}
+
+void GeometryPool::destroy()
+{
+	if (mVAO) {
+		glDeleteVertexArrays(1, &mVAO);
+		GLState::forgetVertexArray(mVAO);
+		mVAO = 0;
+	}
+	if (mVBO) {
+		glDeleteBuffers(1, &mVBO);
+		GLState::forgetBuffer(mVBO);
+		mVBO = 0;
+	}
+	if (mElementBuffer) {
+		glDeleteBuffers(1, &mElementBuffer);
+		GLState::forgetBuffer(mElementBuffer);
+		mElementBuffer = 0;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include "GPUBuffers.h"
+
+struct MeshData;
+class Mesh;
+
+// Static meshes sharing a vertex layout and index type, packed into one vertex buffer and one index buffer
+// behind a single VAO. Meshes are drawn with their base vertex and first index, so going from one mesh of
+// the pool to the next binds nothing.
+class GeometryPool
+{
+public:
+	GeometryPool(const VertexLayout& layout, GLenum indexType);
+	~GeometryPool();
+
+	bool accepts(const MeshData& meshData) const;
+	// Meshes get their ranges in create(), they must stay at the same address until then
+	void add(Mesh& mesh);
+	// Uploads every added mesh. drawIndexBuffer holds the ints 0, 1, 2... and feeds the per-instance
+	// VertexAttribute::DRAW_INDEX, pass 0 when nothing reads it.
+	bool create(GLuint drawIndexBuffer);
+	void destroy();
+
+	GLuint getVertexArray() const { return mVAO; }
+	GLuint getVertexBuffer() const { return mVBO; }
+	GLuint getIndexBuffer() const { return mElementBuffer; }
+	GLenum getIndexType() const { return mIndexType; }
+
+private:
+	VertexLayout mLayout;
+	GLenum mIndexType;
+	std::vector<Mesh*> mMeshes;
+	GLuint mVBO;
+	GLuint mElementBuffer;
+	GLuint mVAO;
+
+	GeometryPool(const GeometryPool& rhs);
+	GeometryPool& operator=(const GeometryPool& rhs);
+};
@@ -0,0 +1,120 @@
+#include "JobPool.h"
+#include <assert.h>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#define JOB_POOL_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_POOL_THREAD_LOCAL __thread
+#endif
+
+JobPool JobPool::sSharedPool;
+
+// Set on the pool workers and marked threads, parallelFor runs inline on them instead of waiting on the pool
+static JOB_POOL_THREAD_LOCAL bool sIsWorkerThread = false;
+
+JobPool::JobPool() :
+	mStopping(false)
+{
+}
+
+JobPool::~JobPool()
+{
+	assert(mThreads.empty());
+}
+
+void JobPool::start(unsigned int threadCount)
+{
+	assert(mThreads.empty());
+	for (unsigned int i=0; i < threadCount; ++i) {
+		mThreads.push_back(std::thread(&JobPool::workerMain, this));
+	}
+}
+
+void JobPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		assert(mRanges.empty());
+		mStopping = true;
+	}
+	mRangeAvailable.notify_all();
+	for (std::thread& thread : mThreads) {
+		thread.join();
+	}
+	mThreads.clear();
+	mStopping = false;
+}
+
+void JobPool::parallelFor(unsigned int count, unsigned int minCountPerThread, const std::function<void (unsigned int, unsigned int)>& function)
+{
+	const unsigned int rangeCount = std::max(1u, std::min(getThreadCount(), count / std::max(1u, minCountPerThread)));
+	if (rangeCount == 1 || sIsWorkerThread) {
+		function(0, count);
+		return;
+	}
+
+	const unsigned int countPerRange = (count + rangeCount - 1) / rangeCount;
+	Batch batch;
+	batch.pFunction = &function;
+	batch.RemainingRanges = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (unsigned int first=countPerRange; first < count; first += countPerRange) {
+			Range range;
+			range.pBatch = &batch;
+			range.First = first;
+			range.End = std::min(first + countPerRange, count);
+			mRanges.push_back(range);
+			++batch.RemainingRanges;
+		}
+	}
+	mRangeAvailable.notify_all();
+
+	function(0, countPerRange);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (batch.RemainingRanges > 0) {
+		mBatchFinished.wait(lock);
+	}
+}
+
+void JobPool::markWorkerThread()
+{
+	sIsWorkerThread = true;
+}
+
+JobPool& JobPool::getShared()
+{
+	return sSharedPool;
+}
+
+void JobPool::workerMain()
+{
+	markWorkerThread();
+	for (;;) {
+		Range range;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (!mStopping && mRanges.empty()) {
+				mRangeAvailable.wait(lock);
+			}
+			if (mStopping) {
+				return;
+			}
+			range = mRanges.front();
+			mRanges.pop_front();
+		}
+
+		(*range.pBatch->pFunction)(range.First, range.End);
+
+		bool finished = false;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			finished = --range.pBatch->RemainingRanges == 0;
+		}
+		if (finished) {
+			mBatchFinished.notify_all();
+		}
+	}
+}
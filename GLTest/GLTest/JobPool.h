@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Persistent worker threads shared by the CPU passes that split their work into ranges: block compression,
+// mip filtering and occlusion rasterization. Until start() is called everything runs on the calling thread.
+class JobPool
+{
+public:
+	JobPool();
+	~JobPool();
+
+	// The calling thread works as well, so threadCount is the number of extra threads
+	void start(unsigned int threadCount);
+	void stop();
+
+	// Splits [0, count) into contiguous ranges of at least minCountPerThread, one per thread, and calls
+	// function(first, end) for each of them. The calling thread takes the first range and returns once all are done.
+	// Runs everything on the calling thread when called from a pool worker or a thread marked with markWorkerThread().
+	void parallelFor(unsigned int count, unsigned int minCountPerThread, const std::function<void (unsigned int, unsigned int)>& function);
+	// Workers and the calling thread
+	unsigned int getThreadCount() const { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+	// For threads of other pools that already keep every core busy, so their work does not fan out again
+	static void markWorkerThread();
+	static JobPool& getShared();
+
+private:
+	struct Batch
+	{
+		const std::function<void (unsigned int, unsigned int)>* pFunction;
+		unsigned int RemainingRanges;
+	};
+
+	struct Range
+	{
+		Batch* pBatch;
+		unsigned int First;
+		unsigned int End;
+	};
+
+	std::vector<std::thread> mThreads;
+	std::deque<Range> mRanges;
+	std::mutex mMutex;
+	std::condition_variable mRangeAvailable;
+	std::condition_variable mBatchFinished;
+	bool mStopping;
+
+	static JobPool sSharedPool;
+
+	void workerMain();
+
+	JobPool(const JobPool& rhs);
+	JobPool& operator=(const JobPool& rhs);
+};
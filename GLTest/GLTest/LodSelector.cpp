@@ -0,0 +1,62 @@
+#include "LodSelector.h"
+#include <assert.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "Camera.h"
+#include "Mesh.h"
+#include "SceneGraph.h"
+#include "Bounds.h"
+
+const float LodSelector::kDefaultErrorThreshold = 1.0f;
+const float LodSelector::kCoarsenHysteresis = 0.75f;
+
+LodSelector::LodSelector() :
+	mCameraPosition(0.0f),
+	mNearPlaneDistance(0.0f),
+	mProjectionScale(0.0f),
+	mViewportHeight(1),
+	mErrorThreshold(kDefaultErrorThreshold)
+{
+	std::fill(mSelectedCounts, mSelectedCounts + MeshData::kMaxLodCount, 0);
+}
+
+void LodSelector::beginFrame(Camera& camera, unsigned int instanceCount)
+{
+	mInstanceLods.resize(instanceCount, 0);
+	mCameraPosition = camera.getPosition();
+	mNearPlaneDistance = camera.getNearPlaneDistance();
+	// The projection's y scale is 1 / tan(fov / 2), reading it back keeps this in step with how the camera
+	// interprets its field of view
+	mProjectionScale = camera.getProjectionMatrix()[1][1] * 0.5f * mViewportHeight;
+	std::fill(mSelectedCounts, mSelectedCounts + MeshData::kMaxLodCount, 0);
+}
+
+unsigned int LodSelector::select(const SceneGraph& sceneGraph, const Mesh& mesh, unsigned int instance)
+{
+	assert(instance < mInstanceLods.size());
+	const unsigned int lodCount = mesh.getLodCount();
+	unsigned int lod = 0;
+	if (lodCount > 1) {
+		// Distance to the closest point of the bounds, the camera inside them gets full detail
+		const BoundingBox box = sceneGraph.getInstanceBounds().get(instance);
+		const glm::vec3 offset = glm::max(glm::max(box.Min - mCameraPosition, mCameraPosition - box.Max), glm::vec3(0.0f));
+		const float distance = std::max(glm::length(offset), mNearPlaneDistance);
+
+		// Errors are in object space, the largest axis scale of the world matrix bounds how much they grow
+		const glm::mat4& worldMatrix = sceneGraph.getWorldMatrix(sceneGraph.getInstanceNode(instance));
+		const float worldScale = std::max(std::max(glm::length(glm::vec3(worldMatrix[0])), glm::length(glm::vec3(worldMatrix[1]))),
+			glm::length(glm::vec3(worldMatrix[2])));
+		const float pixelsPerUnit = worldScale * mProjectionScale / distance;
+
+		const unsigned int currentLod = std::min<unsigned int>(mInstanceLods[instance], lodCount - 1);
+		for (lod=lodCount - 1; lod > 0; --lod) {
+			const float threshold = lod > currentLod ? mErrorThreshold * kCoarsenHysteresis : mErrorThreshold;
+			if (mesh.getLod(lod).Error * pixelsPerUnit <= threshold) {
+				break;
+			}
+		}
+	}
+	mInstanceLods[instance] = static_cast<unsigned char>(lod);
+	++mSelectedCounts[lod];
+	return lod;
+}
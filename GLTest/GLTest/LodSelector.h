@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include "SceneData.h"
+
+class Camera;
+class Mesh;
+class SceneGraph;
+
+// Picks the level of detail of every instance from the screen space error of its mesh levels: the object
+// space error of a level, scaled by the instance's world matrix and projected at the distance of its bounds,
+// has to stay below a pixel threshold. An instance only moves to a coarser level once that level's error is
+// well below the threshold, which keeps instances near the boundary from switching back and forth.
+class LodSelector
+{
+public:
+	LodSelector();
+
+	void setViewportHeight(unsigned int height) { mViewportHeight = height; }
+	void setErrorThreshold(float pixels) { mErrorThreshold = pixels; }
+	float getErrorThreshold() const { return mErrorThreshold; }
+
+	// Takes the camera's projection for this frame, instances start out at full detail
+	void beginFrame(Camera& camera, unsigned int instanceCount);
+	unsigned int select(const SceneGraph& sceneGraph, const Mesh& mesh, unsigned int instance);
+
+	// Instances given each level since beginFrame
+	unsigned int getSelectedCount(unsigned int lod) const { return mSelectedCounts[lod]; }
+
+	static const float kDefaultErrorThreshold;
+	// Fraction of the threshold a coarser level's error has to get under before an instance switches to it
+	static const float kCoarsenHysteresis;
+
+private:
+	std::vector<unsigned char> mInstanceLods;
+	glm::vec3 mCameraPosition;
+	float mNearPlaneDistance;
+	// Pixels covered by one world unit at distance one
+	float mProjectionScale;
+	unsigned int mViewportHeight;
+	float mErrorThreshold;
+	unsigned int mSelectedCounts[MeshData::kMaxLodCount];
+
+	LodSelector(const LodSelector& rhs);
+	LodSelector& operator=(const LodSelector& rhs);
+};
@@ -0,0 +1,114 @@
+#include "MappedFile.h"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile() :
+	mpData(nullptr),
+	mSize(0)
+#if defined(_WIN32)
+	, mFileHandle(INVALID_HANDLE_VALUE),
+	mMappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+
+	mFileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mMappingHandle) {
+		close();
+		return false;
+	}
+
+	mpData = static_cast<const unsigned char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!mpData) {
+		close();
+		return false;
+	}
+	mSize = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mpData) {
+		UnmapViewOfFile(mpData);
+		mpData = nullptr;
+	}
+	if (mMappingHandle) {
+		CloseHandle(mMappingHandle);
+		mMappingHandle = nullptr;
+	}
+	if (mFileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFileHandle);
+		mFileHandle = INVALID_HANDLE_VALUE;
+	}
+	mSize = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+
+	const int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+		::close(fileDescriptor);
+		return false;
+	}
+
+	void* const pMapping = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	::close(fileDescriptor);
+	if (pMapping == MAP_FAILED) {
+		return false;
+	}
+
+	mpData = static_cast<const unsigned char*>(pMapping);
+	mSize = static_cast<size_t>(fileStatus.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mpData) {
+		munmap(const_cast<unsigned char*>(mpData), mSize);
+		mpData = nullptr;
+	}
+	mSize = 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& fileName);
+	void close();
+
+	bool isOpen() const { return mpData != nullptr; }
+	const unsigned char* getData() const { return mpData; }
+	size_t getSize() const { return mSize; }
+
+private:
+	const unsigned char* mpData;
+	size_t mSize;
+#if defined(_WIN32)
+	void* mFileHandle;
+	void* mMappingHandle;
+#endif
+
+	MappedFile(const MappedFile& rhs);
+	MappedFile& operator=(const MappedFile& rhs);
+};
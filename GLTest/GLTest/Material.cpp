@@ -1,18 +1,24 @@
 #include "Material.h"
-#include <assimp/mesh.h>
-#include <assimp/material.h>
-#include <assimp/scene.h>
 #include <assert.h>
+#include <stdio.h>
 #include <glm/gtc/type_ptr.hpp>
-#include "GPUBuffers.h"
 #include "GPUProgram.h"
 #include "Texture.h"
 #include "RenderContext.h"
 #include "Camera.h"
+#include "SceneData.h"
+#include "UniformBlocks.h"
 
-Material::Material(const aiMaterial& aiMaterial, const GPUProgram& program) :
-	mAiMaterial(aiMaterial),
-	mGPUProgram(program)
+const UniformId kDiffuseMapUniform("DiffuseMap");
+const UniformId kNormalMapUniform("NormalMap");
+const UniformId kSpecularMapUniform("SpecularMap");
+
+unsigned int Material::sNextSortId = 0;
+
+Material::Material(const MaterialData& materialData, const GPUProgram& program) :
+	mMaterialData(materialData),
+	mGPUProgram(program),
+	mSortId(sNextSortId++)
 {
 }
 
@@ -23,49 +29,39 @@ Material::~Material()
 
 void Material::init()
 {
+	setSamplerUnits(mGPUProgram);
+
 	loadTexture(TextureType::DIFFUSE_MAP);
 	loadTexture(TextureType::NORMAL_MAP);
 	loadTexture(TextureType::SPECULAR_MAP);
 }
 
-aiTextureType getTextureType(TextureType type)
+void Material::setSamplerUnits(const GPUProgram& program)
 {
-	switch (type) {
-		case TextureType::DIFFUSE_MAP:
-			return aiTextureType_DIFFUSE;
-		case TextureType::NORMAL_MAP:
-			return aiTextureType_HEIGHT; // For OBJs the type is HEIGHT not NORMAL
-		case TextureType::SPECULAR_MAP:
-			return aiTextureType_SPECULAR;
-	}
-	return aiTextureType_DIFFUSE;
+	// Texture units never change, everything else per draw goes through the per-draw data
+	program.use();
+	program.setUniform(kDiffuseMapUniform, 0);
+	program.setUniform(kNormalMapUniform, 1);
+	program.setUniform(kSpecularMapUniform, 2);
 }
 
 void Material::loadTexture(TextureType textureType)
 {
-	const aiTextureType aiType = getTextureType(textureType);
-	aiString path;
-	aiReturn texFound = mAiMaterial.GetTexture(aiType, 0, &path);
-	bool useDefaultTexture = false;
-	if (texFound == AI_SUCCESS) {
-		const Texture* const pTexture = Texture::load(path.C_Str());
-		if (pTexture) {
-			addTexture(textureType, pTexture);
-		}
-		else {
-			fprintf(stderr, "Error loading texture: %s\n", path.C_Str());
-			useDefaultTexture = true;
-		}
+	// Textures stream in while the scene is already rendering, see TextureLoader
+	const auto& nameIt = mMaterialData.TextureNames.find(textureType);
+	if (nameIt != mMaterialData.TextureNames.end()) {
+		addTexture(textureType, Texture::loadAsync(nameIt->second, textureType));
 	}
 	else {
-		useDefaultTexture = true;
-	}
-
-	if (useDefaultTexture) {
 		addTexture(textureType, Texture::sDefaultTexture);
 	}
 }
 
+bool Material::isTwoSided() const
+{
+	return mMaterialData.TwoSided;
+}
+
 bool Material::hasTexture(TextureType type) const
 {
 	return mTextures.find(type) != mTextures.end();
@@ -78,124 +74,34 @@ const Texture& Material::getTexture(TextureType type) const
 	return *it->second;
 }
 
-void Material::addTexture(TextureType type, const Texture* pTexture)
+void Material::addTexture(TextureType type, const TextureHandle& texture)
 {
-	mTextures.insert(std::make_pair(type, pTexture));
+	mTextures.insert(std::make_pair(type, texture));
 }
 
-void Material::apply(const RenderContext& renderContext) const
+void Material::apply(const RenderContext& renderContext, DrawUniforms& drawUniforms) const
 {
-	assert(renderContext.pCamera);
-	mGPUProgram.use();
-
+	drawUniforms.DiffuseLayer = 0;
 	auto& it = mTextures.find(TextureType::DIFFUSE_MAP);
 	if (it != mTextures.end()) {
 		it->second->bind(GL_TEXTURE0);
-		mGPUProgram.setUniform("DiffuseMap", 0);
+		it->second->markUsed(renderContext.FrameIndex);
+		drawUniforms.DiffuseLayer = it->second->getLayer();
 	}
 
+	drawUniforms.NormalLayer = 0;
 	it = mTextures.find(TextureType::NORMAL_MAP);
 	if (it != mTextures.end()) {
 		it->second->bind(GL_TEXTURE1);
-		mGPUProgram.setUniform("NormalMap", 1);
-	}	
+		it->second->markUsed(renderContext.FrameIndex);
+		drawUniforms.NormalLayer = it->second->getLayer();
+	}
 
+	drawUniforms.SpecularLayer = 0;
 	it = mTextures.find(TextureType::SPECULAR_MAP);
 	if (it != mTextures.end()) {
 		it->second->bind(GL_TEXTURE2);
-		mGPUProgram.setUniform("SpecularMap", 2);
-	}	
-	
-	glm::mat4 worldMatrix = renderContext.getCurrentWorldMatrix();
-	glm::mat4 wvpMatrix = renderContext.pCamera->getViewProjectionMatrix() * worldMatrix;
-
-	mGPUProgram.setUniform("WorldMatrix", worldMatrix);
-	mGPUProgram.setUniform("WVPMatrix", wvpMatrix);
-	mGPUProgram.setUniform("CameraPosition", renderContext.pCamera->getPosition());
-
-	mGPUProgram.setUniform("Time", renderContext.Time);
-}
-
-void Material::createVertexBuffer(const aiMesh& aiMesh, VertexBuffer& vertexBuffer) const
-{
-	assert(aiMesh.HasPositions());
-	assert(aiMesh.HasNormals());
-	assert(aiMesh.HasTangentsAndBitangents());
-	assert(aiMesh.HasTextureCoords(0));
-
-	vertexBuffer.VertexCount = aiMesh.mNumVertices;
-	const unsigned int vertexDataSize = vertexBuffer.VertexCount * 3;
-	const unsigned int uvDataSize = vertexBuffer.VertexCount * aiMesh.mNumUVComponents[0];
-	float* const positionData = new float[vertexDataSize];
-	float* const normalData = new float[vertexDataSize];
-	float* const tangentData = new float[vertexDataSize];
-	float* const bitangentData = new float[vertexDataSize];
-	float* const uvData = new float[uvDataSize];
-
-	unsigned int index = 0, uvIndex = 0;
-	for (unsigned int i=0; i < aiMesh.mNumVertices; ++i, index += 3, uvIndex += aiMesh.mNumUVComponents[0]) {
-		positionData[index] = aiMesh.mVertices[i].x;
-		positionData[index + 1] = aiMesh.mVertices[i].y;
-		positionData[index + 2] = aiMesh.mVertices[i].z;
-
-		normalData[index] = aiMesh.mNormals[i].x;
-		normalData[index + 1] = aiMesh.mNormals[i].y;
-		normalData[index + 2] = aiMesh.mNormals[i].z;
-
-		tangentData[index] = aiMesh.mTangents[i].x;
-		tangentData[index + 1] = aiMesh.mTangents[i].y;
-		tangentData[index + 2] = aiMesh.mTangents[i].z;
-
-		bitangentData[index] = aiMesh.mBitangents[i].x;
-		bitangentData[index + 1] = aiMesh.mBitangents[i].y;
-		bitangentData[index + 2] = aiMesh.mBitangents[i].z;
-
-		uvData[uvIndex] = aiMesh.mTextureCoords[0][i].x;
-		if (aiMesh.mNumUVComponents[0] > 1) {
-			uvData[uvIndex + 1] = aiMesh.mTextureCoords[0][i].y;
-			if (aiMesh.mNumUVComponents[0] > 2) {
-				uvData[uvIndex + 2] = aiMesh.mTextureCoords[0][i].z;
-			}
-		}
-	}
-
-	vertexBuffer.VBOs.resize(5);
-	glGenBuffers(5, &vertexBuffer.VBOs[0]);
-	GLuint positionVBO = vertexBuffer.VBOs[0];
-	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexDataSize * sizeof(positionData[0]), positionData, GL_STATIC_DRAW);
-	GLuint normalVBO = vertexBuffer.VBOs[1];
-	glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexDataSize * sizeof(normalData[0]), normalData, GL_STATIC_DRAW);
-	GLuint tangentVBO = vertexBuffer.VBOs[2];
-	glBindBuffer(GL_ARRAY_BUFFER, tangentVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexDataSize * sizeof(tangentData[0]), tangentData, GL_STATIC_DRAW);
-	GLuint bitangentVBO = vertexBuffer.VBOs[2];
-	glBindBuffer(GL_ARRAY_BUFFER, bitangentVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexDataSize * sizeof(bitangentData[0]), bitangentData, GL_STATIC_DRAW);
-	GLuint texCoordVBO = vertexBuffer.VBOs[3];
-	glBindBuffer(GL_ARRAY_BUFFER, texCoordVBO);
-	glBufferData(GL_ARRAY_BUFFER, uvDataSize * sizeof(uvData[0]), uvData, GL_STATIC_DRAW);
-
-	glGenVertexArrays(1, &vertexBuffer.VAO);
-	glBindVertexArray(vertexBuffer.VAO);
-	for (unsigned int i=0; i < vertexBuffer.VBOs.size(); ++i) {
-		glEnableVertexAttribArray(i);
+		it->second->markUsed(renderContext.FrameIndex);
+		drawUniforms.SpecularLayer = it->second->getLayer();
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);	
-	glBindBuffer(GL_ARRAY_BUFFER, texCoordVBO);
-	glVertexAttribPointer(1, aiMesh.mNumUVComponents[0], GL_FLOAT, GL_FALSE, 0, nullptr);
-	glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-	glBindBuffer(GL_ARRAY_BUFFER, tangentVBO);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-	glBindBuffer(GL_ARRAY_BUFFER, bitangentVBO);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-	delete[] positionData;
-	delete[] normalData;
-	delete[] tangentData;
-	delete[] bitangentData;
-	delete[] uvData;
 }
@@ -1,33 +1,39 @@
 #pragma once
 #include <unordered_map>
+#include "Texture.h"
 
-struct aiMesh;
-struct aiMaterial;
-struct VertexBuffer;
+struct MaterialData;
 struct RenderContext;
-enum class TextureType;
-class Texture;
+struct DrawUniforms;
 class GPUProgram;
 
 class Material
 {
 public:
-	Material(const aiMaterial& aiMaterial, const GPUProgram& program);
+	Material(const MaterialData& materialData, const GPUProgram& program);
 	virtual ~Material();
 
 	const GPUProgram& getGPUProgram() const { return mGPUProgram; }
+	// Small unique number used in draw sort keys, copies share it
+	unsigned int getSortId() const { return mSortId; }
+	bool isTwoSided() const;
 	bool hasTexture(TextureType type) const;
 	const Texture& getTexture(TextureType type) const;
-	void addTexture(TextureType type, const Texture* pTexture);
+	void addTexture(TextureType type, const TextureHandle& texture);
 
 	virtual void init();
-	virtual void apply(const RenderContext& renderContext) const;
-	virtual void createVertexBuffer(const aiMesh& aiMesh, VertexBuffer& vertexBuffer) const;
+	// Points the program's texture samplers at the units apply() binds to
+	static void setSamplerUnits(const GPUProgram& program);
+	// Binds the textures and fills in the material part of the draw uniforms, the renderer binds the program
+	virtual void apply(const RenderContext& renderContext, DrawUniforms& drawUniforms) const;
 
 private:
-	const aiMaterial& mAiMaterial;
-	std::unordered_map<TextureType, const Texture*> mTextures;
+	const MaterialData& mMaterialData;
+	std::unordered_map<TextureType, TextureHandle> mTextures;
 	const GPUProgram& mGPUProgram;
+	unsigned int mSortId;
+
+	static unsigned int sNextSortId;
 
 	void loadTexture(TextureType textureType);
 };
@@ -1,13 +1,31 @@
 #include "Mesh.h"
-#include <assimp/mesh.h>
-#include <assimp/scene.h>
 #include <assert.h>
-#include "Texture.h"
 #include "Material.h"
+#include "SceneData.h"
+#include "VertexPacking.h"
+#include "GLState.h"
+#include "GeometryPool.h"
 
-Mesh::Mesh(const aiMesh& aiMesh, const Material& material) :
-	mAiMesh(aiMesh),
-	mMaterial(material)
+// Uploads straight from the blob, which for loaded scenes is a range of the memory-mapped scene file.
+// Immutable storage lets the driver copy once from the file pages with no intermediate buffer.
+static void uploadBuffer(GLenum target, const DataBlob& blob)
+{
+	assert(blob.pData && blob.Size);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(target, blob.Size, blob.pData, 0);
+	}
+	else {
+		glBufferData(target, blob.Size, blob.pData, GL_STATIC_DRAW);
+	}
+}
+
+unsigned int Mesh::sNextSortId = 0;
+
+Mesh::Mesh(const MeshData& meshData, const Material& material) :
+	mMeshData(meshData),
+	mMaterial(material),
+	mpGeometryPool(nullptr),
+	mSortId(sNextSortId++)
 {
 }
 
@@ -15,86 +33,148 @@ Mesh::~Mesh()
 {
 }
 
+unsigned int Mesh::getLodCount() const
+{
+	return static_cast<unsigned int>(mMeshData.Lods.size());
+}
+
+const MeshLod& Mesh::getLod(unsigned int lod) const
+{
+	assert(lod < mMeshData.Lods.size());
+	return mMeshData.Lods[lod];
+}
+
+unsigned int Mesh::getMeshletCount() const
+{
+	return static_cast<unsigned int>(mMeshData.Meshlets.size());
+}
+
+const Meshlet& Mesh::getMeshlet(unsigned int meshlet) const
+{
+	assert(meshlet < mMeshData.Meshlets.size());
+	return mMeshData.Meshlets[meshlet];
+}
+
 void Mesh::createBuffers()
 {
-	mMaterial.createVertexBuffer(mAiMesh, mVertexBuffer);
+	createVertexBuffer();
 	createIndexBuffer();
 }
 
+void Mesh::createBuffers(const GeometryPool& pool, GLint baseVertex, unsigned int firstIndex)
+{
+	assert(!mVertexBuffer.VBO && !mpGeometryPool);
+	mpGeometryPool = &pool;
+
+	mVertexBuffer.Layout = mMeshData.Layout;
+	mVertexBuffer.Quantization = mMeshData.Quantization;
+	mVertexBuffer.VertexCount = mMeshData.VertexCount;
+	mVertexBuffer.VBO = pool.getVertexBuffer();
+	mVertexBuffer.VAO = pool.getVertexArray();
+	mVertexBuffer.BaseVertex = baseVertex;
+
+	mIndexBuffer.IndexCount = mMeshData.IndexCount;
+	mIndexBuffer.IndexType = mMeshData.IndexType;
+	mIndexBuffer.ElementBuffer = pool.getIndexBuffer();
+	mIndexBuffer.FirstIndex = firstIndex;
+}
+
+void Mesh::createVertexBuffer()
+{
+	assert(!mVertexBuffer.VBO);
+	assert(mMeshData.VertexCount);
+	assert(mMeshData.VertexData.Size == mMeshData.VertexCount * mMeshData.Layout.Stride);
+
+	mVertexBuffer.Layout = mMeshData.Layout;
+	mVertexBuffer.Quantization = mMeshData.Quantization;
+	mVertexBuffer.VertexCount = mMeshData.VertexCount;
+
+	glGenBuffers(1, &mVertexBuffer.VBO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer.VBO);
+	uploadBuffer(GL_ARRAY_BUFFER, mMeshData.VertexData);
+
+	glGenVertexArrays(1, &mVertexBuffer.VAO);
+	GLState::bindVertexArray(mVertexBuffer.VAO);
+	mVertexBuffer.Layout.setAttributePointers();
+}
+
 void Mesh::createIndexBuffer()
 {
-	assert(mAiMesh.HasFaces());
 	assert(!mIndexBuffer.ElementBuffer);
+	assert(mMeshData.IndexCount);
 
-	mIndexBuffer.IndexCount = mAiMesh.mNumFaces * 3;
-	unsigned int* const indices = new unsigned int[mIndexBuffer.IndexCount];
-
-	// Create index buffer
-	unsigned int index = 0;
-	for (unsigned int i=0; i < mAiMesh.mNumFaces; ++i) {
-		assert(mAiMesh.mFaces[i].mNumIndices == 3);
-		indices[index++] = mAiMesh.mFaces[i].mIndices[0];
-		indices[index++] = mAiMesh.mFaces[i].mIndices[1];
-		indices[index++] = mAiMesh.mFaces[i].mIndices[2];
-	}
+	mIndexBuffer.IndexCount = mMeshData.IndexCount;
+	mIndexBuffer.IndexType = mMeshData.IndexType;
+	assert(mMeshData.IndexData.Size == mIndexBuffer.IndexCount * mIndexBuffer.getIndexSize());
 
+	// The vertex array is still bound from createVertexBuffer, so it records the element buffer
 	glGenBuffers(1, &mIndexBuffer.ElementBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer.ElementBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer.IndexCount * sizeof(indices[0]), indices, GL_STATIC_DRAW);
-
-	delete[] indices;
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer.ElementBuffer);
+	uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, mMeshData.IndexData);
 }
 
 void Mesh::destroy()
 {
-	glDeleteBuffers(static_cast<GLsizei>(mVertexBuffer.VBOs.size()), &mVertexBuffer.VBOs[0]);
+	// Shared buffers belong to the pool
+	if (mpGeometryPool) {
+		mVertexBuffer.clear();
+		mIndexBuffer.clear();
+		mpGeometryPool = nullptr;
+		return;
+	}
+
+	glDeleteBuffers(1, &mVertexBuffer.VBO);
 	glDeleteBuffers(1, &mIndexBuffer.ElementBuffer);
 	glDeleteVertexArrays(1, &mVertexBuffer.VAO);
+	GLState::forgetBuffer(mVertexBuffer.VBO);
+	GLState::forgetBuffer(mIndexBuffer.ElementBuffer);
+	GLState::forgetVertexArray(mVertexBuffer.VAO);
 
 	mVertexBuffer.clear();
 	mIndexBuffer.clear();
 }
 
-std::vector<glm::vec3> Mesh::getVertices() const
+std::vector<glm::vec3> Mesh::getAttribute(VertexAttribute attribute) const
 {
-	assert(mAiMesh.HasPositions());
+	const VertexAttributeFormat* const pFormat = mMeshData.Layout.findAttribute(attribute);
+	assert(pFormat);
 	std::vector<glm::vec3> array;
-	for (unsigned int i=0; i < mAiMesh.mNumVertices; ++i) {
-		const aiVector3D& v = mAiMesh.mVertices[i];
-		array.push_back(glm::vec3(v.x, v.y, v.z));
+	array.reserve(mMeshData.VertexCount);
+	assert(mMeshData.VertexData.pData);
+	const unsigned char* pSource = mMeshData.VertexData.pData + pFormat->Offset;
+	for (unsigned int i=0; i < mMeshData.VertexCount; ++i, pSource += mMeshData.Layout.Stride) {
+		array.push_back(glm::vec3(decodeAttribute(*pFormat, mMeshData.Quantization, pSource)));
 	}
 	return array;
 }
 
+std::vector<glm::vec3> Mesh::getVertices() const
+{
+	return getAttribute(VertexAttribute::POSITION);
+}
+
 std::vector<glm::vec3> Mesh::getNormals() const
 {
-	assert(mAiMesh.HasNormals());
-	std::vector<glm::vec3> array;
-	for (unsigned int i=0; i < mAiMesh.mNumVertices; ++i) {
-		const aiVector3D& v = mAiMesh.mNormals[i];
-		array.push_back(glm::vec3(v.x, v.y, v.z));
-	}
-	return array;
+	return getAttribute(VertexAttribute::NORMAL);
 }
 
 std::vector<glm::vec3> Mesh::getTangents() const
 {
-	assert(mAiMesh.HasTangentsAndBitangents());
-	std::vector<glm::vec3> array;
-	for (unsigned int i=0; i < mAiMesh.mNumVertices; ++i) {
-		const aiVector3D& v = mAiMesh.mTangents[i];
-		array.push_back(glm::vec3(v.x, v.y, v.z));
-	}
-	return array;
+	return getAttribute(VertexAttribute::TANGENT);
 }
 
 std::vector<glm::vec3> Mesh::getBitangents() const
 {
-	assert(mAiMesh.HasTangentsAndBitangents());
+	// Rebuilt the same way as in basic.vert
+	const VertexAttributeFormat* const pTangent = mMeshData.Layout.findAttribute(VertexAttribute::TANGENT);
+	assert(pTangent);
+	const std::vector<glm::vec3> normals = getNormals();
 	std::vector<glm::vec3> array;
-	for (unsigned int i=0; i < mAiMesh.mNumVertices; ++i) {
-		const aiVector3D& v = mAiMesh.mBitangents[i];
-		array.push_back(glm::vec3(v.x, v.y, v.z));
+	array.reserve(mMeshData.VertexCount);
+	const unsigned char* pSource = mMeshData.VertexData.pData + pTangent->Offset;
+	for (unsigned int i=0; i < mMeshData.VertexCount; ++i, pSource += mMeshData.Layout.Stride) {
+		const glm::vec4 tangent = decodeAttribute(*pTangent, mMeshData.Quantization, pSource);
+		array.push_back(glm::cross(normals[i], glm::vec3(tangent)) * tangent.w);
 	}
 	return array;
 }
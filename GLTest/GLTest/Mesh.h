@@ -4,32 +4,52 @@
 #include <glm/vec3.hpp>
 #include "GPUBuffers.h"
 
-struct aiMesh;
-struct aiScene;
+struct MeshData;
+struct MeshLod;
+struct Meshlet;
 class Material;
+class GeometryPool;
 
 class Mesh
 {
 public:
-	Mesh(const aiMesh& aiMesh, const Material& material);
+	Mesh(const MeshData& meshData, const Material& material);
 	~Mesh();
 
+	const MeshData& getMeshData() const { return mMeshData; }
 	const Material& getMaterial() const { return mMaterial; }
+	// Small unique number used in draw sort keys, copies share it
+	unsigned int getSortId() const { return mSortId; }
 	const VertexBuffer& getVertexBuffer() const { return mVertexBuffer; }
 	const IndexBuffer& getIndexBuffer() const { return mIndexBuffer; }
+	// Index ranges within the index buffer, see MeshData::Lods
+	unsigned int getLodCount() const;
+	const MeshLod& getLod(unsigned int lod) const;
+	// Clusters of the full detail level, see MeshData::Meshlets
+	unsigned int getMeshletCount() const;
+	const Meshlet& getMeshlet(unsigned int meshlet) const;
 	std::vector<glm::vec3> getVertices() const;
 	std::vector<glm::vec3> getNormals() const;
 	std::vector<glm::vec3> getTangents() const;
 	std::vector<glm::vec3> getBitangents() const;
 
 	void createBuffers();
+	// Uses a range of the pool's buffers instead of owning any, called by GeometryPool::create
+	void createBuffers(const GeometryPool& pool, GLint baseVertex, unsigned int firstIndex);
+	bool hasSharedBuffers() const { return mpGeometryPool != nullptr; }
 	void destroy();
 
 private:
-	const aiMesh& mAiMesh;
+	const MeshData& mMeshData;
 	VertexBuffer mVertexBuffer;
 	IndexBuffer mIndexBuffer;
 	const Material& mMaterial;
+	const GeometryPool* mpGeometryPool;
+	unsigned int mSortId;
 
+	static unsigned int sNextSortId;
+
+	void createVertexBuffer();
 	void createIndexBuffer();
+	std::vector<glm::vec3> getAttribute(VertexAttribute attribute) const;
 };
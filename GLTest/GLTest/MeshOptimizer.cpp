@@ -0,0 +1,819 @@
+#include "MeshOptimizer.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+#include "SceneData.h"
+
+const unsigned int MeshOptimizer::kDefaultCacheSize = 16;
+// Cones wider than this, as the cosine of their half angle, face the camera from almost everywhere
+const float kMinMeshletConeDot = 0.1f;
+
+// Tuning values from Forsyth's article
+const int kMaxCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+static float computeVertexScore(int cachePosition, unsigned int remainingValence)
+{
+	if (remainingValence == 0) {
+		// No triangle left to use this vertex
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// Vertices of the last triangle get a fixed score so it is not reused right away
+			score = kLastTriangleScore;
+		}
+		else {
+			const float scaler = 1.0f / (kMaxCacheSize - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+		}
+	}
+
+	// Favour vertices with few triangles left so they are finished off and leave the cache
+	score += kValenceBoostScale * powf(static_cast<float>(remainingValence), -kValenceBoostPower);
+	return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	assert(indices.size() % 3 == 0);
+	const unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Vertex to triangle adjacency, stored as one contiguous array with per-vertex offsets
+	std::vector<unsigned int> valence(vertexCount, 0);
+	for (unsigned int index : indices) {
+		assert(index < vertexCount);
+		++valence[index];
+	}
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (unsigned int v=0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + valence[v];
+	}
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (unsigned int t=0; t < triangleCount; ++t) {
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int v = indices[t * 3 + c];
+			adjacency[fill[v]++] = t;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (unsigned int v=0; v < vertexCount; ++v) {
+		vertexScore[v] = computeVertexScore(-1, valence[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (unsigned int t=0; t < triangleCount; ++t) {
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(kMaxCacheSize + 3);
+	newCache.reserve(kMaxCacheSize + 3);
+
+	int bestTriangle = static_cast<int>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	unsigned int nextUnemitted = 0;
+
+	while (result.size() < indices.size()) {
+		if (bestTriangle < 0) {
+			// Nothing in the cache can be continued, restart from the next unused triangle in input order
+			while (emitted[nextUnemitted]) {
+				++nextUnemitted;
+			}
+			bestTriangle = static_cast<int>(nextUnemitted);
+		}
+
+		const unsigned int* const triangle = &indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+
+		// Remove the triangle from the adjacency of its vertices
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int v = triangle[c];
+			result.push_back(v);
+			unsigned int* const pBegin = &adjacency[adjacencyOffsets[v]];
+			unsigned int* const pEnd = pBegin + valence[v];
+			unsigned int* const pFound = std::find(pBegin, pEnd, static_cast<unsigned int>(bestTriangle));
+			assert(pFound != pEnd);
+			std::swap(*pFound, *(pEnd - 1));
+			--valence[v];
+		}
+
+		// The emitted triangle moves to the front of the LRU cache
+		newCache.clear();
+		newCache.push_back(triangle[0]);
+		newCache.push_back(triangle[1]);
+		newCache.push_back(triangle[2]);
+		for (unsigned int v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		for (unsigned int i=0; i < newCache.size(); ++i) {
+			const unsigned int v = newCache[i];
+			cachePosition[v] = i < kMaxCacheSize ? static_cast<int>(i) : -1;
+			vertexScore[v] = computeVertexScore(cachePosition[v], valence[v]);
+		}
+
+		// Rescore the triangles touched by the cache and pick the best one to continue with
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (unsigned int v : newCache) {
+			const unsigned int* const pAdjacent = &adjacency[adjacencyOffsets[v]];
+			for (unsigned int a=0; a < valence[v]; ++a) {
+				const unsigned int t = pAdjacent[a];
+				assert(!emitted[t]);
+				const float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				triangleScore[t] = score;
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+		}
+
+		if (newCache.size() > kMaxCacheSize) {
+			newCache.resize(kMaxCacheSize);
+		}
+		cache.swap(newCache);
+	}
+
+	indices.swap(result);
+}
+
+struct TriangleCluster
+{
+	unsigned int FirstTriangle;
+	unsigned int TriangleCount;
+	float SortKey;
+
+	bool operator<(const TriangleCluster& rhs) const
+	{
+		return SortKey > rhs.SortKey;
+	}
+};
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions)
+{
+	assert(indices.size() % 3 == 0);
+	const unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Cluster boundaries are placed where the cache-optimized order already restarts, i.e. where a triangle
+	// misses on all three vertices, so reordering clusters keeps the vertex cache efficiency
+	std::vector<TriangleCluster> clusters;
+	std::vector<unsigned int> cacheTime(positions.size(), 0);
+	unsigned int time = kDefaultCacheSize + 1;
+	for (unsigned int t=0; t < triangleCount; ++t) {
+		unsigned int misses = 0;
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int v = indices[t * 3 + c];
+			if (time - cacheTime[v] > kDefaultCacheSize) {
+				cacheTime[v] = time++;
+				++misses;
+			}
+		}
+		if (misses == 3 || clusters.empty()) {
+			TriangleCluster cluster;
+			cluster.FirstTriangle = t;
+			cluster.TriangleCount = 0;
+			cluster.SortKey = 0.0f;
+			clusters.push_back(cluster);
+		}
+		++clusters.back().TriangleCount;
+	}
+
+	if (clusters.size() < 2) {
+		return;
+	}
+
+	// Area-weighted centroid and normal of every cluster
+	std::vector<glm::vec3> clusterCentroids(clusters.size()), clusterNormals(clusters.size());
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (unsigned int i=0; i < clusters.size(); ++i) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		const TriangleCluster& cluster = clusters[i];
+		for (unsigned int t=cluster.FirstTriangle; t < cluster.FirstTriangle + cluster.TriangleCount; ++t) {
+			const glm::vec3& p0 = positions[indices[t * 3]];
+			const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+			const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+			const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			const float triangleArea = glm::length(n);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		clusterCentroids[i] = area > 0.0f ? centroid / area : positions[indices[cluster.FirstTriangle * 3]];
+		clusterNormals[i] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters facing away from the centroid are likely to occlude the rest, so draw them first
+	for (unsigned int i=0; i < clusters.size(); ++i) {
+		clusters[i].SortKey = glm::dot(clusterCentroids[i] - meshCentroid, clusterNormals[i]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end());
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (const TriangleCluster& cluster : clusters) {
+		result.insert(result.end(), indices.begin() + cluster.FirstTriangle * 3,
+			indices.begin() + (cluster.FirstTriangle + cluster.TriangleCount) * 3);
+	}
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int vertexCount,
+										std::vector<unsigned int>& vertexOrder)
+{
+	const unsigned int kUnassigned = ~0u;
+	std::vector<unsigned int> remap(vertexCount, kUnassigned);
+	vertexOrder.clear();
+	vertexOrder.reserve(vertexCount);
+
+	for (unsigned int& index : indices) {
+		assert(index < vertexCount);
+		if (remap[index] == kUnassigned) {
+			remap[index] = static_cast<unsigned int>(vertexOrder.size());
+			vertexOrder.push_back(index);
+		}
+		index = remap[index];
+	}
+}
+
+VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount,
+														unsigned int cacheSize)
+{
+	VertexCacheStatistics stats;
+	stats.TriangleCount = static_cast<unsigned int>(indices.size() / 3);
+
+	// FIFO cache: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	unsigned int time = cacheSize + 1;
+	for (unsigned int index : indices) {
+		assert(index < vertexCount);
+		if (time - cacheTime[index] > cacheSize) {
+			cacheTime[index] = time++;
+			++stats.TransformedVertices;
+		}
+		if (!referenced[index]) {
+			referenced[index] = true;
+			++stats.VertexCount;
+		}
+	}
+	return stats;
+}
+
+// Symmetric 4x4 error quadric of a set of weighted planes (Garland and Heckbert), doubles keep the
+// accumulated sums accurate for large meshes
+struct Quadric
+{
+public:
+	Quadric() :
+		A00(0.0), A11(0.0), A22(0.0), A01(0.0), A02(0.0), A12(0.0), B0(0.0), B1(0.0), B2(0.0), C(0.0), Weight(0.0)
+	{
+	}
+
+	// Plane dot(normal, p) + distance = 0 with a unit normal
+	Quadric(const glm::vec3& normal, float distance, float weight) :
+		A00(weight * normal.x * normal.x), A11(weight * normal.y * normal.y), A22(weight * normal.z * normal.z),
+		A01(weight * normal.x * normal.y), A02(weight * normal.x * normal.z), A12(weight * normal.y * normal.z),
+		B0(weight * normal.x * distance), B1(weight * normal.y * distance), B2(weight * normal.z * distance),
+		C(weight * distance * distance), Weight(weight)
+	{
+	}
+
+	void add(const Quadric& q)
+	{
+		A00 += q.A00; A11 += q.A11; A22 += q.A22;
+		A01 += q.A01; A02 += q.A02; A12 += q.A12;
+		B0 += q.B0; B1 += q.B1; B2 += q.B2;
+		C += q.C;
+		Weight += q.Weight;
+	}
+
+	// Weighted mean squared distance of p to the planes
+	float evaluate(const glm::vec3& p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		const double error = A00 * x * x + A11 * y * y + A22 * z * z + 2.0 * (A01 * x * y + A02 * x * z + A12 * y * z) +
+			2.0 * (B0 * x + B1 * y + B2 * z) + C;
+		return Weight > 0.0 ? static_cast<float>(fabs(error) / Weight) : 0.0f;
+	}
+
+	double A00, A11, A22, A01, A02, A12;
+	double B0, B1, B2;
+	double C;
+	double Weight;
+};
+
+// MANIFOLD vertices move freely, BORDER and SEAM vertices only along their open edges, LOCKED ones never
+enum class SimplifyVertexKind
+{
+	MANIFOLD,
+	BORDER,
+	SEAM,
+	LOCKED
+};
+
+struct EdgeCollapse
+{
+	unsigned int Source;
+	unsigned int Target;
+	float Cost;
+
+	bool operator<(const EdgeCollapse& rhs) const
+	{
+		return Cost < rhs.Cost;
+	}
+};
+
+// Open edges have no opposite half-edge between the same two vertices, openCorners flags the edge from every
+// corner to the next one of its triangle. openOut[v] and openIn[v] hold the other end of the single open edge
+// leaving or entering v, kNoEdge when there is none and v itself when there are several.
+const unsigned int kNoEdge = ~0u;
+// Open edges bend the surface as much as a face, scaled so borders and seams keep their shape
+const float kOpenEdgeWeight = 10.0f;
+// Collapses considered per pass, as a multiple of the ones needed to reach the target
+const unsigned int kCollapseCandidateScale = 3;
+const size_t kMinCandidateWindowDivisor = 8;
+
+static unsigned long long makeEdgeKey(unsigned int from, unsigned int to)
+{
+	return (static_cast<unsigned long long>(from) << 32) | to;
+}
+
+static void computeOpenEdges(const std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<bool>& openCorners,
+							 std::vector<unsigned int>& openOut, std::vector<unsigned int>& openIn)
+{
+	std::unordered_set<unsigned long long> halfEdges;
+	halfEdges.reserve(indices.size());
+	for (size_t i=0; i < indices.size(); i += 3) {
+		for (unsigned int c=0; c < 3; ++c) {
+			halfEdges.insert(makeEdgeKey(indices[i + c], indices[i + (c + 1) % 3]));
+		}
+	}
+
+	openCorners.assign(indices.size(), false);
+	openOut.assign(vertexCount, kNoEdge);
+	openIn.assign(vertexCount, kNoEdge);
+	for (size_t i=0; i < indices.size(); i += 3) {
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int from = indices[i + c], to = indices[i + (c + 1) % 3];
+			if (halfEdges.count(makeEdgeKey(to, from))) {
+				continue;
+			}
+			openCorners[i + c] = true;
+			openOut[from] = openOut[from] == kNoEdge ? to : from;
+			openIn[to] = openIn[to] == kNoEdge ? from : to;
+		}
+	}
+}
+
+static bool hasSingleOpenEdge(const std::vector<unsigned int>& openEdges, unsigned int v)
+{
+	return openEdges[v] != kNoEdge && openEdges[v] != v;
+}
+
+struct PositionHash
+{
+	size_t operator()(const glm::vec3& p) const
+	{
+		// Adding zero turns -0 into +0, which compares equal and has to hash the same
+		const glm::vec3 q = p + glm::vec3(0.0f);
+		unsigned int bits[3];
+		memcpy(bits, &q.x, sizeof(bits));
+		return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+	}
+};
+
+// Vertices sharing a position differ in some other attribute, remap points every vertex at the first
+// one of its position and wedges links the vertices of a position into a ring. Unreferenced vertices
+// stay on their own so they do not turn the others into seams.
+static void buildPositionRemap(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+							   std::vector<unsigned int>& remap, std::vector<unsigned int>& wedges)
+{
+	const unsigned int vertexCount = static_cast<unsigned int>(positions.size());
+	std::vector<bool> referenced(vertexCount, false);
+	for (unsigned int index : indices) {
+		referenced[index] = true;
+	}
+
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> firstVertices;
+	firstVertices.reserve(vertexCount);
+	remap.resize(vertexCount);
+	wedges.resize(vertexCount);
+	for (unsigned int v=0; v < vertexCount; ++v) {
+		if (!referenced[v]) {
+			remap[v] = wedges[v] = v;
+			continue;
+		}
+		const unsigned int first = firstVertices.insert(std::make_pair(positions[v], v)).first->second;
+		remap[v] = first;
+		// Insert v into the ring right after the first vertex
+		wedges[v] = first == v ? v : wedges[first];
+		wedges[first] = v;
+	}
+}
+
+// Only wedges the indices still reference count, collapses leave the others behind in the rings
+static void classifyVertices(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& remap,
+							 const std::vector<unsigned int>& wedges, const std::vector<unsigned int>& openOut,
+							 const std::vector<unsigned int>& openIn, std::vector<SimplifyVertexKind>& kinds)
+{
+	const unsigned int vertexCount = static_cast<unsigned int>(remap.size());
+	std::vector<bool> referenced(vertexCount, false);
+	for (unsigned int index : indices) {
+		referenced[index] = true;
+	}
+
+	kinds.assign(vertexCount, SimplifyVertexKind::LOCKED);
+	for (unsigned int v=0; v < vertexCount; ++v) {
+		if (remap[v] != v) {
+			continue;
+		}
+
+		unsigned int usedWedges[2] = { kNoEdge, kNoEdge };
+		unsigned int usedCount = 0;
+		unsigned int wedge = v;
+		do {
+			if (referenced[wedge]) {
+				if (usedCount < 2) {
+					usedWedges[usedCount] = wedge;
+				}
+				++usedCount;
+			}
+			wedge = wedges[wedge];
+		} while (wedge != v);
+
+		SimplifyVertexKind kind = SimplifyVertexKind::LOCKED;
+		const unsigned int u = usedWedges[0], w = usedWedges[1];
+		if (usedCount == 1) {
+			if (openOut[u] == kNoEdge && openIn[u] == kNoEdge) {
+				kind = SimplifyVertexKind::MANIFOLD;
+			}
+			else if (hasSingleOpenEdge(openOut, u) && hasSingleOpenEdge(openIn, u)) {
+				kind = SimplifyVertexKind::BORDER;
+			}
+		}
+		else if (usedCount == 2) {
+			// Two wedges whose open edges run opposite each other along one seam line
+			if (hasSingleOpenEdge(openOut, u) && hasSingleOpenEdge(openIn, u) &&
+				hasSingleOpenEdge(openOut, w) && hasSingleOpenEdge(openIn, w) &&
+				remap[openOut[u]] == remap[openIn[w]] && remap[openIn[u]] == remap[openOut[w]]) {
+				kind = SimplifyVertexKind::SEAM;
+			}
+		}
+
+		// Every wedge of a position shares its kind
+		wedge = v;
+		do {
+			kinds[wedge] = kind;
+			wedge = wedges[wedge];
+		} while (wedge != v);
+	}
+}
+
+static Quadric makeTriangleQuadric(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+	const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	const float doubleArea = glm::length(normal);
+	if (doubleArea <= 0.0f) {
+		return Quadric();
+	}
+	const glm::vec3 unitNormal = normal / doubleArea;
+	return Quadric(unitNormal, -glm::dot(unitNormal, p0), doubleArea * 0.5f);
+}
+
+// Plane through the edge perpendicular to its triangle, penalizes moving the edge within the surface
+static Quadric makeEdgeQuadric(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+	const glm::vec3 edge = p1 - p0;
+	const glm::vec3 edgeNormal = glm::cross(edge, glm::cross(edge, p2 - p0));
+	const float length = glm::length(edgeNormal);
+	if (length <= 0.0f) {
+		return Quadric();
+	}
+	const glm::vec3 unitNormal = edgeNormal / length;
+	return Quadric(unitNormal, -glm::dot(unitNormal, p0), glm::dot(edge, edge) * kOpenEdgeWeight);
+}
+
+// Moving source onto target must not flip or collapse any triangle that survives the collapse.
+// removedTriangles counts the triangles that degenerate.
+static bool isCollapseValid(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+							const std::vector<unsigned int>& remap, const std::vector<unsigned int>& adjacencyOffsets,
+							const std::vector<unsigned int>& adjacency, unsigned int source, unsigned int target,
+							unsigned int& removedTriangles)
+{
+	const glm::vec3& targetPosition = positions[target];
+	for (unsigned int a=adjacencyOffsets[source]; a < adjacencyOffsets[source + 1]; ++a) {
+		const unsigned int* const triangle = &indices[adjacency[a] * 3];
+		const unsigned int c = triangle[0] == source ? 0 : (triangle[1] == source ? 1 : 2);
+		const unsigned int v1 = triangle[(c + 1) % 3], v2 = triangle[(c + 2) % 3];
+		if (remap[v1] == remap[target] || remap[v2] == remap[target]) {
+			++removedTriangles;
+			continue;
+		}
+		const glm::vec3& p1 = positions[v1];
+		const glm::vec3& p2 = positions[v2];
+		const glm::vec3 before = glm::cross(p1 - positions[source], p2 - positions[source]);
+		const glm::vec3 after = glm::cross(p1 - targetPosition, p2 - targetPosition);
+		if (glm::dot(before, after) <= 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void MeshOptimizer::simplify(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+							 unsigned int targetIndexCount, float& error)
+{
+	assert(indices.size() % 3 == 0);
+	const unsigned int vertexCount = static_cast<unsigned int>(positions.size());
+	error = 0.0f;
+
+	std::vector<unsigned int> remap, wedges;
+	buildPositionRemap(indices, positions, remap, wedges);
+	std::vector<bool> openCorners;
+	std::vector<unsigned int> openOut, openIn;
+	computeOpenEdges(indices, vertexCount, openCorners, openOut, openIn);
+
+	// Quadrics live on the first vertex of each position so all wedges share them
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i=0; i < indices.size(); i += 3) {
+		const unsigned int* const triangle = &indices[i];
+		const Quadric triangleQuadric = makeTriangleQuadric(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int v0 = triangle[c], v1 = triangle[(c + 1) % 3], v2 = triangle[(c + 2) % 3];
+			quadrics[remap[v0]].add(triangleQuadric);
+			if (openCorners[i + c]) {
+				const Quadric edgeQuadric = makeEdgeQuadric(positions[v0], positions[v1], positions[v2]);
+				quadrics[remap[v0]].add(edgeQuadric);
+				quadrics[remap[v1]].add(edgeQuadric);
+			}
+		}
+	}
+
+	std::vector<unsigned int> adjacencyOffsets, adjacency, collapseRemap(vertexCount);
+	std::vector<EdgeCollapse> collapses;
+	std::vector<bool> lockedPositions(vertexCount);
+	std::vector<SimplifyVertexKind> kinds;
+	float maxCost = 0.0f;
+
+	while (indices.size() > targetIndexCount) {
+		const unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+		// Collapses open and close edges and leave wedges unused, so the kinds are redone on every pass
+		computeOpenEdges(indices, vertexCount, openCorners, openOut, openIn);
+		classifyVertices(indices, remap, wedges, openOut, openIn, kinds);
+
+		// Vertex to triangle adjacency
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (unsigned int index : indices) {
+			++adjacencyOffsets[index + 1];
+		}
+		for (unsigned int v=0; v < vertexCount; ++v) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(indices.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (unsigned int t=0; t < triangleCount; ++t) {
+			for (unsigned int c=0; c < 3; ++c) {
+				adjacency[fill[indices[t * 3 + c]]++] = t;
+			}
+		}
+
+		// Every directed edge is a candidate moving its first vertex onto the second
+		collapses.clear();
+		for (size_t i=0; i < indices.size(); ++i) {
+			const unsigned int source = indices[i];
+			const unsigned int target = indices[i % 3 == 2 ? i - 2 : i + 1];
+			for (unsigned int direction=0; direction < 2; ++direction) {
+				const unsigned int from = direction ? target : source, to = direction ? source : target;
+				const SimplifyVertexKind kind = kinds[from];
+				if (kind == SimplifyVertexKind::LOCKED || remap[from] == remap[to]) {
+					continue;
+				}
+				if (kind != SimplifyVertexKind::MANIFOLD &&
+					(kinds[to] != kind || (openOut[from] != to && openIn[from] != to))) {
+					continue;
+				}
+				EdgeCollapse collapse;
+				collapse.Source = from;
+				collapse.Target = to;
+				collapse.Cost = quadrics[remap[from]].evaluate(positions[to]);
+				collapses.push_back(collapse);
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+
+		// Cheapest collapses first, about two triangles go with each. The window keeps a pass from reaching
+		// for expensive collapses while cheaper ones wait on locked neighbours, it never gets so small that
+		// the last few collapses take a pass each. Candidates past it are only tried while nothing collapsed.
+		const unsigned int neededTriangles = triangleCount - targetIndexCount / 3;
+		const size_t candidateWindow = std::max(static_cast<size_t>(neededTriangles) * kCollapseCandidateScale / 2,
+			collapses.size() / kMinCandidateWindowDivisor);
+		std::sort(collapses.begin(), collapses.end());
+
+		for (unsigned int v=0; v < vertexCount; ++v) {
+			collapseRemap[v] = v;
+		}
+		lockedPositions.assign(vertexCount, false);
+		unsigned int removedTriangles = 0;
+		for (size_t i=0; i < collapses.size() && removedTriangles < neededTriangles; ++i) {
+			if (i >= candidateWindow && removedTriangles) {
+				break;
+			}
+			const EdgeCollapse& collapse = collapses[i];
+			const unsigned int source = collapse.Source, target = collapse.Target;
+			if (lockedPositions[remap[source]] || lockedPositions[remap[target]]) {
+				continue;
+			}
+
+			// A seam moves both wedges, the other one onto the wedge across the seam from target
+			unsigned int sibling = kNoEdge, siblingTarget = kNoEdge;
+			if (kinds[source] == SimplifyVertexKind::SEAM) {
+				// Earlier collapses may have left unused wedges in the ring, those have no open edges
+				sibling = wedges[source];
+				while (sibling != source && openOut[sibling] == kNoEdge) {
+					sibling = wedges[sibling];
+				}
+				siblingTarget = openOut[source] == target ? openIn[sibling] : openOut[sibling];
+				if (sibling == source || !hasSingleOpenEdge(openOut, sibling) || !hasSingleOpenEdge(openIn, sibling) ||
+					remap[siblingTarget] != remap[target]) {
+					continue;
+				}
+			}
+
+			unsigned int removed = 0;
+			if (!isCollapseValid(indices, positions, remap, adjacencyOffsets, adjacency, source, target, removed) ||
+				(sibling != kNoEdge &&
+				!isCollapseValid(indices, positions, remap, adjacencyOffsets, adjacency, sibling, siblingTarget, removed))) {
+				continue;
+			}
+
+			collapseRemap[source] = target;
+			if (sibling != kNoEdge) {
+				collapseRemap[sibling] = siblingTarget;
+			}
+			quadrics[remap[target]].add(quadrics[remap[source]]);
+			maxCost = std::max(maxCost, collapse.Cost);
+			removedTriangles += removed;
+
+			// Positions on the triangles around source moved or lost a neighbour, they wait for the next pass
+			const unsigned int movedVertices[] = { source, sibling };
+			for (unsigned int moved : movedVertices) {
+				if (moved == kNoEdge) {
+					continue;
+				}
+				for (unsigned int a=adjacencyOffsets[moved]; a < adjacencyOffsets[moved + 1]; ++a) {
+					const unsigned int* const triangle = &indices[adjacency[a] * 3];
+					lockedPositions[remap[triangle[0]]] = true;
+					lockedPositions[remap[triangle[1]]] = true;
+					lockedPositions[remap[triangle[2]]] = true;
+				}
+			}
+		}
+		if (removedTriangles == 0) {
+			break;
+		}
+
+		// Apply the collapses and drop the triangles that lost an edge
+		size_t writeIndex = 0;
+		for (size_t i=0; i < indices.size(); i += 3) {
+			const unsigned int v0 = collapseRemap[indices[i]];
+			const unsigned int v1 = collapseRemap[indices[i + 1]];
+			const unsigned int v2 = collapseRemap[indices[i + 2]];
+			if (remap[v0] == remap[v1] || remap[v1] == remap[v2] || remap[v2] == remap[v0]) {
+				continue;
+			}
+			indices[writeIndex++] = v0;
+			indices[writeIndex++] = v1;
+			indices[writeIndex++] = v2;
+		}
+		indices.resize(writeIndex);
+	}
+
+	error = sqrtf(maxCost);
+}
+
+static void computeMeshletBounds(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+								 Meshlet& meshlet)
+{
+	const unsigned int* const pIndices = &indices[meshlet.FirstIndex];
+	BoundingBox box;
+	box.Min = box.Max = positions[pIndices[0]];
+	glm::vec3 normalSum(0.0f);
+	for (unsigned int i=0; i < meshlet.IndexCount; i += 3) {
+		const glm::vec3& p0 = positions[pIndices[i]];
+		const glm::vec3& p1 = positions[pIndices[i + 1]];
+		const glm::vec3& p2 = positions[pIndices[i + 2]];
+		box.Min = glm::min(box.Min, glm::min(p0, glm::min(p1, p2)));
+		box.Max = glm::max(box.Max, glm::max(p0, glm::max(p1, p2)));
+		const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(normal);
+		if (length > 0.0f) {
+			normalSum += normal / length;
+		}
+	}
+
+	// Centered on the box like the mesh spheres, see SceneImporter
+	meshlet.Sphere.Center = box.getCenter();
+	float radiusSquared = 0.0f;
+	for (unsigned int i=0; i < meshlet.IndexCount; ++i) {
+		const glm::vec3 offset = positions[pIndices[i]] - meshlet.Sphere.Center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	meshlet.Sphere.Radius = sqrtf(radiusSquared);
+
+	// The average normal is the cone axis, the normal furthest from it sets the angle
+	const float sumLength = glm::length(normalSum);
+	meshlet.ConeAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	float minDot = sumLength > 0.0f ? 1.0f : -1.0f;
+	for (unsigned int i=0; i < meshlet.IndexCount && minDot > kMinMeshletConeDot; i += 3) {
+		const glm::vec3& p0 = positions[pIndices[i]];
+		const glm::vec3 normal = glm::cross(positions[pIndices[i + 1]] - p0, positions[pIndices[i + 2]] - p0);
+		const float length = glm::length(normal);
+		if (length > 0.0f) {
+			minDot = std::min(minDot, glm::dot(normal / length, meshlet.ConeAxis));
+		}
+	}
+	meshlet.ConeCutoff = minDot > kMinMeshletConeDot ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+}
+
+void MeshOptimizer::buildMeshlets(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+								  std::vector<Meshlet>& meshlets)
+{
+	assert(indices.size() % 3 == 0);
+	meshlets.clear();
+	if (indices.empty()) {
+		return;
+	}
+
+	// Index of the meshlet that last used each vertex
+	const unsigned int kNoMeshlet = ~0u;
+	std::vector<unsigned int> vertexMeshlets(positions.size(), kNoMeshlet);
+	auto countNewVertices = [&](const unsigned int* triangle, unsigned int meshletIndex) -> unsigned int {
+		unsigned int count = 0;
+		for (unsigned int c=0; c < 3; ++c) {
+			const unsigned int v = triangle[c];
+			if (vertexMeshlets[v] != meshletIndex && (c < 1 || v != triangle[0]) && (c < 2 || v != triangle[1])) {
+				++count;
+			}
+		}
+		return count;
+	};
+
+	Meshlet meshlet;
+	meshlet.FirstIndex = 0;
+	meshlet.IndexCount = 0;
+	unsigned int vertexCount = 0;
+	for (unsigned int i=0; i < indices.size(); i += 3) {
+		const unsigned int* const triangle = &indices[i];
+		unsigned int newVertices = countNewVertices(triangle, static_cast<unsigned int>(meshlets.size()));
+		if (vertexCount + newVertices > Meshlet::kMaxVertices || meshlet.IndexCount == Meshlet::kMaxTriangles * 3) {
+			computeMeshletBounds(indices, positions, meshlet);
+			meshlets.push_back(meshlet);
+			meshlet.FirstIndex = i;
+			meshlet.IndexCount = 0;
+			vertexCount = 0;
+			newVertices = countNewVertices(triangle, static_cast<unsigned int>(meshlets.size()));
+		}
+
+		const unsigned int meshletIndex = static_cast<unsigned int>(meshlets.size());
+		for (unsigned int c=0; c < 3; ++c) {
+			vertexMeshlets[triangle[c]] = meshletIndex;
+		}
+		vertexCount += newVertices;
+		meshlet.IndexCount += 3;
+	}
+	computeMeshletBounds(indices, positions, meshlet);
+	meshlets.push_back(meshlet);
+}
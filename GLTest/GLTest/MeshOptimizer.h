@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+
+struct Meshlet;
+
+// Post-transform cache efficiency of an index buffer, measured with a FIFO cache model
+struct VertexCacheStatistics
+{
+public:
+	VertexCacheStatistics() :
+		TransformedVertices(0), TriangleCount(0), VertexCount(0)
+	{
+	}
+
+	void add(const VertexCacheStatistics& stats)
+	{
+		TransformedVertices += stats.TransformedVertices;
+		TriangleCount += stats.TriangleCount;
+		VertexCount += stats.VertexCount;
+	}
+
+	// Average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for regular grids
+	float getACMR() const { return TriangleCount ? static_cast<float>(TransformedVertices) / TriangleCount : 0.0f; }
+	// Average transform to vertex ratio: 1.0 means every vertex is transformed exactly once
+	float getATVR() const { return VertexCount ? static_cast<float>(TransformedVertices) / VertexCount : 0.0f; }
+
+	unsigned int TransformedVertices;
+	unsigned int TriangleCount;
+	unsigned int VertexCount;
+};
+
+// Import-time index and vertex reordering for GPU-friendly meshes
+class MeshOptimizer
+{
+public:
+	// Reorders triangles for post-transform cache locality (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	static void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+	// Splits cache-optimized triangles into clusters and sorts them front to back from the mesh centroid
+	// to reduce overdraw (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+	static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+
+	// Renumbers vertices in order of first use and drops unreferenced ones.
+	// vertexOrder[newIndex] holds the original vertex index.
+	static void optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int vertexCount,
+		std::vector<unsigned int>& vertexOrder);
+
+	// Quadric error edge collapse (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics")
+	// onto existing vertices until at most targetIndexCount indices remain or nothing can collapse.
+	// Vertices sharing a position with different attributes only collapse along their seam, with all their
+	// wedges, so UV and normal discontinuities survive. Open borders only collapse along the border.
+	// error receives the largest object space distance a collapse moved the surface by.
+	static void simplify(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		unsigned int targetIndexCount, float& error);
+
+	// Splits the triangles into meshlets of consecutive triangles in index order, so the cache and overdraw
+	// order is kept and every meshlet is a contiguous index range. A meshlet ends when the next triangle
+	// would take it past Meshlet::kMaxVertices or Meshlet::kMaxTriangles.
+	static void buildMeshlets(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		std::vector<Meshlet>& meshlets);
+
+	static VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount,
+		unsigned int cacheSize = kDefaultCacheSize);
+
+	static const unsigned int kDefaultCacheSize;
+};
@@ -0,0 +1,61 @@
+#include "MeshletCuller.h"
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Material.h"
+#include "SceneData.h"
+#include "SceneGraph.h"
+#include "Frustum.h"
+
+MeshletCuller::MeshletCuller() :
+	mCameraPosition(0.0f),
+	mTestedCount(0),
+	mFrustumCulledCount(0),
+	mBackfaceCulledCount(0)
+{
+}
+
+void MeshletCuller::beginFrame(const glm::vec3& cameraPosition)
+{
+	mCameraPosition = cameraPosition;
+	mTestedCount = 0;
+	mFrustumCulledCount = 0;
+	mBackfaceCulledCount = 0;
+}
+
+void MeshletCuller::cull(const SceneGraph& sceneGraph, const Mesh& mesh, unsigned int instance,
+						 std::vector<IndexRange>& ranges)
+{
+	const unsigned int nodeIndex = sceneGraph.getInstanceNode(instance);
+	const Frustum frustum(sceneGraph.getWorldViewProjectionMatrix(nodeIndex));
+	const glm::vec3 camera(glm::inverse(sceneGraph.getWorldMatrix(nodeIndex)) * glm::vec4(mCameraPosition, 1.0f));
+
+	// Back faces of two-sided materials are visible, the rasterizer does not cull them either
+	const bool testCones = !mesh.getMaterial().isTwoSided();
+	const unsigned int meshletCount = mesh.getMeshletCount();
+	const size_t firstRange = ranges.size();
+	for (unsigned int i=0; i < meshletCount; ++i) {
+		const Meshlet& meshlet = mesh.getMeshlet(i);
+		if (!frustum.intersects(meshlet.Sphere)) {
+			++mFrustumCulledCount;
+			continue;
+		}
+		// Every triangle faces away when the direction to the cluster lies inside the cone widened by the
+		// angle the sphere covers
+		const glm::vec3 offset = meshlet.Sphere.Center - camera;
+		if (testCones && glm::dot(offset, meshlet.ConeAxis) >= meshlet.ConeCutoff * glm::length(offset) + meshlet.Sphere.Radius) {
+			++mBackfaceCulledCount;
+			continue;
+		}
+
+		if (ranges.size() > firstRange && ranges.back().FirstIndex + ranges.back().IndexCount == meshlet.FirstIndex) {
+			ranges.back().IndexCount += meshlet.IndexCount;
+		}
+		else {
+			IndexRange range;
+			range.FirstIndex = meshlet.FirstIndex;
+			range.IndexCount = meshlet.IndexCount;
+			ranges.push_back(range);
+		}
+	}
+	mTestedCount += meshletCount;
+}
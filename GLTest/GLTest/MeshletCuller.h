@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include "RenderQueue.h"
+
+class Mesh;
+class SceneGraph;
+
+// Culls the meshlets of instances drawn at full detail against the view frustum and against their normal
+// cones, so clusters lying off screen or facing away from the camera are never drawn. Meshes with a two-sided
+// material only get the frustum test. Both tests run in the instance's object space on the cooked meshlet data:
+// the frustum planes come from the world-view-projection matrix and the camera position is moved into object space.
+class MeshletCuller
+{
+public:
+	MeshletCuller();
+
+	void beginFrame(const glm::vec3& cameraPosition);
+	// Appends the index ranges of the meshlets that may be visible, neighbouring ones merged into one range.
+	// Nothing is appended when every meshlet is culled.
+	void cull(const SceneGraph& sceneGraph, const Mesh& mesh, unsigned int instance, std::vector<IndexRange>& ranges);
+
+	// Statistics since beginFrame
+	unsigned int getTestedCount() const { return mTestedCount; }
+	unsigned int getFrustumCulledCount() const { return mFrustumCulledCount; }
+	unsigned int getBackfaceCulledCount() const { return mBackfaceCulledCount; }
+
+private:
+	glm::vec3 mCameraPosition;
+	unsigned int mTestedCount;
+	unsigned int mFrustumCulledCount;
+	unsigned int mBackfaceCulledCount;
+
+	MeshletCuller(const MeshletCuller& rhs);
+	MeshletCuller& operator=(const MeshletCuller& rhs);
+};
@@ -0,0 +1,241 @@
+#include "MipGenerator.h"
+#include <assert.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <xmmintrin.h>
+#include "TextureData.h"
+#include "JobPool.h"
+
+// Builds with -mavx filter two RGBA pixels per instruction in the vertical pass. The v110 project enables no
+// enhanced instruction set, so Visual Studio builds ship the SSE path.
+#if defined(__AVX2__) || defined(__AVX__)
+#define MIP_GENERATOR_AVX
+#include <immintrin.h>
+#endif
+
+// Smaller passes are not worth a thread each
+const unsigned int kMinPixelsPerThread = 64 * 1024;
+const unsigned int kMaxTaps = 6;
+const float kPi = 3.14159265f;
+
+struct FilterKernel
+{
+	int FirstOffset;
+	unsigned int Step;
+	std::vector<float> Weights;
+};
+
+// RGBA float image, linear or gamma encoded depending on the filter
+struct FloatImage
+{
+	void resize(unsigned int width, unsigned int height)
+	{
+		Width = width;
+		Height = height;
+		Pixels.resize(static_cast<size_t>(width) * height * 4);
+	}
+
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<float> Pixels;
+};
+
+static float besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k=1; k < 16; ++k) {
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static float sinc(float x)
+{
+	return fabsf(x) < 1e-6f ? 1.0f : sinf(kPi * x) / (kPi * x);
+}
+
+static float kaiser(float x, float alpha, float width)
+{
+	const float t = x / width;
+	return fabsf(t) >= 1.0f ? 0.0f : besselI0(alpha * sqrtf(1.0f - t * t)) / besselI0(alpha);
+}
+
+static FilterKernel createKernel(MipFilter filter)
+{
+	FilterKernel kernel;
+	kernel.Step = 2;
+	if (filter == MipFilter::BOX) {
+		kernel.FirstOffset = 0;
+		kernel.Weights.assign(2, 0.5f);
+		return kernel;
+	}
+
+	// Taps sit 0.5, 1.5 and 2.5 source texels either side of the destination texel center.
+	// The sinc cutoff is at the destination Nyquist frequency.
+	const float kAlpha = 4.0f, kWidth = 3.0f;
+	kernel.FirstOffset = -2;
+	float weightSum = 0.0f;
+	for (unsigned int i=0; i < kMaxTaps; ++i) {
+		const float x = i - 2.5f;
+		const float weight = sinc(x * 0.5f) * kaiser(x, kAlpha, kWidth);
+		kernel.Weights.push_back(weight);
+		weightSum += weight;
+	}
+	for (float& weight : kernel.Weights) {
+		weight /= weightSum;
+	}
+	return kernel;
+}
+
+// Used along an axis that is already one texel wide
+static FilterKernel createIdentityKernel()
+{
+	FilterKernel kernel;
+	kernel.FirstOffset = 0;
+	kernel.Step = 1;
+	kernel.Weights.assign(1, 1.0f);
+	return kernel;
+}
+
+static unsigned int getRowsPerThread(unsigned int width)
+{
+	return std::max(1u, kMinPixelsPerThread / width);
+}
+
+// Filters along y, whole rows at a time since they are contiguous
+static void filterRows(const FloatImage& source, const FilterKernel& kernel, FloatImage& result, unsigned int firstRow, unsigned int endRow)
+{
+	const unsigned int floatCount = source.Width * 4;
+	const unsigned int tapCount = static_cast<unsigned int>(kernel.Weights.size());
+	const float* sourceRows[kMaxTaps];
+	for (unsigned int y=firstRow; y < endRow; ++y) {
+		for (unsigned int k=0; k < tapCount; ++k) {
+			const int sourceY = std::min(std::max(static_cast<int>(y * kernel.Step) + kernel.FirstOffset + static_cast<int>(k), 0),
+				static_cast<int>(source.Height) - 1);
+			sourceRows[k] = &source.Pixels[sourceY * floatCount];
+		}
+
+		float* const pOut = &result.Pixels[y * floatCount];
+		unsigned int x = 0;
+#if defined(MIP_GENERATOR_AVX)
+		for (; x + 8 <= floatCount; x += 8) {
+			__m256 sum = _mm256_setzero_ps();
+			for (unsigned int k=0; k < tapCount; ++k) {
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(sourceRows[k] + x), _mm256_set1_ps(kernel.Weights[k])));
+			}
+			_mm256_storeu_ps(pOut + x, sum);
+		}
+#endif
+		for (; x < floatCount; x += 4) {
+			__m128 sum = _mm_setzero_ps();
+			for (unsigned int k=0; k < tapCount; ++k) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sourceRows[k] + x), _mm_set1_ps(kernel.Weights[k])));
+			}
+			_mm_storeu_ps(pOut + x, sum);
+		}
+	}
+}
+
+// Filters along x, one RGBA texel per vector
+static void filterColumns(const FloatImage& source, const FilterKernel& kernel, FloatImage& result, unsigned int firstRow, unsigned int endRow)
+{
+	const unsigned int tapCount = static_cast<unsigned int>(kernel.Weights.size());
+	__m128 weights[kMaxTaps];
+	for (unsigned int k=0; k < tapCount; ++k) {
+		weights[k] = _mm_set1_ps(kernel.Weights[k]);
+	}
+
+	for (unsigned int y=firstRow; y < endRow; ++y) {
+		const float* const pSourceRow = &source.Pixels[y * source.Width * 4];
+		float* const pOut = &result.Pixels[y * result.Width * 4];
+		for (unsigned int x=0; x < result.Width; ++x) {
+			__m128 sum = _mm_setzero_ps();
+			for (unsigned int k=0; k < tapCount; ++k) {
+				const int sourceX = std::min(std::max(static_cast<int>(x * kernel.Step) + kernel.FirstOffset + static_cast<int>(k), 0),
+					static_cast<int>(source.Width) - 1);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pSourceRow + sourceX * 4), weights[k]));
+			}
+			_mm_storeu_ps(pOut + x * 4, sum);
+		}
+	}
+}
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char quantize(float value)
+{
+	return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Alpha is always linear
+static void decodeLevel(const MipLevel& level, bool gammaCorrect, FloatImage& result)
+{
+	float colorTable[256], alphaTable[256];
+	for (unsigned int i=0; i < 256; ++i) {
+		alphaTable[i] = i / 255.0f;
+		colorTable[i] = gammaCorrect ? srgbToLinear(alphaTable[i]) : alphaTable[i];
+	}
+
+	result.resize(level.Width, level.Height);
+	const size_t valueCount = result.Pixels.size();
+	for (size_t i=0; i < valueCount; i += 4) {
+		result.Pixels[i] = colorTable[level.Data[i]];
+		result.Pixels[i + 1] = colorTable[level.Data[i + 1]];
+		result.Pixels[i + 2] = colorTable[level.Data[i + 2]];
+		result.Pixels[i + 3] = alphaTable[level.Data[i + 3]];
+	}
+}
+
+static void encodeLevel(const FloatImage& image, bool gammaCorrect, MipLevel& level)
+{
+	level.Width = image.Width;
+	level.Height = image.Height;
+	level.Data.resize(image.Pixels.size());
+	for (size_t i=0; i < image.Pixels.size(); ++i) {
+		const bool isColor = (i & 3) != 3;
+		level.Data[i] = quantize(gammaCorrect && isColor ? linearToSrgb(std::max(image.Pixels[i], 0.0f)) : image.Pixels[i]);
+	}
+}
+
+void MipGenerator::generate(TextureData& texture, MipFilter filter)
+{
+	assert(!texture.isCompressed() && !texture.Levels.empty());
+	texture.Levels.resize(1);
+	const unsigned int levelCount = TextureData::getMipLevelCount(texture.getWidth(), texture.getHeight());
+	texture.Levels.reserve(levelCount);
+
+	const bool gammaCorrect = filter == MipFilter::GAMMA_CORRECT;
+	const FilterKernel kernel = createKernel(filter);
+	const FilterKernel identity = createIdentityKernel();
+
+	FloatImage source, filtered, result;
+	decodeLevel(texture.Levels[0], gammaCorrect, source);
+	for (unsigned int i=1; i < levelCount; ++i) {
+		const FilterKernel& verticalKernel = source.Height > 1 ? kernel : identity;
+		const FilterKernel& horizontalKernel = source.Width > 1 ? kernel : identity;
+
+		filtered.resize(source.Width, std::max(1u, source.Height / 2));
+		JobPool::getShared().parallelFor(filtered.Height, getRowsPerThread(filtered.Width), [&](unsigned int firstRow, unsigned int endRow) {
+			filterRows(source, verticalKernel, filtered, firstRow, endRow);
+		});
+
+		result.resize(std::max(1u, source.Width / 2), filtered.Height);
+		JobPool::getShared().parallelFor(result.Height, getRowsPerThread(result.Width), [&](unsigned int firstRow, unsigned int endRow) {
+			filterColumns(filtered, horizontalKernel, result, firstRow, endRow);
+		});
+
+		texture.Levels.push_back(MipLevel());
+		encodeLevel(result, gammaCorrect, texture.Levels.back());
+		std::swap(source, result);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+struct TextureData;
+
+enum class MipFilter
+{
+	BOX,			// 2x2 average
+	KAISER,			// Kaiser-windowed sinc, sharper and with less aliasing than the box
+	GAMMA_CORRECT	// Kaiser filter applied to linear color, for sRGB color maps
+};
+
+// Builds RGBA8 mip chains on the CPU. Every level is produced from the float data of the previous one
+// with a separable filter, the rows of each pass are split across the shared JobPool.
+class MipGenerator
+{
+public:
+	// Replaces every level after the first one
+	static void generate(TextureData& texture, MipFilter filter);
+};
@@ -0,0 +1,326 @@
+#include "OcclusionCuller.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <xmmintrin.h>
+#include "JobPool.h"
+#include "SceneData.h"
+#include "SceneGraph.h"
+#include "VertexPacking.h"
+
+// Orders mesh indices by decreasing bounding box surface area
+struct LargerBounds
+{
+	explicit LargerBounds(const std::vector<MeshData>& meshes) :
+		Meshes(meshes)
+	{
+	}
+
+	bool operator()(unsigned int lhs, unsigned int rhs) const
+	{
+		return Meshes[lhs].Bounds.getSurfaceArea() > Meshes[rhs].Bounds.getSurfaceArea();
+	}
+
+	const std::vector<MeshData>& Meshes;
+};
+
+OcclusionCuller::OcclusionCuller() :
+	mOccludedCount(0),
+	mRasterizationTime(0.0)
+{
+	unsigned int width = kWidth, height = kHeight, size = 0;
+	for (;;) {
+		mLevelOffsets.push_back(size);
+		size += width * height;
+		if (width == 1 && height == 1) {
+			break;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	mDepthPyramid.assign(size, 1.0f);
+}
+
+void OcclusionCuller::selectOccluders(const std::vector<MeshData>& meshes)
+{
+	clear();
+	mOccluderSlots.assign(meshes.size(), -1);
+	std::vector<unsigned int> order(meshes.size());
+	for (unsigned int i=0; i < order.size(); ++i) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), LargerBounds(meshes));
+
+	unsigned int triangleBudget = kMaxOccluderTriangles;
+	for (unsigned int meshIndex : order) {
+		const MeshData& mesh = meshes[meshIndex];
+		// Full detail only, a simplified level may poke out of the real surface and hide what it should not
+		const unsigned int triangleCount = mesh.Lods.empty() ? 0 : mesh.Lods[0].IndexCount / 3;
+		const VertexAttributeFormat* const pPosition = mesh.Layout.findAttribute(VertexAttribute::POSITION);
+		if (triangleCount == 0 || triangleCount > kMaxTrianglesPerOccluder || triangleCount > triangleBudget || !pPosition ||
+			!mesh.VertexData.pData || !mesh.IndexData.pData) {
+			continue;
+		}
+
+		OccluderMesh occluder;
+		occluder.FirstVertex = static_cast<unsigned int>(mOccluderPositions.size());
+		occluder.VertexCount = mesh.VertexCount;
+		occluder.FirstIndex = static_cast<unsigned int>(mOccluderIndices.size());
+		occluder.IndexCount = triangleCount * 3;
+
+		const unsigned char* pVertex = mesh.VertexData.pData + pPosition->Offset;
+		for (unsigned int i=0; i < mesh.VertexCount; ++i, pVertex += mesh.Layout.Stride) {
+			mOccluderPositions.push_back(glm::vec3(decodeAttribute(*pPosition, mesh.Quantization, pVertex)));
+		}
+		for (unsigned int i=0; i < occluder.IndexCount; ++i) {
+			const unsigned int index = mesh.IndexType == GL_UNSIGNED_SHORT ?
+				reinterpret_cast<const GLushort*>(mesh.IndexData.pData)[i] : reinterpret_cast<const GLuint*>(mesh.IndexData.pData)[i];
+			assert(index < mesh.VertexCount);
+			mOccluderIndices.push_back(index);
+		}
+
+		mOccluderSlots[meshIndex] = static_cast<int>(mOccluderMeshes.size());
+		mOccluderMeshes.push_back(occluder);
+		triangleBudget -= triangleCount;
+	}
+}
+
+void OcclusionCuller::clear()
+{
+	mOccluderSlots.clear();
+	mOccluderMeshes.clear();
+	mOccluderPositions.clear();
+	mOccluderIndices.clear();
+	mTriangles.clear();
+	std::fill(mDepthPyramid.begin(), mDepthPyramid.end(), 1.0f);
+}
+
+void OcclusionCuller::render(const SceneGraph& sceneGraph, const std::vector<unsigned int>& instances,
+	const glm::mat4& viewProjection)
+{
+	const std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+	mViewProjection = viewProjection;
+	mTriangles.clear();
+
+	for (unsigned int instance : instances) {
+		const unsigned int meshIndex = sceneGraph.getInstanceMesh(instance);
+		if (!isOccluder(meshIndex)) {
+			continue;
+		}
+		const OccluderMesh& occluder = mOccluderMeshes[mOccluderSlots[meshIndex]];
+		const glm::mat4& wvp = sceneGraph.getWorldViewProjectionMatrix(sceneGraph.getInstanceNode(instance));
+		mClipPositions.resize(occluder.VertexCount);
+		for (unsigned int i=0; i < occluder.VertexCount; ++i) {
+			mClipPositions[i] = wvp * glm::vec4(mOccluderPositions[occluder.FirstVertex + i], 1.0f);
+		}
+		const unsigned int* const pIndices = &mOccluderIndices[occluder.FirstIndex];
+		for (unsigned int i=0; i < occluder.IndexCount; i += 3) {
+			addClippedTriangle(mClipPositions[pIndices[i]], mClipPositions[pIndices[i + 1]], mClipPositions[pIndices[i + 2]]);
+		}
+	}
+
+	std::fill(mDepthPyramid.begin(), mDepthPyramid.begin() + kWidth * kHeight, 1.0f);
+	// Bands of rows, the calling thread takes the first one
+	JobPool::getShared().parallelFor(kHeight, kMinRowsPerThread, [this](unsigned int firstRow, unsigned int endRow) {
+		rasterizeRows(firstRow, endRow);
+	});
+	buildPyramid();
+
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+	mRasterizationTime = elapsed.count();
+}
+
+// Clips against the near plane z >= -w, the other planes are handled by the screen bounds and depth clear
+void OcclusionCuller::addClippedTriangle(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2)
+{
+	const glm::vec4* const vertices[3] = { &clip0, &clip1, &clip2 };
+	float distances[3];
+	unsigned int insideCount = 0;
+	for (int i=0; i < 3; ++i) {
+		distances[i] = vertices[i]->z + vertices[i]->w;
+		insideCount += distances[i] >= 0.0f ? 1 : 0;
+	}
+	if (insideCount == 3) {
+		addTriangle(clip0, clip1, clip2);
+		return;
+	}
+	if (insideCount == 0) {
+		return;
+	}
+
+	glm::vec4 polygon[4];
+	unsigned int polygonSize = 0;
+	for (int i=0; i < 3; ++i) {
+		const int next = (i + 1) % 3;
+		if (distances[i] >= 0.0f) {
+			polygon[polygonSize++] = *vertices[i];
+		}
+		if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+			const float t = distances[i] / (distances[i] - distances[next]);
+			polygon[polygonSize++] = *vertices[i] + (*vertices[next] - *vertices[i]) * t;
+		}
+	}
+	for (unsigned int i=1; i + 1 < polygonSize; ++i) {
+		addTriangle(polygon[0], polygon[i], polygon[i + 1]);
+	}
+}
+
+void OcclusionCuller::addTriangle(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2)
+{
+	const glm::vec4* const vertices[3] = { &clip0, &clip1, &clip2 };
+	float x[3], y[3], z[3];
+	for (int i=0; i < 3; ++i) {
+		const glm::vec4& clip = *vertices[i];
+		if (clip.w <= 0.0f) {
+			return;
+		}
+		const float invW = 1.0f / clip.w;
+		x[i] = (clip.x * invW * 0.5f + 0.5f) * kWidth;
+		y[i] = (clip.y * invW * 0.5f + 0.5f) * kHeight;
+		z[i] = clip.z * invW * 0.5f + 0.5f;
+	}
+
+	// Pixels are covered when their center is, centers sit at i + 0.5
+	ScreenTriangle triangle;
+	triangle.MinX = std::max(0, static_cast<int>(ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f)));
+	triangle.MaxX = std::min(static_cast<int>(kWidth) - 1, static_cast<int>(floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f)));
+	triangle.MinY = std::max(0, static_cast<int>(ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f)));
+	triangle.MaxY = std::min(static_cast<int>(kHeight) - 1, static_cast<int>(floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f)));
+	if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY) {
+		return;
+	}
+
+	const float dx1 = x[1] - x[0], dy1 = y[1] - y[0], dx2 = x[2] - x[0], dy2 = y[2] - y[0];
+	const float area = dx1 * dy2 - dx2 * dy1;
+	if (fabsf(area) < 1e-8f) {
+		return;
+	}
+	// Both windings are drawn, the edges are flipped so the inside is positive either way
+	const float sign = area > 0.0f ? -1.0f : 1.0f;
+	for (int i=0; i < 3; ++i) {
+		const int next = (i + 1) % 3;
+		triangle.EdgeA[i] = sign * (y[next] - y[i]);
+		triangle.EdgeB[i] = sign * (x[i] - x[next]);
+		triangle.EdgeC[i] = -(triangle.EdgeA[i] * x[i] + triangle.EdgeB[i] * y[i]);
+	}
+	const float dz1 = z[1] - z[0], dz2 = z[2] - z[0];
+	triangle.DepthDx = (dz1 * dy2 - dz2 * dy1) / area;
+	triangle.DepthDy = (dx1 * dz2 - dx2 * dz1) / area;
+	triangle.DepthC = z[0] - triangle.DepthDx * x[0] - triangle.DepthDy * y[0];
+	mTriangles.push_back(triangle);
+}
+
+void OcclusionCuller::rasterizeRows(unsigned int firstRow, unsigned int endRow)
+{
+	float* const pDepth = &mDepthPyramid[0];
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	for (const ScreenTriangle& triangle : mTriangles) {
+		const int minY = std::max(triangle.MinY, static_cast<int>(firstRow));
+		const int maxY = std::min(triangle.MaxY, static_cast<int>(endRow) - 1);
+		if (minY > maxY) {
+			continue;
+		}
+		// Groups of four pixels start on a multiple of four, the width is one too
+		const int minX = triangle.MinX & ~3;
+
+		const __m128 edgeA0 = _mm_set1_ps(triangle.EdgeA[0]), edgeA1 = _mm_set1_ps(triangle.EdgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(triangle.EdgeA[2]), depthDx = _mm_set1_ps(triangle.DepthDx);
+		for (int y=minY; y <= maxY; ++y) {
+			const float centerY = y + 0.5f;
+			const __m128 rowEdge0 = _mm_set1_ps(triangle.EdgeB[0] * centerY + triangle.EdgeC[0]);
+			const __m128 rowEdge1 = _mm_set1_ps(triangle.EdgeB[1] * centerY + triangle.EdgeC[1]);
+			const __m128 rowEdge2 = _mm_set1_ps(triangle.EdgeB[2] * centerY + triangle.EdgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(triangle.DepthDy * centerY + triangle.DepthC);
+			float* const pRow = pDepth + y * kWidth;
+			for (int x=minX; x <= triangle.MaxX; x += 4) {
+				const __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), pixelOffsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, centerX), rowEdge0), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, centerX), rowEdge1), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, centerX), rowEdge2), zero));
+				if (!_mm_movemask_ps(inside)) {
+					continue;
+				}
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(depthDx, centerX), rowDepth);
+				const __m128 previous = _mm_loadu_ps(pRow + x);
+				const __m128 nearest = _mm_min_ps(previous, depth);
+				_mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	unsigned int width = kWidth, height = kHeight;
+	for (size_t level=1; level < mLevelOffsets.size(); ++level) {
+		const float* const pSource = &mDepthPyramid[mLevelOffsets[level - 1]];
+		float* const pDest = &mDepthPyramid[mLevelOffsets[level]];
+		const unsigned int destWidth = width > 1 ? width / 2 : 1, destHeight = height > 1 ? height / 2 : 1;
+		for (unsigned int y=0; y < destHeight; ++y) {
+			const float* const pRow0 = pSource + std::min(2 * y, height - 1) * width;
+			const float* const pRow1 = pSource + std::min(2 * y + 1, height - 1) * width;
+			for (unsigned int x=0; x < destWidth; ++x) {
+				const unsigned int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+				pDest[y * destWidth + x] = std::max(std::max(pRow0[x0], pRow0[x1]), std::max(pRow1[x0], pRow1[x1]));
+			}
+		}
+		width = destWidth;
+		height = destHeight;
+	}
+}
+
+bool OcclusionCuller::isOccluded(const BoundingBox& box) const
+{
+	glm::vec3 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+	for (int corner=0; corner < 8; ++corner) {
+		const glm::vec4 clip = mViewProjection * glm::vec4(corner & 1 ? box.Max.x : box.Min.x, corner & 2 ? box.Max.y : box.Min.y,
+			corner & 4 ? box.Max.z : box.Min.z, 1.0f);
+		// Boxes reaching the near plane are never hidden
+		if (clip.w <= 0.0f || clip.z < -clip.w) {
+			return false;
+		}
+		const glm::vec3 screen((clip.x / clip.w * 0.5f + 0.5f) * kWidth, (clip.y / clip.w * 0.5f + 0.5f) * kHeight,
+			clip.z / clip.w * 0.5f + 0.5f);
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+	}
+
+	const int minX = std::max(0, static_cast<int>(floorf(screenMin.x)));
+	const int maxX = std::min(static_cast<int>(kWidth) - 1, static_cast<int>(floorf(screenMax.x)));
+	const int minY = std::max(0, static_cast<int>(floorf(screenMin.y)));
+	const int maxY = std::min(static_cast<int>(kHeight) - 1, static_cast<int>(floorf(screenMax.y)));
+	if (minX > maxX || minY > maxY) {
+		return false;
+	}
+
+	// The first level where the rectangle covers at most 2x2 texels
+	unsigned int level = 0;
+	while (level + 1 < mLevelOffsets.size() && ((maxX >> level) - (minX >> level) > 1 || (maxY >> level) - (minY >> level) > 1)) {
+		++level;
+	}
+	const unsigned int levelWidth = kWidth >> level ? kWidth >> level : 1;
+	const float* const pLevel = &mDepthPyramid[mLevelOffsets[level]];
+	float maxDepth = 0.0f;
+	for (int y=minY >> level; y <= maxY >> level; ++y) {
+		for (int x=minX >> level; x <= maxX >> level; ++x) {
+			maxDepth = std::max(maxDepth, pLevel[y * levelWidth + x]);
+		}
+	}
+	return screenMin.z > maxDepth;
+}
+
+unsigned int OcclusionCuller::cullInstances(const BoundingBoxArray& bounds, std::vector<unsigned int>& instances)
+{
+	size_t visibleCount = 0;
+	for (size_t i=0; i < instances.size(); ++i) {
+		if (!isOccluded(bounds.get(instances[i]))) {
+			instances[visibleCount++] = instances[i];
+		}
+	}
+	mOccludedCount = static_cast<unsigned int>(instances.size() - visibleCount);
+	instances.resize(visibleCount);
+	return mOccludedCount;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+struct MeshData;
+struct BoundingBox;
+struct BoundingBoxArray;
+class SceneGraph;
+
+// Software occlusion culling. The largest meshes of the scene are kept on the CPU as occluders and rasterized
+// depth-only into a small buffer, split into row bands across threads with four pixels per SSE instruction.
+// A max-depth mip pyramid over that buffer then rejects boxes lying entirely behind the occluders.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Copies the positions and indices of the occluder meshes, call while the scene still holds its geometry
+	void selectOccluders(const std::vector<MeshData>& meshes);
+	void clear();
+	bool isOccluder(unsigned int meshIndex) const { return meshIndex < mOccluderSlots.size() && mOccluderSlots[meshIndex] >= 0; }
+
+	// Rasterizes the occluders among the instances and builds the depth pyramid
+	void render(const SceneGraph& sceneGraph, const std::vector<unsigned int>& instances, const glm::mat4& viewProjection);
+	// Removes the instances hidden in the last render(), returns how many were removed
+	unsigned int cullInstances(const BoundingBoxArray& bounds, std::vector<unsigned int>& instances);
+	bool isOccluded(const BoundingBox& box) const;
+
+	// Statistics of the last frame
+	unsigned int getOccludedCount() const { return mOccludedCount; }
+	unsigned int getRasterizedTriangleCount() const { return static_cast<unsigned int>(mTriangles.size()); }
+	// Milliseconds spent in render()
+	double getRasterizationTime() const { return mRasterizationTime; }
+
+	static const unsigned int kWidth = 256;
+	static const unsigned int kHeight = 128;
+
+private:
+	struct OccluderMesh
+	{
+		unsigned int FirstVertex;
+		unsigned int VertexCount;
+		unsigned int FirstIndex;
+		unsigned int IndexCount;
+	};
+
+	// Edge functions and depth plane in pixel coordinates, every edge is >= 0 inside
+	struct ScreenTriangle
+	{
+		float EdgeA[3], EdgeB[3], EdgeC[3];
+		float DepthDx, DepthDy, DepthC;
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	std::vector<int> mOccluderSlots;
+	std::vector<OccluderMesh> mOccluderMeshes;
+	std::vector<glm::vec3> mOccluderPositions;
+	std::vector<unsigned int> mOccluderIndices;
+
+	glm::mat4 mViewProjection;
+	std::vector<glm::vec4> mClipPositions;
+	std::vector<ScreenTriangle> mTriangles;
+	// Every level of the pyramid back to back, level 0 is the rasterized depth
+	std::vector<float> mDepthPyramid;
+	std::vector<unsigned int> mLevelOffsets;
+
+	unsigned int mOccludedCount;
+	double mRasterizationTime;
+
+	void addTriangle(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2);
+	void addClippedTriangle(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2);
+	void rasterizeRows(unsigned int firstRow, unsigned int endRow);
+	void buildPyramid();
+
+	// Occluders are picked by bounding box surface area until the triangle budget is spent
+	static const unsigned int kMaxOccluderTriangles = 65536;
+	static const unsigned int kMaxTrianglesPerOccluder = 8192;
+	static const unsigned int kMinRowsPerThread = 16;
+
+	OcclusionCuller(const OcclusionCuller& rhs);
+	OcclusionCuller& operator=(const OcclusionCuller& rhs);
+};
@@ -0,0 +1,185 @@
+#include "OcclusionQueries.h"
+#include <assert.h>
+#include "Bounds.h"
+#include "GPUProgram.h"
+#include "GLState.h"
+#include "GPUBuffers.h"
+
+const UniformId kBoxMatrixUniform("BoxMatrix");
+
+OcclusionQueries::OcclusionQueries() :
+	mpProgram(nullptr),
+	mTarget(GL_SAMPLES_PASSED),
+	mVAO(0),
+	mVBO(0),
+	mElementBuffer(0),
+	mCullFaceEnabled(GL_FALSE),
+	mIssuedCount(0)
+{
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+	destroy();
+}
+
+bool OcclusionQueries::init(const GPUProgram& program)
+{
+	assert(!mVAO);
+	// The conservative target lets the driver answer from coarse depth, a plain sample count is the fallback
+	if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility) {
+		mTarget = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+	}
+	else if (GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2) {
+		mTarget = GL_ANY_SAMPLES_PASSED;
+	}
+	else {
+		mTarget = GL_SAMPLES_PASSED;
+	}
+
+	const GLfloat corners[] = {
+		-1.0f, -1.0f, -1.0f,	1.0f, -1.0f, -1.0f,		-1.0f, 1.0f, -1.0f,		1.0f, 1.0f, -1.0f,
+		-1.0f, -1.0f, 1.0f,		1.0f, -1.0f, 1.0f,		-1.0f, 1.0f, 1.0f,		1.0f, 1.0f, 1.0f
+	};
+	// Corner i has x, y and z set from bits 0, 1 and 2, face culling is off so the winding does not matter
+	const GLubyte indices[] = {
+		0, 2, 1, 1, 2, 3,	4, 5, 6, 5, 7, 6,	0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,	0, 4, 2, 2, 4, 6,	1, 3, 5, 3, 7, 5
+	};
+
+	glGenVertexArrays(1, &mVAO);
+	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mElementBuffer);
+	if (!mVAO || !mVBO || !mElementBuffer) {
+		destroy();
+		return false;
+	}
+	GLState::bindVertexArray(mVAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	const GLuint location = static_cast<GLuint>(VertexAttribute::POSITION);
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	mpProgram = &program;
+	return true;
+}
+
+void OcclusionQueries::destroy()
+{
+	if (!mAllQueries.empty()) {
+		glDeleteQueries(static_cast<GLsizei>(mAllQueries.size()), &mAllQueries[0]);
+		mAllQueries.clear();
+	}
+	mFreeQueries.clear();
+	mPendingQueries.clear();
+	mVisible.clear();
+	if (mVAO) {
+		glDeleteVertexArrays(1, &mVAO);
+		GLState::forgetVertexArray(mVAO);
+		mVAO = 0;
+	}
+	GLuint* const buffers[] = { &mVBO, &mElementBuffer };
+	for (GLuint* pBuffer : buffers) {
+		if (*pBuffer) {
+			glDeleteBuffers(1, pBuffer);
+			GLState::forgetBuffer(*pBuffer);
+			*pBuffer = 0;
+		}
+	}
+	mpProgram = nullptr;
+}
+
+void OcclusionQueries::collectResults(unsigned int instanceCount)
+{
+	mVisible.resize(instanceCount, 1);
+	mIssuedCount = 0;
+	while (!mPendingQueries.empty()) {
+		const PendingQuery& pending = mPendingQueries.front();
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(pending.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			break;
+		}
+		GLuint samples = 0;
+		glGetQueryObjectuiv(pending.Query, GL_QUERY_RESULT, &samples);
+		if (pending.Instance < instanceCount) {
+			mVisible[pending.Instance] = samples ? 1 : 0;
+		}
+		mFreeQueries.push_back(pending.Query);
+		mPendingQueries.pop_front();
+	}
+}
+
+bool OcclusionQueries::isQueryDue(unsigned int instance, unsigned int frameIndex) const
+{
+	return isHidden(instance) || (instance + frameIndex) % kVisibleQueryInterval == 0;
+}
+
+void OcclusionQueries::beginQueries(const glm::mat4& viewProjection)
+{
+	assert(mVAO);
+	mViewProjection = viewProjection;
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	// Boxes the camera is inside of only pass with their back faces
+	mCullFaceEnabled = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+	mpProgram->use();
+	GLState::bindVertexArray(mVAO);
+}
+
+void OcclusionQueries::endQueries()
+{
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	if (mCullFaceEnabled) {
+		glEnable(GL_CULL_FACE);
+	}
+}
+
+GLuint OcclusionQueries::issueQuery(unsigned int instance, const BoundingBox& box)
+{
+	assert(instance < mVisible.size());
+	const glm::vec3 center = box.getCenter(), extents = box.getExtents();
+	glm::mat4 boxMatrix(extents.x, 0.0f, 0.0f, 0.0f, 0.0f, extents.y, 0.0f, 0.0f, 0.0f, 0.0f, extents.z, 0.0f,
+		center.x, center.y, center.z, 1.0f);
+	boxMatrix = mViewProjection * boxMatrix;
+
+	// With the camera inside the box its front faces are clipped and the query would report nothing
+	for (int corner=0; corner < 8; ++corner) {
+		const glm::vec4 clip = boxMatrix * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f,
+			corner & 4 ? 1.0f : -1.0f, 1.0f);
+		if (clip.z < -clip.w) {
+			mVisible[instance] = 1;
+			return 0;
+		}
+	}
+
+	const GLuint query = allocateQuery();
+	mpProgram->setUniform(kBoxMatrixUniform, boxMatrix);
+	glBeginQuery(mTarget, query);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, nullptr);
+	glEndQuery(mTarget);
+
+	PendingQuery pending;
+	pending.Query = query;
+	pending.Instance = instance;
+	mPendingQueries.push_back(pending);
+	++mIssuedCount;
+	return query;
+}
+
+GLuint OcclusionQueries::allocateQuery()
+{
+	if (mFreeQueries.empty()) {
+		const size_t first = mAllQueries.size();
+		mAllQueries.resize(first + kQueryAllocationSize);
+		glGenQueries(kQueryAllocationSize, &mAllQueries[first]);
+		mFreeQueries.assign(mAllQueries.begin() + first, mAllQueries.end());
+	}
+	const GLuint query = mFreeQueries.back();
+	mFreeQueries.pop_back();
+	return query;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+
+struct BoundingBox;
+class GPUProgram;
+
+// Hardware occlusion culling with temporal coherence in the spirit of CHC++. Every instance keeps the
+// visibility its last query returned. Instances last seen visible are drawn normally and re-queried every
+// few frames. Hidden instances are queried every frame against the depth of the visible ones, and their draw
+// is wrapped in conditional rendering on that query, so the GPU skips it when the box passed no samples.
+// Results are read back frames later from a pool of queries, never waiting on the GPU.
+class OcclusionQueries
+{
+public:
+	OcclusionQueries();
+	~OcclusionQueries();
+
+	// program is built from box.vert and box.frag
+	bool init(const GPUProgram& program);
+	void destroy();
+	bool isInitialized() const { return mVAO != 0; }
+
+	// Applies every result the GPU has finished, without blocking. Instances default to visible.
+	void collectResults(unsigned int instanceCount);
+	bool isHidden(unsigned int instance) const { return instance < mVisible.size() && !mVisible[instance]; }
+	// Hidden instances need a query every frame, visible ones every kVisibleQueryInterval frames, staggered
+	bool isQueryDue(unsigned int instance, unsigned int frameIndex) const;
+
+	// Queries are drawn between these calls. They turn color and depth writes off and back on, and face culling
+	// off and back to whatever it was
+	void beginQueries(const glm::mat4& viewProjection);
+	void endQueries();
+	// Returns 0 when the box reaches the near plane, the instance then counts as visible
+	GLuint issueQuery(unsigned int instance, const BoundingBox& box);
+
+	// Statistics of the current frame
+	unsigned int getIssuedCount() const { return mIssuedCount; }
+	unsigned int getPendingCount() const { return static_cast<unsigned int>(mPendingQueries.size()); }
+
+	static const unsigned int kVisibleQueryInterval = 4;
+
+private:
+	struct PendingQuery
+	{
+		GLuint Query;
+		unsigned int Instance;
+	};
+
+	const GPUProgram* mpProgram;
+	GLenum mTarget;
+	GLuint mVAO;
+	GLuint mVBO;
+	GLuint mElementBuffer;
+	glm::mat4 mViewProjection;
+	GLboolean mCullFaceEnabled;
+
+	std::vector<unsigned char> mVisible;
+	// Issue order, which is also the order the GPU finishes them in
+	std::deque<PendingQuery> mPendingQueries;
+	std::vector<GLuint> mFreeQueries;
+	std::vector<GLuint> mAllQueries;
+	unsigned int mIssuedCount;
+
+	GLuint allocateQuery();
+
+	static const unsigned int kQueryAllocationSize = 256;
+
+	OcclusionQueries(const OcclusionQueries& rhs);
+	OcclusionQueries& operator=(const OcclusionQueries& rhs);
+};
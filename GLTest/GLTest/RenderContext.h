@@ -1,20 +1,22 @@
 #pragma once
-#include <glm/mat4x4.hpp>
 
 class Camera;
-struct aiNode;
+class SceneGraph;
 
 struct RenderContext
 {
 public:
 	RenderContext() :
-		pCamera(nullptr)
+		pCamera(nullptr),
+		pSceneGraph(nullptr),
+		Time(0.0f),
+		FrameIndex(0)
 	{
 	}
 
-	glm::mat4 getCurrentWorldMatrix() const;
-
 	Camera* pCamera;
-	const aiNode* pAiNode;
+	// Draws reference their node's matrices by index, update it before submitting
+	const SceneGraph* pSceneGraph;
 	float Time;
+	unsigned int FrameIndex;
 };
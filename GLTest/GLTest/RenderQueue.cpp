@@ -0,0 +1,106 @@
+#include "RenderQueue.h"
+#include <assert.h>
+#include <string.h>
+
+const unsigned int kPassBits = 4;
+const unsigned int kProgramBits = 8;
+const unsigned int kMaterialBits = 12;
+const unsigned int kVertexArrayBits = 10;
+const unsigned int kMeshBits = 14;
+// Holds MeshData::kMaxLodCount levels
+const unsigned int kLodBits = 2;
+
+static unsigned long long packField(unsigned long long key, unsigned int value, unsigned int bits)
+{
+	// Values wider than their field wrap, that only costs some batching since the draw data is in the packet
+	return (key << bits) | (value & ((1u << bits) - 1));
+}
+
+unsigned long long RenderQueue::makeSortKey(RenderPass pass, unsigned int program, unsigned int material,
+											unsigned int vertexArray, unsigned int mesh, unsigned int lod, float depth)
+{
+	// depth is normalized to [0, 1], solid draws go front to back within a state group
+	const unsigned int maxDepth = (1u << kDepthBits) - 1;
+	const float clampedDepth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	const unsigned int quantizedDepth = static_cast<unsigned int>(clampedDepth * maxDepth);
+
+	unsigned long long key = 0;
+	key = packField(key, static_cast<unsigned int>(pass), kPassBits);
+	key = packField(key, program, kProgramBits);
+	key = packField(key, material, kMaterialBits);
+	key = packField(key, vertexArray, kVertexArrayBits);
+	key = packField(key, mesh, kMeshBits);
+	key = packField(key, lod, kLodBits);
+	key = packField(key, quantizedDepth, kDepthBits);
+	return key;
+}
+
+void RenderQueue::push(unsigned long long sortKey, const Mesh& mesh, unsigned int nodeIndex, unsigned int lod,
+					   unsigned int occlusionQuery, const IndexRange* pRanges, unsigned int rangeCount)
+{
+	DrawPacket packet;
+	packet.SortKey = sortKey;
+	packet.pMesh = &mesh;
+	packet.NodeIndex = nodeIndex;
+	packet.Lod = lod;
+	packet.OcclusionQuery = occlusionQuery;
+	packet.FirstRange = static_cast<unsigned int>(mRanges.size());
+	packet.RangeCount = rangeCount;
+	mRanges.insert(mRanges.end(), pRanges, pRanges + rangeCount);
+	mPackets.push_back(packet);
+}
+
+void RenderQueue::sort()
+{
+	const unsigned int count = static_cast<unsigned int>(mPackets.size());
+	mSorted.resize(count);
+	mScratch.resize(count);
+	if (count == 0) {
+		return;
+	}
+
+	for (unsigned int i=0; i < count; ++i) {
+		mSorted[i].SortKey = mPackets[i].SortKey;
+		mSorted[i].PacketIndex = i;
+	}
+
+	// Histograms of all eight key bytes in one pass over the data
+	unsigned int histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (unsigned int i=0; i < count; ++i) {
+		const unsigned long long key = mSorted[i].SortKey;
+		for (unsigned int b=0; b < 8; ++b) {
+			++histograms[b][(key >> (b * 8)) & 0xFF];
+		}
+	}
+
+	for (unsigned int b=0; b < 8; ++b) {
+		unsigned int* const histogram = histograms[b];
+		const unsigned int shift = b * 8;
+
+		// A byte that is the same in every key does not change the order, typically the pass and program bytes
+		if (histogram[(mSorted[0].SortKey >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		unsigned int offset = 0;
+		for (unsigned int i=0; i < 256; ++i) {
+			const unsigned int bucketCount = histogram[i];
+			histogram[i] = offset;
+			offset += bucketCount;
+		}
+
+		for (unsigned int i=0; i < count; ++i) {
+			const SortEntry& entry = mSorted[i];
+			mScratch[histogram[(entry.SortKey >> shift) & 0xFF]++] = entry;
+		}
+		mSorted.swap(mScratch);
+	}
+}
+
+void RenderQueue::clear()
+{
+	mPackets.clear();
+	mRanges.clear();
+	mSorted.clear();
+}
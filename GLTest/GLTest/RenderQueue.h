@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+class Mesh;
+
+enum class RenderPass
+{
+	SOLID = 0
+};
+
+// Part of a mesh's index buffer, relative to the mesh's first index
+struct IndexRange
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+};
+
+struct DrawPacket
+{
+public:
+	unsigned long long SortKey;
+	const Mesh* pMesh;
+	// Scene graph node whose matrices the draw uses
+	unsigned int NodeIndex;
+	// Level of detail of the mesh, selects its index range
+	unsigned int Lod;
+	// Draws only these ranges of the queue's index ranges instead of the whole level when RangeCount is set
+	unsigned int FirstRange;
+	unsigned int RangeCount;
+	// GL query the draw is conditional on, 0 for unconditional draws
+	unsigned int OcclusionQuery;
+};
+
+// Draws collected during a frame and sorted by a packed 64-bit key so draws sharing state end up adjacent.
+// Key layout from the most significant bit:
+//   pass (4) | program (8) | material (12) | vertex array (10) | mesh (14) | lod (2) | depth (14)
+// Draws of the same mesh and level of detail end up next to each other, the renderer turns such runs into
+// instanced draws.
+class RenderQueue
+{
+public:
+	static unsigned long long makeSortKey(RenderPass pass, unsigned int program, unsigned int material,
+		unsigned int vertexArray, unsigned int mesh, unsigned int lod, float depth);
+
+	void push(unsigned long long sortKey, const Mesh& mesh, unsigned int nodeIndex, unsigned int lod,
+		unsigned int occlusionQuery = 0, const IndexRange* pRanges = nullptr, unsigned int rangeCount = 0);
+	// LSD radix sort on the keys, stable so equal keys keep their submission order
+	void sort();
+	void clear();
+
+	bool isEmpty() const { return mPackets.empty(); }
+	unsigned int getCount() const { return static_cast<unsigned int>(mPackets.size()); }
+	// Valid after sort()
+	const DrawPacket& operator[](unsigned int index) const { return mPackets[mSorted[index].PacketIndex]; }
+	const IndexRange& getRange(unsigned int index) const { return mRanges[index]; }
+
+	static const unsigned int kDepthBits = 14;
+
+private:
+	struct SortEntry
+	{
+		unsigned long long SortKey;
+		unsigned int PacketIndex;
+	};
+
+	std::vector<DrawPacket> mPackets;
+	std::vector<IndexRange> mRanges;
+	std::vector<SortEntry> mSorted;
+	std::vector<SortEntry> mScratch;
+};
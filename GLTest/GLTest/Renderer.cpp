@@ -1,36 +1,493 @@
 #include "Renderer.h"
 #include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include "Mesh.h"
 #include "Material.h"
+#include "GPUProgram.h"
 #include "Camera.h"
+#include "UniformBlocks.h"
+#include "GLState.h"
+#include "GeometryPool.h"
+#include "SceneData.h"
+#include "SceneGraph.h"
 
-void Renderer::render(const Mesh& mesh)
+const UniformId kDrawDataBufferUniform("DrawDataBuffer");
+
+// DrawUniforms is read as RGBA32F texels from the buffer texture
+const unsigned int kDrawUniformsTexels = sizeof(DrawUniforms) / sizeof(glm::vec4);
+
+Renderer::Renderer() :
+	mDrawCallCount(0),
+	mConditionalDrawCount(0),
+	mTriangleCount(0),
+	mIdentityInstanceOffset(-1),
+	mInstancedDrawCount(0),
+	mpMultiDrawProgram(nullptr),
+	mDrawIndexBuffer(0),
+	mDrawDataTexture(0),
+	mMaxMultiDraws(0),
+	mFrameTimerIndex(0),
+	mGPUFrameTime(0.0)
+{
+	for (unsigned int i=0; i < kFrameTimerQueryCount; ++i) {
+		mFrameTimerQueries[i] = 0;
+		mFrameTimerIssued[i] = false;
+	}
+}
+
+bool Renderer::init()
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	const GLsizeiptr drawSize = (sizeof(DrawUniforms) + alignment - 1) / alignment * alignment;
+	const GLsizeiptr instanceSize = (sizeof(InstanceUniforms) + alignment - 1) / alignment * alignment;
+	if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+		glGenQueries(kFrameTimerQueryCount, mFrameTimerQueries);
+	}
+	// The extra instance block is the identity block of beginFrame
+	return mUniformRing.create(sizeof(FrameUniforms) + alignment + drawSize * kMaxDrawsPerFrame +
+		instanceSize * (kMaxInstancedDrawsPerFrame + 1));
+}
+
+void Renderer::destroy()
+{
+	mUniformRing.destroy();
+	mDrawDataRing.destroy();
+	mIndirectRing.destroy();
+	if (mFrameTimerQueries[0]) {
+		glDeleteQueries(kFrameTimerQueryCount, mFrameTimerQueries);
+		for (unsigned int i=0; i < kFrameTimerQueryCount; ++i) {
+			mFrameTimerQueries[i] = 0;
+			mFrameTimerIssued[i] = false;
+		}
+	}
+
+	for (GeometryPool* pPool : mGeometryPools) {
+		delete pPool;
+	}
+	mGeometryPools.clear();
+	if (mDrawDataTexture) {
+		glDeleteTextures(1, &mDrawDataTexture);
+		GLState::forgetTexture(mDrawDataTexture);
+		mDrawDataTexture = 0;
+	}
+	if (mDrawIndexBuffer) {
+		glDeleteBuffers(1, &mDrawIndexBuffer);
+		GLState::forgetBuffer(mDrawIndexBuffer);
+		mDrawIndexBuffer = 0;
+	}
+	mpMultiDrawProgram = nullptr;
+}
+
+bool Renderer::enableMultiDraw(const GPUProgram& program)
+{
+	assert(!mpMultiDrawProgram && mGeometryPools.empty());
+	// The base instance in the indirect commands is what selects the per-draw data
+	if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_base_instance) {
+		return false;
+	}
+
+	// The buffer texture spans every region of the ring
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	const unsigned int maxDraws = static_cast<unsigned int>(maxTexels) / kDrawUniformsTexels / UniformRing::kRegionCount;
+	mMaxMultiDraws = maxDraws < kMaxDrawsPerFrame ? maxDraws : kMaxDrawsPerFrame;
+	// Allocations at multiples of the element size keep offsets convertible to draw indices
+	if (!mDrawDataRing.create(mMaxMultiDraws * sizeof(DrawUniforms), sizeof(DrawUniforms)) ||
+		!mIndirectRing.create(kMaxMultiDrawCommands * sizeof(DrawElementsIndirectCommand), sizeof(DrawElementsIndirectCommand))) {
+		return false;
+	}
+
+	std::vector<GLint> drawIndices(mMaxMultiDraws * UniformRing::kRegionCount);
+	for (unsigned int i=0; i < drawIndices.size(); ++i) {
+		drawIndices[i] = static_cast<GLint>(i);
+	}
+	glGenBuffers(1, &mDrawIndexBuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mDrawIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLint), &drawIndices[0], GL_STATIC_DRAW);
+
+	glGenTextures(1, &mDrawDataTexture);
+	GLState::bindTexture(kDrawDataTextureUnit, GL_TEXTURE_BUFFER, mDrawDataTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mDrawDataRing.getBuffer());
+
+	Material::setSamplerUnits(program);
+	program.setUniform(kDrawDataBufferUniform, static_cast<int>(kDrawDataTextureUnit));
+	mpMultiDrawProgram = &program;
+	mMultiDrawUniforms.reserve(mMaxMultiDraws);
+	mMultiDrawCommands.reserve(kMaxMultiDrawCommands);
+	return true;
+}
+
+void Renderer::createGeometry(std::vector<Mesh>& meshes)
+{
+	if (!mpMultiDrawProgram) {
+		for (Mesh& mesh : meshes) {
+			mesh.createBuffers();
+		}
+		return;
+	}
+
+	for (Mesh& mesh : meshes) {
+		GeometryPool* pPool = nullptr;
+		for (GeometryPool* pCandidate : mGeometryPools) {
+			if (pCandidate->accepts(mesh.getMeshData())) {
+				pPool = pCandidate;
+				break;
+			}
+		}
+		if (!pPool) {
+			pPool = new GeometryPool(mesh.getMeshData().Layout, mesh.getMeshData().IndexType);
+			mGeometryPools.push_back(pPool);
+		}
+		pPool->add(mesh);
+	}
+
+	for (GeometryPool* pPool : mGeometryPools) {
+		if (!pPool->create(mDrawIndexBuffer)) {
+			fprintf(stderr, "Failed to create merged geometry buffers\n");
+		}
+	}
+}
+
+void Renderer::beginFrame()
+{
+	assert(mRenderContext.pCamera);
+	mUniformRing.beginFrame();
+	if (mpMultiDrawProgram) {
+		mDrawDataRing.beginFrame();
+		mIndirectRing.beginFrame();
+	}
+
+	FrameUniforms frameUniforms;
+	frameUniforms.ViewProjectionMatrix = mRenderContext.pCamera->getViewProjectionMatrix();
+	frameUniforms.CameraPosition = glm::vec4(mRenderContext.pCamera->getPosition(), 1.0f);
+	const float time = mRenderContext.Time;
+	frameUniforms.LightDirection = glm::vec4(-glm::normalize(glm::vec3(cosf(time), -1.0f, sinf(time))), 0.0f);
+	frameUniforms.Time = time;
+	const GLintptr offset = mUniformRing.allocate(&frameUniforms, sizeof(frameUniforms));
+	mUniformRing.bind(static_cast<GLuint>(UniformBlock::FRAME), offset, sizeof(frameUniforms));
+
+	// Draws of a single instance only read the first matrix, their world matrix is in DrawUniforms
+	InstanceUniforms identityInstance;
+	identityInstance.WorldMatrices[0] = glm::mat4(1.0f);
+	mIdentityInstanceOffset = mUniformRing.allocate(&identityInstance, sizeof(identityInstance));
+	mInstancedDrawCount = 0;
+	mDrawCallCount = 0;
+	mConditionalDrawCount = 0;
+	mTriangleCount = 0;
+
+	if (mFrameTimerQueries[0]) {
+		// The query was issued kFrameTimerQueryCount frames ago, it is usually done and never waited on
+		const GLuint query = mFrameTimerQueries[mFrameTimerIndex];
+		GLuint available = GL_FALSE;
+		if (mFrameTimerIssued[mFrameTimerIndex]) {
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		}
+		if (available) {
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+			mGPUFrameTime = nanoseconds / 1000000.0;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		mFrameTimerIssued[mFrameTimerIndex] = true;
+	}
+}
+
+void Renderer::endFrame()
+{
+	if (mFrameTimerQueries[0]) {
+		glEndQuery(GL_TIME_ELAPSED);
+		mFrameTimerIndex = (mFrameTimerIndex + 1) % kFrameTimerQueryCount;
+	}
+	mUniformRing.endFrame();
+	if (mpMultiDrawProgram) {
+		mDrawDataRing.endFrame();
+		mIndirectRing.endFrame();
+	}
+}
+
+unsigned long long Renderer::makeSortKey(const Mesh& mesh, unsigned int nodeIndex, unsigned int lod, RenderPass pass) const
+{
+	assert(mesh.getVertexBuffer().VAO);
+	assert(mesh.getIndexBuffer().ElementBuffer);
+	assert(lod < mesh.getLodCount());
+
+	assert(mRenderContext.pSceneGraph && nodeIndex < mRenderContext.pSceneGraph->getNodeCount());
+	const Camera& camera = *mRenderContext.pCamera;
+	const glm::mat4& worldMatrix = mRenderContext.pSceneGraph->getWorldMatrix(nodeIndex);
+	const float distance = glm::length(glm::vec3(worldMatrix[3]) - camera.getPosition());
+	const Material& material = mesh.getMaterial();
+	return RenderQueue::makeSortKey(pass, material.getGPUProgram().getHandle(), material.getSortId(),
+		mesh.getVertexBuffer().VAO, mesh.getSortId(), lod, distance / camera.getFarPlaneDistance());
+}
+
+void Renderer::submit(const Mesh& mesh, unsigned int nodeIndex, unsigned int lod, RenderPass pass, GLuint occlusionQuery)
+{
+	mRenderQueue.push(makeSortKey(mesh, nodeIndex, lod, pass), mesh, nodeIndex, lod, occlusionQuery);
+}
+
+void Renderer::submit(const Mesh& mesh, unsigned int nodeIndex, const std::vector<IndexRange>& ranges, RenderPass pass,
+					  GLuint occlusionQuery)
+{
+	if (ranges.empty()) {
+		return;
+	}
+	if (ranges.size() == 1 && ranges[0].FirstIndex == 0 && ranges[0].IndexCount == mesh.getLod(0).IndexCount) {
+		submit(mesh, nodeIndex, 0, pass, occlusionQuery);
+		return;
+	}
+	mRenderQueue.push(makeSortKey(mesh, nodeIndex, 0, pass), mesh, nodeIndex, 0, occlusionQuery, &ranges[0],
+		static_cast<unsigned int>(ranges.size()));
+}
+
+void Renderer::flush()
+{
+	mRenderQueue.sort();
+	if (mpMultiDrawProgram) {
+		flushMultiDraws();
+	}
+	else {
+		flushDraws();
+	}
+	mRenderQueue.clear();
+}
+
+unsigned int Renderer::getInstanceRunLength(unsigned int first, unsigned int end, unsigned int maxLength) const
+{
+	const Mesh* const pMesh = mRenderQueue[first].pMesh;
+	const unsigned int lod = mRenderQueue[first].Lod;
+	if (mRenderQueue[first].RangeCount) {
+		return 1;
+	}
+	unsigned int last = first + 1;
+	// Conditional draws and draws of index ranges are never instanced, each has its own query or ranges
+	while (last < end && last - first < maxLength && mRenderQueue[last].pMesh == pMesh && mRenderQueue[last].Lod == lod &&
+		!mRenderQueue[last].OcclusionQuery && !mRenderQueue[last].RangeCount) {
+		++last;
+	}
+	return last - first;
+}
+
+void Renderer::fillDrawUniforms(const Mesh& mesh, const glm::mat4& worldMatrix, const glm::mat4& wvpMatrix,
+								DrawUniforms& drawUniforms) const
 {
 	const VertexBuffer& vertexBuffer = mesh.getVertexBuffer();
-	const IndexBuffer& indexBuffer = mesh.getIndexBuffer();
-	assert(vertexBuffer.VAO);
-	assert(indexBuffer.ElementBuffer);
+	drawUniforms.WorldMatrix = worldMatrix;
+	drawUniforms.WVPMatrix = wvpMatrix;
+	const VertexQuantization& quantization = vertexBuffer.Quantization;
+	drawUniforms.PositionOffset = glm::vec4(quantization.PositionOffset, 0.0f);
+	drawUniforms.PositionScale = glm::vec4(quantization.PositionScale, 0.0f);
+	drawUniforms.TexCoordTransform = glm::vec4(quantization.TexCoordOffset, quantization.TexCoordScale);
+	drawUniforms.OctahedralNormals = vertexBuffer.hasOctahedralNormals() ? 1 : 0;
+}
+
+void Renderer::flushDraws()
+{
+	const Material* pMaterial = nullptr;
+	// The material part of the uniforms carries over while consecutive draws share a material
+	DrawUniforms drawUniforms;
+	InstanceUniforms instanceUniforms;
+	const glm::mat4 identity(1.0f);
+	const SceneGraph& sceneGraph = *mRenderContext.pSceneGraph;
+
+	const unsigned int packetCount = mRenderQueue.getCount();
+	unsigned int instanceCount = 0;
+	for (unsigned int i=0; i < packetCount; i += instanceCount) {
+		const DrawPacket& packet = mRenderQueue[i];
+		const Mesh& mesh = *packet.pMesh;
+		const VertexBuffer& vertexBuffer = mesh.getVertexBuffer();
+		const IndexBuffer& indexBuffer = mesh.getIndexBuffer();
+
+		const Material& material = mesh.getMaterial();
+		material.getGPUProgram().use();
+		if (&material != pMaterial) {
+			pMaterial = &material;
+			material.apply(mRenderContext, drawUniforms);
+		}
+
+		// Consecutive packets of the same mesh become one instanced draw while instance blocks are left
+		const unsigned int maxInstances = mInstancedDrawCount < kMaxInstancedDrawsPerFrame && !packet.OcclusionQuery ?
+			InstanceUniforms::kMaxInstances : 1;
+		instanceCount = getInstanceRunLength(i, packetCount, maxInstances);
+		GLintptr instanceOffset = mIdentityInstanceOffset;
+		if (instanceCount > 1) {
+			fillDrawUniforms(mesh, identity, mRenderContext.pCamera->getViewProjectionMatrix(), drawUniforms);
+			for (unsigned int instance=0; instance < instanceCount; ++instance) {
+				instanceUniforms.WorldMatrices[instance] = sceneGraph.getWorldMatrix(mRenderQueue[i + instance].NodeIndex);
+			}
+			instanceOffset = mUniformRing.allocate(&instanceUniforms, sizeof(instanceUniforms));
+			++mInstancedDrawCount;
+		}
+		else {
+			fillDrawUniforms(mesh, sceneGraph.getWorldMatrix(packet.NodeIndex),
+				sceneGraph.getWorldViewProjectionMatrix(packet.NodeIndex), drawUniforms);
+		}
 
-	mesh.getMaterial().apply(mRenderContext);
+		const GLintptr offset = mUniformRing.allocate(&drawUniforms, sizeof(drawUniforms));
+		if (offset < 0 || instanceOffset < 0) {
+			break;
+		}
+		mUniformRing.bind(static_cast<GLuint>(UniformBlock::DRAW), offset, sizeof(drawUniforms));
+		mUniformRing.bind(static_cast<GLuint>(UniformBlock::INSTANCE), instanceOffset, sizeof(instanceUniforms));
 
-	glBindVertexArray(vertexBuffer.VAO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.ElementBuffer);
-	glDrawElements(GL_TRIANGLES, indexBuffer.IndexCount, GL_UNSIGNED_INT, (const void*)0);
+		// The element buffer binding is part of the vertex array state, see Mesh::createIndexBuffer
+		GLState::bindVertexArray(vertexBuffer.VAO);
+		if (packet.OcclusionQuery) {
+			// Waits on the GPU only, the CPU never sees the result
+			glBeginConditionalRender(packet.OcclusionQuery, GL_QUERY_WAIT);
+		}
+		if (packet.RangeCount) {
+			mRangeCounts.clear();
+			mRangeOffsets.clear();
+			for (unsigned int r=0; r < packet.RangeCount; ++r) {
+				const IndexRange& range = mRenderQueue.getRange(packet.FirstRange + r);
+				mRangeCounts.push_back(static_cast<GLsizei>(range.IndexCount));
+				mRangeOffsets.push_back(indexBuffer.getIndexOffset(range.FirstIndex));
+				mTriangleCount += range.IndexCount / 3;
+			}
+			mRangeBaseVertices.assign(packet.RangeCount, vertexBuffer.BaseVertex);
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, &mRangeCounts[0], indexBuffer.IndexType, &mRangeOffsets[0],
+				static_cast<GLsizei>(packet.RangeCount), &mRangeBaseVertices[0]);
+		}
+		else {
+			const MeshLod& lod = mesh.getLod(packet.Lod);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.IndexCount, indexBuffer.IndexType,
+				indexBuffer.getIndexOffset(lod.FirstIndex), instanceCount, vertexBuffer.BaseVertex);
+			mTriangleCount += lod.IndexCount / 3 * instanceCount;
+		}
+		if (packet.OcclusionQuery) {
+			glEndConditionalRender();
+			++mConditionalDrawCount;
+		}
+		++mDrawCallCount;
+	}
+}
+
+void Renderer::flushMultiDraws()
+{
+	mpMultiDrawProgram->use();
+	GLState::bindTexture(kDrawDataTextureUnit, GL_TEXTURE_BUFFER, mDrawDataTexture);
+	GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectRing.getBuffer());
+
+	// Sorting put draws with the same material and pool next to each other, each such run is one draw call.
+	// Conditional draws get a call of their own. Draws of index ranges add a command per range.
+	// A run is cut where it would no longer fit into one region of the rings.
+	DrawUniforms drawUniforms;
+	const SceneGraph& sceneGraph = *mRenderContext.pSceneGraph;
+	const unsigned int packetCount = mRenderQueue.getCount();
+	unsigned int groupStart = 0;
+	while (groupStart < packetCount) {
+		const GLuint occlusionQuery = mRenderQueue[groupStart].OcclusionQuery;
+		const Mesh& firstMesh = *mRenderQueue[groupStart].pMesh;
+		const Material& material = firstMesh.getMaterial();
+		const GLuint vertexArray = firstMesh.getVertexBuffer().VAO;
+		assert(firstMesh.hasSharedBuffers());
+		material.apply(mRenderContext, drawUniforms);
+
+		mMultiDrawUniforms.clear();
+		mMultiDrawCommands.clear();
+		const unsigned int groupLimit = std::min(packetCount, groupStart + mMaxMultiDraws);
+		unsigned int groupEnd = groupStart;
+		while (groupEnd < groupLimit) {
+			const DrawPacket& packet = mRenderQueue[groupEnd];
+			const Mesh& mesh = *packet.pMesh;
+			if (&mesh.getMaterial() != &material || mesh.getVertexBuffer().VAO != vertexArray ||
+				(groupEnd > groupStart && (occlusionQuery || packet.OcclusionQuery))) {
+				break;
+			}
+			const unsigned int packetCommands = packet.RangeCount ? packet.RangeCount : 1;
+			if (mMultiDrawCommands.size() + packetCommands > kMaxMultiDrawCommands) {
+				break;
+			}
+
+			// Instances of one mesh share a command, each instance still reads its own DrawUniforms
+			const unsigned int instanceCount = getInstanceRunLength(groupEnd, groupLimit, occlusionQuery ? 1 : groupLimit);
+			for (unsigned int instance=0; instance < instanceCount; ++instance) {
+				const unsigned int nodeIndex = mRenderQueue[groupEnd + instance].NodeIndex;
+				fillDrawUniforms(mesh, sceneGraph.getWorldMatrix(nodeIndex), sceneGraph.getWorldViewProjectionMatrix(nodeIndex),
+					drawUniforms);
+				mMultiDrawUniforms.push_back(drawUniforms);
+			}
+
+			// The base instance is relative to the group until its DrawUniforms have a place in the ring
+			DrawElementsIndirectCommand command;
+			command.InstanceCount = instanceCount;
+			command.BaseVertex = mesh.getVertexBuffer().BaseVertex;
+			command.BaseInstance = groupEnd - groupStart;
+			if (packet.RangeCount) {
+				// The commands of all ranges point at the packet's one DrawUniforms
+				for (unsigned int r=0; r < packet.RangeCount; ++r) {
+					const IndexRange& range = mRenderQueue.getRange(packet.FirstRange + r);
+					command.Count = range.IndexCount;
+					command.FirstIndex = mesh.getIndexBuffer().FirstIndex + range.FirstIndex;
+					mMultiDrawCommands.push_back(command);
+					mTriangleCount += range.IndexCount / 3;
+				}
+			}
+			else {
+				const MeshLod& lod = mesh.getLod(packet.Lod);
+				command.Count = lod.IndexCount;
+				command.FirstIndex = mesh.getIndexBuffer().FirstIndex + lod.FirstIndex;
+				mMultiDrawCommands.push_back(command);
+				mTriangleCount += lod.IndexCount / 3 * instanceCount;
+			}
+			groupEnd += instanceCount;
+		}
+		if (groupEnd == groupStart) {
+			assert(false && "Too many index ranges in one draw for the indirect buffer");
+			++groupStart;
+			continue;
+		}
+
+		// A full region is fenced and the next one taken, as at the end of a frame. This only waits when
+		// the GPU is still reading that region.
+		const GLsizeiptr uniformsSize = mMultiDrawUniforms.size() * sizeof(DrawUniforms);
+		const GLsizeiptr commandsSize = mMultiDrawCommands.size() * sizeof(DrawElementsIndirectCommand);
+		if (!mDrawDataRing.canAllocate(uniformsSize)) {
+			mDrawDataRing.endFrame();
+			mDrawDataRing.beginFrame();
+		}
+		if (!mIndirectRing.canAllocate(commandsSize)) {
+			mIndirectRing.endFrame();
+			mIndirectRing.beginFrame();
+		}
+		const GLintptr uniformsOffset = mDrawDataRing.allocate(&mMultiDrawUniforms[0], uniformsSize);
+		const GLuint firstDrawIndex = static_cast<GLuint>(uniformsOffset / sizeof(DrawUniforms));
+		for (DrawElementsIndirectCommand& command : mMultiDrawCommands) {
+			command.BaseInstance += firstDrawIndex;
+		}
+		const GLintptr commandOffset = mIndirectRing.allocate(&mMultiDrawCommands[0], commandsSize);
+
+		GLState::bindVertexArray(vertexArray);
+		if (occlusionQuery) {
+			glBeginConditionalRender(occlusionQuery, GL_QUERY_WAIT);
+		}
+		glMultiDrawElementsIndirect(GL_TRIANGLES, firstMesh.getIndexBuffer().IndexType,
+			reinterpret_cast<const void*>(commandOffset), static_cast<GLsizei>(mMultiDrawCommands.size()), 0);
+		if (occlusionQuery) {
+			glEndConditionalRender();
+			++mConditionalDrawCount;
+		}
+		++mDrawCallCount;
+		groupStart = groupEnd;
+	}
 }
 
-void Renderer::renderDebug(const Mesh& mesh)
+void Renderer::renderDebug(const Mesh& mesh, unsigned int nodeIndex)
 {
 	const std::vector<glm::vec3> vertices = mesh.getVertices();
 	const std::vector<glm::vec3> normals = mesh.getNormals();
 	const std::vector<glm::vec3> tangents = mesh.getTangents();
 	const std::vector<glm::vec3> bitangents = mesh.getBitangents();
 
-	glUseProgram(0);
+	GLState::useProgram(0);
 	glMatrixMode(GL_PROJECTION);
 	glLoadMatrixf((const GLfloat*)&mRenderContext.pCamera->getProjectionMatrix()[0][0]);
 	glMatrixMode(GL_MODELVIEW);
-	glm::mat4 worldView = mRenderContext.pCamera->getViewMatrix() * mRenderContext.getCurrentWorldMatrix();
+	glm::mat4 worldView = mRenderContext.pCamera->getViewMatrix() * mRenderContext.pSceneGraph->getWorldMatrix(nodeIndex);
 	glLoadMatrixf((const GLfloat*)&worldView[0][0]);
 
 	const float length = 0.2f;
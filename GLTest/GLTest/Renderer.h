@@ -1,17 +1,110 @@
 #pragma once
+#include <vector>
 #include "RenderContext.h"
+#include "UniformRing.h"
+#include "RenderQueue.h"
+#include "UniformBlocks.h"
+#include "GPUBuffers.h"
 
 class Mesh;
+class GPUProgram;
+class GeometryPool;
 
 class Renderer
 {
 public:
+	Renderer();
+
+	bool init();
+	void destroy();
+
+	// Draws merged geometry with one glMultiDrawElementsIndirect per material. program has to be built from
+	// the shaders with MULTI_DRAW defined. Call before createGeometry, returns false when the GL lacks support.
+	bool enableMultiDraw(const GPUProgram& program);
+	bool isMultiDrawEnabled() const { return mpMultiDrawProgram != nullptr; }
+	// Packs the meshes into shared buffers with multi-draw enabled, otherwise every mesh gets its own
+	void createGeometry(std::vector<Mesh>& meshes);
+
+	// Per-frame uniforms come from the render context, set it up first
+	void beginFrame();
+	void endFrame();
+
 	RenderContext& getRenderContext() { return mRenderContext; }
 	const RenderContext& getRenderContext() const { return mRenderContext; }
 
-	void render(const Mesh& mesh);
-	void renderDebug(const Mesh& mesh);
+	// Queues a draw, nothing reaches GL until flush() so callers can submit in any order.
+	// Draws of the same mesh and level of detail are instanced. With an occlusion query the draw is issued on
+	// its own inside conditional rendering, the GPU skips it when the query passed no samples.
+	void submit(const Mesh& mesh, unsigned int nodeIndex, unsigned int lod = 0, RenderPass pass = RenderPass::SOLID,
+		GLuint occlusionQuery = 0);
+	// Draws only the given ranges of the full detail level, e.g. the meshlets MeshletCuller kept. These draws
+	// are not instanced unless the ranges cover the whole level.
+	void submit(const Mesh& mesh, unsigned int nodeIndex, const std::vector<IndexRange>& ranges,
+		RenderPass pass = RenderPass::SOLID, GLuint occlusionQuery = 0);
+	// Sorts the queued draws and issues them, only binding state that differs from the previous draw.
+	// May be called several times per frame.
+	void flush();
+	void renderDebug(const Mesh& mesh, unsigned int nodeIndex);
+
+	// Draw calls issued since beginFrame, the conditional ones are also counted separately
+	unsigned int getDrawCallCount() const { return mDrawCallCount; }
+	unsigned int getConditionalDrawCount() const { return mConditionalDrawCount; }
+	// Triangles drawn since beginFrame, counting every instance and ignoring conditional rendering
+	unsigned int getTriangleCount() const { return mTriangleCount; }
+	// Milliseconds the GPU spent between beginFrame and endFrame a few frames ago, 0 without timer queries
+	double getGPUFrameTime() const { return mGPUFrameTime; }
 
 private:
 	RenderContext mRenderContext;
+	UniformRing mUniformRing;
+	RenderQueue mRenderQueue;
+	unsigned int mDrawCallCount;
+	unsigned int mConditionalDrawCount;
+	unsigned int mTriangleCount;
+	GLintptr mIdentityInstanceOffset;
+	unsigned int mInstancedDrawCount;
+
+	const GPUProgram* mpMultiDrawProgram;
+	std::vector<GeometryPool*> mGeometryPools;
+	// Holds 0, 1, 2... for the per-instance draw index attribute
+	GLuint mDrawIndexBuffer;
+	// DrawUniforms of the multi-draws, read in the vertex shader through a buffer texture over the whole ring
+	UniformRing mDrawDataRing;
+	GLuint mDrawDataTexture;
+	UniformRing mIndirectRing;
+	// Draws in one region of mDrawDataRing
+	unsigned int mMaxMultiDraws;
+	std::vector<DrawUniforms> mMultiDrawUniforms;
+	std::vector<DrawElementsIndirectCommand> mMultiDrawCommands;
+	// Per-range arguments of glMultiDrawElementsBaseVertex for draws of index ranges
+	std::vector<GLsizei> mRangeCounts;
+	std::vector<const void*> mRangeOffsets;
+	std::vector<GLint> mRangeBaseVertices;
+
+	// GL_TIME_ELAPSED queries used round robin, a result is read when its query comes around again
+	static const unsigned int kFrameTimerQueryCount = 4;
+	GLuint mFrameTimerQueries[kFrameTimerQueryCount];
+	bool mFrameTimerIssued[kFrameTimerQueryCount];
+	unsigned int mFrameTimerIndex;
+	double mGPUFrameTime;
+
+	unsigned long long makeSortKey(const Mesh& mesh, unsigned int nodeIndex, unsigned int lod, RenderPass pass) const;
+	void flushDraws();
+	void flushMultiDraws();
+	// Number of sorted packets from first on that draw the same mesh at the same level of detail, at most maxLength
+	unsigned int getInstanceRunLength(unsigned int first, unsigned int end, unsigned int maxLength) const;
+	void fillDrawUniforms(const Mesh& mesh, const glm::mat4& worldMatrix, const glm::mat4& wvpMatrix,
+		DrawUniforms& drawUniforms) const;
+
+	// Sizes each ring region, a DrawUniforms allocation takes one uniform buffer offset alignment
+	static const unsigned int kMaxDrawsPerFrame = 16384;
+	// Indirect commands in one region of mIndirectRing, draws of index ranges take one per range
+	static const unsigned int kMaxMultiDrawCommands = 65536;
+	// Instanced draws each take an InstanceUniforms block from the ring, runs past this are drawn one by one
+	static const unsigned int kMaxInstancedDrawsPerFrame = 1024;
+	// Unit of the per-draw buffer texture, the material textures use the units below
+	static const unsigned int kDrawDataTextureUnit = 3;
+
+	Renderer(const Renderer& rhs);
+	Renderer& operator=(const Renderer& rhs);
 };
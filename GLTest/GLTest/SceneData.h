@@ -0,0 +1,175 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <glm/mat4x4.hpp>
+#include "GPUBuffers.h"
+#include "Texture.h"
+#include "MappedFile.h"
+#include "Bounds.h"
+
+// GPU-ready scene description shared by the scene cooker and the runtime
+
+// Byte range that either owns its bytes or views a range of a memory-mapped scene file
+struct DataBlob
+{
+public:
+	DataBlob() :
+		pData(nullptr), Size(0)
+	{
+	}
+
+	DataBlob(const DataBlob& rhs) :
+		pData(rhs.pData), Size(rhs.Size), mStorage(rhs.mStorage)
+	{
+		if (!mStorage.empty()) {
+			pData = &mStorage[0];
+		}
+	}
+
+	DataBlob& operator=(const DataBlob& rhs)
+	{
+		mStorage = rhs.mStorage;
+		pData = mStorage.empty() ? rhs.pData : &mStorage[0];
+		Size = rhs.Size;
+		return *this;
+	}
+
+	void setStorage(std::vector<unsigned char>& bytes)
+	{
+		mStorage.swap(bytes);
+		pData = mStorage.empty() ? nullptr : &mStorage[0];
+		Size = mStorage.size();
+	}
+
+	void setView(const unsigned char* pBytes, size_t size)
+	{
+		mStorage.clear();
+		pData = pBytes;
+		Size = size;
+	}
+
+	void clear()
+	{
+		mStorage.clear();
+		pData = nullptr;
+		Size = 0;
+	}
+
+	const unsigned char* pData;
+	size_t Size;
+
+private:
+	std::vector<unsigned char> mStorage;
+};
+
+// Range of MeshData::IndexData drawn at one level of detail
+struct MeshLod
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	// Object space distance the surface may deviate from the full detail mesh by
+	float Error;
+};
+
+// Cluster of neighbouring triangles of the full detail level, a contiguous range of its indices that is
+// culled as a whole at runtime, see MeshletCuller
+struct Meshlet
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	// Object space bounds of the cluster's vertices
+	BoundingSphere Sphere;
+	// Every triangle normal lies within the cone around ConeAxis, ConeCutoff is the sine of its half angle.
+	// A cutoff of 1 never culls.
+	glm::vec3 ConeAxis;
+	float ConeCutoff;
+
+	static const unsigned int kMaxVertices = 64;
+	static const unsigned int kMaxTriangles = 124;
+};
+
+struct MeshData
+{
+public:
+	MeshData() :
+		VertexCount(0), IndexType(GL_UNSIGNED_INT), IndexCount(0), MaterialIndex(0)
+	{
+	}
+
+	VertexLayout Layout;
+	VertexQuantization Quantization;
+	unsigned int VertexCount;
+	DataBlob VertexData;
+	GLenum IndexType;
+	// Indices of all levels of detail
+	unsigned int IndexCount;
+	DataBlob IndexData;
+	// Full detail first, each further level coarser with a larger error
+	std::vector<MeshLod> Lods;
+	// Partition of the full detail level, empty for meshes that fit in one
+	std::vector<Meshlet> Meshlets;
+	unsigned int MaterialIndex;
+	// Object space, computed from the unquantized positions
+	BoundingBox Bounds;
+	BoundingSphere Sphere;
+
+	static const unsigned int kMaxLodCount = 4;
+};
+
+struct MaterialData
+{
+public:
+	MaterialData() :
+		TwoSided(false)
+	{
+	}
+
+	std::string Name;
+	std::unordered_map<TextureType, std::string> TextureNames;
+	// Both faces are meant to be seen, so no geometry may be culled for facing away
+	bool TwoSided;
+};
+
+struct NodeData
+{
+public:
+	NodeData() :
+		ParentIndex(-1)
+	{
+	}
+
+	std::string Name;
+	glm::mat4 Transform;
+	int ParentIndex;
+	std::vector<unsigned int> MeshIndices;
+};
+
+struct SceneData
+{
+public:
+	// Nodes are stored depth-first, a parent always comes before its children
+	std::vector<NodeData> Nodes;
+	std::vector<MeshData> Meshes;
+	std::vector<MaterialData> Materials;
+	// Backs the vertex and index blobs of a loaded scene
+	MappedFile File;
+
+	// Drops the CPU-side geometry once it lives in GPU buffers
+	void releaseGeometry()
+	{
+		for (MeshData& mesh : Meshes) {
+			mesh.VertexData.clear();
+			mesh.IndexData.clear();
+		}
+		File.close();
+	}
+
+	void clear()
+	{
+		Nodes.clear();
+		Meshes.clear();
+		Materials.clear();
+		File.close();
+	}
+};
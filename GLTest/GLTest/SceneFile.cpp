@@ -0,0 +1,346 @@
+#include "SceneFile.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "SceneData.h"
+
+// File layout, all values little-endian:
+//   header:    magic, version, node count, mesh count, material count, blob section offset
+//   materials: name, two-sided flag, texture count, (texture type, texture name) pairs
+//   meshes:    material index, vertex count, stride, attribute count, attributes, quantization,
+//              index type, index count, bounding box, bounding sphere, vertex blob, index blob
+//   nodes:     name, transform, parent index, mesh count, mesh indices
+//   blobs:     vertex and index data, every blob starts on a kBlobAlignment boundary
+// Blobs are referenced by (offset, size) relative to the blob section so the runtime can map the file
+// and hand the ranges to the GPU without copying them.
+
+const unsigned int SceneFile::kMagic = 0x53544C47; // "GLTS"
+const unsigned int SceneFile::kVersion = 6;
+const unsigned int SceneFile::kBlobAlignment = 4096;
+
+struct SceneFileHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int NodeCount;
+	unsigned int MeshCount;
+	unsigned int MaterialCount;
+	unsigned int Padding;
+	unsigned long long BlobSectionOffset;
+};
+
+static unsigned long long alignBlobOffset(unsigned long long offset)
+{
+	return (offset + SceneFile::kBlobAlignment - 1) / SceneFile::kBlobAlignment * SceneFile::kBlobAlignment;
+}
+
+template<typename T>
+static void writeValue(std::ostream& stream, const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void writeArray(std::ostream& stream, const std::vector<T>& values)
+{
+	writeValue(stream, static_cast<unsigned int>(values.size()));
+	if (!values.empty()) {
+		stream.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+	}
+}
+
+static void writeString(std::ostream& stream, const std::string& value)
+{
+	writeValue(stream, static_cast<unsigned int>(value.size()));
+	stream.write(value.c_str(), value.size());
+}
+
+// Records where a blob goes in the blob section and writes the reference
+static void writeBlobReference(std::ostream& stream, const DataBlob& blob, std::vector<const DataBlob*>& blobs,
+							   unsigned long long& blobSectionSize)
+{
+	const unsigned long long offset = alignBlobOffset(blobSectionSize);
+	writeValue(stream, offset);
+	writeValue(stream, static_cast<unsigned long long>(blob.Size));
+	blobs.push_back(&blob);
+	blobSectionSize = offset + blob.Size;
+}
+
+// Bounds-checked reads from the mapped file
+struct MemoryReader
+{
+public:
+	MemoryReader(const unsigned char* pBegin, const unsigned char* pEnd) :
+		pCursor(pBegin), pEnd(pEnd), Failed(false)
+	{
+	}
+
+	bool readBytes(void* pDest, size_t size)
+	{
+		if (Failed || static_cast<size_t>(pEnd - pCursor) < size) {
+			Failed = true;
+			return false;
+		}
+		memcpy(pDest, pCursor, size);
+		pCursor += size;
+		return true;
+	}
+
+	template<typename T>
+	bool readValue(T& value)
+	{
+		return readBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	bool readArray(std::vector<T>& values)
+	{
+		unsigned int count = 0;
+		if (!readValue(count)) {
+			return false;
+		}
+		if (static_cast<size_t>(pEnd - pCursor) / sizeof(T) < count) {
+			Failed = true;
+			return false;
+		}
+		values.resize(count);
+		return count == 0 || readBytes(&values[0], count * sizeof(T));
+	}
+
+	bool readString(std::string& value)
+	{
+		unsigned int length = 0;
+		if (!readValue(length)) {
+			return false;
+		}
+		if (static_cast<size_t>(pEnd - pCursor) < length) {
+			Failed = true;
+			return false;
+		}
+		value.resize(length);
+		return length == 0 || readBytes(&value[0], length);
+	}
+
+	const unsigned char* pCursor;
+	const unsigned char* pEnd;
+	bool Failed;
+};
+
+static bool readBlobReference(MemoryReader& reader, const MappedFile& file, unsigned long long blobSectionOffset, DataBlob& blob)
+{
+	unsigned long long offset = 0, size = 0;
+	if (!reader.readValue(offset) || !reader.readValue(size)) {
+		return false;
+	}
+	const unsigned long long begin = blobSectionOffset + offset;
+	if (begin + size > file.getSize()) {
+		reader.Failed = true;
+		return false;
+	}
+	blob.setView(file.getData() + begin, static_cast<size_t>(size));
+	return true;
+}
+
+bool SceneFile::save(const std::string& fileName, const SceneData& scene)
+{
+	// Metadata is serialized first so the blob section offset is known before writing the header
+	std::ostringstream metadata(std::ios::binary);
+	std::vector<const DataBlob*> blobs;
+	unsigned long long blobSectionSize = 0;
+
+	for (const MaterialData& material : scene.Materials) {
+		writeString(metadata, material.Name);
+		writeValue(metadata, material.TwoSided);
+		writeValue(metadata, static_cast<unsigned int>(material.TextureNames.size()));
+		for (const auto& textureIt : material.TextureNames) {
+			writeValue(metadata, static_cast<unsigned int>(textureIt.first));
+			writeString(metadata, textureIt.second);
+		}
+	}
+
+	for (const MeshData& mesh : scene.Meshes) {
+		writeValue(metadata, mesh.MaterialIndex);
+		writeValue(metadata, mesh.VertexCount);
+		writeValue(metadata, mesh.Layout.Stride);
+		writeArray(metadata, mesh.Layout.Attributes);
+		writeValue(metadata, mesh.Quantization);
+		writeValue(metadata, mesh.IndexType);
+		writeValue(metadata, mesh.IndexCount);
+		writeArray(metadata, mesh.Lods);
+		writeArray(metadata, mesh.Meshlets);
+		writeValue(metadata, mesh.Bounds);
+		writeValue(metadata, mesh.Sphere);
+		writeBlobReference(metadata, mesh.VertexData, blobs, blobSectionSize);
+		writeBlobReference(metadata, mesh.IndexData, blobs, blobSectionSize);
+	}
+
+	for (const NodeData& node : scene.Nodes) {
+		writeString(metadata, node.Name);
+		writeValue(metadata, node.Transform);
+		writeValue(metadata, node.ParentIndex);
+		writeArray(metadata, node.MeshIndices);
+	}
+
+	const std::string metadataBytes = metadata.str();
+
+	SceneFileHeader header;
+	header.Magic = kMagic;
+	header.Version = kVersion;
+	header.NodeCount = static_cast<unsigned int>(scene.Nodes.size());
+	header.MeshCount = static_cast<unsigned int>(scene.Meshes.size());
+	header.MaterialCount = static_cast<unsigned int>(scene.Materials.size());
+	header.Padding = 0;
+	header.BlobSectionOffset = alignBlobOffset(sizeof(header) + metadataBytes.size());
+
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	writeValue(file, header);
+	file.write(metadataBytes.c_str(), metadataBytes.size());
+
+	unsigned long long position = sizeof(header) + metadataBytes.size();
+	unsigned long long blobOffset = 0;
+	const std::vector<char> padding(kBlobAlignment, 0);
+	for (const DataBlob* pBlob : blobs) {
+		const unsigned long long blobPosition = header.BlobSectionOffset + alignBlobOffset(blobOffset);
+		assert(blobPosition >= position && blobPosition - position <= kBlobAlignment);
+		file.write(&padding[0], static_cast<std::streamsize>(blobPosition - position));
+		if (pBlob->Size) {
+			file.write(reinterpret_cast<const char*>(pBlob->pData), pBlob->Size);
+		}
+		blobOffset = alignBlobOffset(blobOffset) + pBlob->Size;
+		position = blobPosition + pBlob->Size;
+	}
+
+	return file.good();
+}
+
+// Every index must address a vertex of the mesh, the renderer and the CPU-side occluders read through them
+static bool hasValidIndices(const MeshData& mesh)
+{
+	for (unsigned int i=0; i < mesh.IndexCount; ++i) {
+		unsigned int index = 0;
+		if (mesh.IndexType == GL_UNSIGNED_SHORT) {
+			unsigned short shortIndex = 0;
+			memcpy(&shortIndex, mesh.IndexData.pData + i * sizeof(shortIndex), sizeof(shortIndex));
+			index = shortIndex;
+		}
+		else {
+			memcpy(&index, mesh.IndexData.pData + i * sizeof(index), sizeof(index));
+		}
+		if (index >= mesh.VertexCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SceneFile::load(const std::string& fileName, SceneData& scene)
+{
+	scene.clear();
+	if (!scene.File.open(fileName)) {
+		return false;
+	}
+
+	const MappedFile& file = scene.File;
+	MemoryReader reader(file.getData(), file.getData() + file.getSize());
+
+	SceneFileHeader header;
+	if (!reader.readValue(header) || header.Magic != kMagic || header.Version != kVersion) {
+		fprintf(stderr, "Unsupported scene file, cook it again with SceneCooker: %s\n", fileName.c_str());
+		scene.clear();
+		return false;
+	}
+
+	// Every entry takes at least a byte, larger counts can only come from a corrupt header
+	const size_t metadataSize = file.getSize() - sizeof(header);
+	if (header.MaterialCount > metadataSize || header.MeshCount > metadataSize || header.NodeCount > metadataSize) {
+		fprintf(stderr, "Truncated or corrupt scene file: %s\n", fileName.c_str());
+		scene.clear();
+		return false;
+	}
+
+	scene.Materials.resize(header.MaterialCount);
+	for (MaterialData& material : scene.Materials) {
+		unsigned int textureCount = 0;
+		reader.readString(material.Name);
+		reader.readValue(material.TwoSided);
+		reader.readValue(textureCount);
+		for (unsigned int i=0; i < textureCount && !reader.Failed; ++i) {
+			unsigned int textureType = 0;
+			std::string textureName;
+			reader.readValue(textureType);
+			reader.readString(textureName);
+			if (textureType > static_cast<unsigned int>(TextureType::SPECULAR_MAP)) {
+				reader.Failed = true;
+				break;
+			}
+			material.TextureNames[static_cast<TextureType>(textureType)] = textureName;
+		}
+	}
+
+	scene.Meshes.resize(header.MeshCount);
+	for (MeshData& mesh : scene.Meshes) {
+		reader.readValue(mesh.MaterialIndex);
+		reader.readValue(mesh.VertexCount);
+		reader.readValue(mesh.Layout.Stride);
+		reader.readArray(mesh.Layout.Attributes);
+		reader.readValue(mesh.Quantization);
+		reader.readValue(mesh.IndexType);
+		reader.readValue(mesh.IndexCount);
+		reader.readArray(mesh.Lods);
+		reader.readArray(mesh.Meshlets);
+		reader.readValue(mesh.Bounds);
+		reader.readValue(mesh.Sphere);
+		readBlobReference(reader, file, header.BlobSectionOffset, mesh.VertexData);
+		readBlobReference(reader, file, header.BlobSectionOffset, mesh.IndexData);
+		const size_t indexSize = mesh.IndexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		if (reader.Failed || mesh.Lods.empty() || mesh.MaterialIndex >= header.MaterialCount ||
+			(mesh.IndexType != GL_UNSIGNED_SHORT && mesh.IndexType != GL_UNSIGNED_INT) ||
+			mesh.VertexData.Size < static_cast<size_t>(mesh.VertexCount) * mesh.Layout.Stride ||
+			mesh.IndexData.Size < mesh.IndexCount * indexSize || !hasValidIndices(mesh)) {
+			reader.Failed = true;
+			break;
+		}
+		for (const MeshLod& lod : mesh.Lods) {
+			if (lod.FirstIndex > mesh.IndexCount || lod.IndexCount > mesh.IndexCount - lod.FirstIndex) {
+				reader.Failed = true;
+			}
+		}
+		for (const Meshlet& meshlet : mesh.Meshlets) {
+			if (mesh.Lods.empty() || meshlet.FirstIndex > mesh.Lods[0].IndexCount ||
+				meshlet.IndexCount > mesh.Lods[0].IndexCount - meshlet.FirstIndex) {
+				reader.Failed = true;
+			}
+		}
+	}
+
+	scene.Nodes.resize(header.NodeCount);
+	for (unsigned int i=0; i < header.NodeCount && !reader.Failed; ++i) {
+		NodeData& node = scene.Nodes[i];
+		reader.readString(node.Name);
+		reader.readValue(node.Transform);
+		reader.readValue(node.ParentIndex);
+		reader.readArray(node.MeshIndices);
+		// Nodes are stored depth-first, parents first
+		if (node.ParentIndex < -1 || node.ParentIndex >= static_cast<int>(i)) {
+			reader.Failed = true;
+		}
+		for (unsigned int meshIndex : node.MeshIndices) {
+			if (meshIndex >= header.MeshCount) {
+				reader.Failed = true;
+			}
+		}
+	}
+
+	if (reader.Failed) {
+		fprintf(stderr, "Truncated or corrupt scene file: %s\n", fileName.c_str());
+		scene.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+
+struct SceneData;
+
+// Versioned binary scene file written by the scene cooker and loaded by the runtime
+class SceneFile
+{
+public:
+	static bool save(const std::string& fileName, const SceneData& scene);
+	// Memory-maps the file, the vertex and index blobs of the returned meshes point into the mapping
+	static bool load(const std::string& fileName, SceneData& scene);
+
+	static const unsigned int kMagic;
+	static const unsigned int kVersion;
+	static const unsigned int kBlobAlignment;
+};
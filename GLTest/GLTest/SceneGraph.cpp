@@ -0,0 +1,107 @@
+#include "SceneGraph.h"
+#include <assert.h>
+#include "SceneData.h"
+
+SceneGraph::SceneGraph() :
+	mHasDirtyNodes(false)
+{
+}
+
+void SceneGraph::build(const std::vector<NodeData>& nodes, const std::vector<MeshData>& meshes)
+{
+	clear();
+	const unsigned int nodeCount = static_cast<unsigned int>(nodes.size());
+	mParents.resize(nodeCount);
+	mSubtreeEnds.resize(nodeCount);
+	mFirstMeshes.resize(nodeCount);
+	mMeshCounts.resize(nodeCount);
+	mLocalTransforms.resize(nodeCount);
+	mWorldMatrices.resize(nodeCount);
+	mWVPMatrices.resize(nodeCount);
+	mDirty.assign(nodeCount, 1);
+	mHasDirtyNodes = nodeCount > 0;
+	mMeshBounds.resize(meshes.size());
+	for (size_t i=0; i < meshes.size(); ++i) {
+		mMeshBounds[i] = meshes[i].Bounds;
+	}
+
+	for (unsigned int i=0; i < nodeCount; ++i) {
+		const NodeData& node = nodes[i];
+		assert(node.ParentIndex < static_cast<int>(i) && "Nodes must be stored depth-first");
+		mParents[i] = node.ParentIndex;
+		mSubtreeEnds[i] = i + 1;
+		mLocalTransforms[i] = node.Transform;
+		mFirstMeshes[i] = static_cast<unsigned int>(mMeshIndices.size());
+		mMeshCounts[i] = static_cast<unsigned int>(node.MeshIndices.size());
+		mMeshIndices.insert(mMeshIndices.end(), node.MeshIndices.begin(), node.MeshIndices.end());
+		mInstanceNodes.insert(mInstanceNodes.end(), node.MeshIndices.size(), i);
+	}
+	mInstanceBounds.resize(getInstanceCount());
+
+	// Children come after their parent, walking backwards every subtree is complete before its parent is reached
+	for (unsigned int i=nodeCount; i-- > 0;) {
+		const int parent = mParents[i];
+		if (parent >= 0 && mSubtreeEnds[parent] < mSubtreeEnds[i]) {
+			mSubtreeEnds[parent] = mSubtreeEnds[i];
+		}
+	}
+}
+
+void SceneGraph::clear()
+{
+	mParents.clear();
+	mSubtreeEnds.clear();
+	mFirstMeshes.clear();
+	mMeshCounts.clear();
+	mMeshIndices.clear();
+	mInstanceNodes.clear();
+	mMeshBounds.clear();
+	mInstanceBounds.clear();
+	mLocalTransforms.clear();
+	mWorldMatrices.clear();
+	mWVPMatrices.clear();
+	mDirty.clear();
+	mHasDirtyNodes = false;
+}
+
+void SceneGraph::setLocalTransform(unsigned int index, const glm::mat4& transform)
+{
+	assert(index < getNodeCount());
+	mLocalTransforms[index] = transform;
+	mDirty[index] = 1;
+	mHasDirtyNodes = true;
+}
+
+bool SceneGraph::update(const glm::mat4& viewProjection)
+{
+	const unsigned int nodeCount = getNodeCount();
+	const bool boundsChanged = mHasDirtyNodes;
+	if (mHasDirtyNodes) {
+		// One pass in depth-first order, everything before recomputeEnd lies under a dirty node
+		unsigned int recomputeEnd = 0;
+		for (unsigned int i=0; i < nodeCount; ++i) {
+			if (mDirty[i]) {
+				mDirty[i] = 0;
+				if (recomputeEnd < mSubtreeEnds[i]) {
+					recomputeEnd = mSubtreeEnds[i];
+				}
+			}
+			if (i < recomputeEnd) {
+				const int parent = mParents[i];
+				mWorldMatrices[i] = parent >= 0 ? mWorldMatrices[parent] * mLocalTransforms[i] : mLocalTransforms[i];
+				for (unsigned int instance=mFirstMeshes[i]; instance < mFirstMeshes[i] + mMeshCounts[i]; ++instance) {
+					mInstanceBounds.set(instance, mMeshBounds[mMeshIndices[instance]].transformed(mWorldMatrices[i]));
+				}
+			}
+		}
+		mHasDirtyNodes = false;
+	}
+
+	// Only nodes with meshes get drawn
+	for (unsigned int i=0; i < nodeCount; ++i) {
+		if (mMeshCounts[i]) {
+			mWVPMatrices[i] = viewProjection * mWorldMatrices[i];
+		}
+	}
+	return boundsChanged;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include "Bounds.h"
+
+struct NodeData;
+struct MeshData;
+
+// Node hierarchy flattened depth-first into parallel arrays, so a parent always comes before its subtree
+// and the subtree of node i is the range [i, getSubtreeEnd(i)). World matrices are cached and only the
+// subtrees under changed local transforms are recomputed.
+// Every (node, mesh) pair is an instance, numbered in node order. The world-space boxes of the instances sit in
+// one contiguous array for culling and follow the world matrices.
+class SceneGraph
+{
+public:
+	SceneGraph();
+
+	void build(const std::vector<NodeData>& nodes, const std::vector<MeshData>& meshes);
+	void clear();
+
+	unsigned int getNodeCount() const { return static_cast<unsigned int>(mParents.size()); }
+	int getParent(unsigned int index) const { return mParents[index]; }
+	unsigned int getSubtreeEnd(unsigned int index) const { return mSubtreeEnds[index]; }
+	unsigned int getMeshCount(unsigned int index) const { return mMeshCounts[index]; }
+	unsigned int getMeshIndex(unsigned int index, unsigned int mesh) const { return mMeshIndices[mFirstMeshes[index] + mesh]; }
+
+	unsigned int getInstanceCount() const { return static_cast<unsigned int>(mMeshIndices.size()); }
+	unsigned int getInstanceNode(unsigned int instance) const { return mInstanceNodes[instance]; }
+	unsigned int getInstanceMesh(unsigned int instance) const { return mMeshIndices[instance]; }
+
+	const glm::mat4& getLocalTransform(unsigned int index) const { return mLocalTransforms[index]; }
+	// The node and its subtree get new world matrices in the next update()
+	void setLocalTransform(unsigned int index, const glm::mat4& transform);
+
+	// Recomputes the world matrices and instance bounds of dirty subtrees, then the world-view-projection matrix
+	// of every node with meshes. Returns true when instance bounds changed.
+	bool update(const glm::mat4& viewProjection);
+	// Valid after update()
+	const glm::mat4& getWorldMatrix(unsigned int index) const { return mWorldMatrices[index]; }
+	const glm::mat4& getWorldViewProjectionMatrix(unsigned int index) const { return mWVPMatrices[index]; }
+	const BoundingBoxArray& getInstanceBounds() const { return mInstanceBounds; }
+
+private:
+	std::vector<int> mParents;
+	std::vector<unsigned int> mSubtreeEnds;
+	std::vector<unsigned int> mFirstMeshes;
+	std::vector<unsigned int> mMeshCounts;
+	std::vector<unsigned int> mMeshIndices;
+	std::vector<unsigned int> mInstanceNodes;
+	std::vector<BoundingBox> mMeshBounds;
+	BoundingBoxArray mInstanceBounds;
+	std::vector<glm::mat4> mLocalTransforms;
+	std::vector<glm::mat4> mWorldMatrices;
+	std::vector<glm::mat4> mWVPMatrices;
+	std::vector<unsigned char> mDirty;
+	bool mHasDirtyNodes;
+};
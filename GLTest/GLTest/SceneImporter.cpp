@@ -0,0 +1,372 @@
+#include "SceneImporter.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+#include "SceneData.h"
+#include "VertexPacking.h"
+
+SceneImporter::SceneImporter() :
+	mVertexFormat(VertexFormat::COMPACT),
+	mOptimizeMeshes(true),
+	mGenerateLods(true),
+	mGenerateMeshlets(true),
+	mMeshletCount(0),
+	mMeshletTriangleCount(0)
+{
+}
+
+// Meshes smaller than this are cheap enough to always draw at full detail
+const unsigned int kMinLodTriangleCount = 256;
+const float kMaxLodIndexRatio = 0.8f;
+
+static aiTextureType getTextureType(TextureType type)
+{
+	switch (type) {
+		case TextureType::DIFFUSE_MAP:
+			return aiTextureType_DIFFUSE;
+		case TextureType::NORMAL_MAP:
+			return aiTextureType_HEIGHT; // For OBJs the type is HEIGHT not NORMAL
+		case TextureType::SPECULAR_MAP:
+			return aiTextureType_SPECULAR;
+	}
+	return aiTextureType_DIFFUSE;
+}
+
+static void importMaterial(const aiMaterial& aiMaterial, MaterialData& materialData)
+{
+	aiString name;
+	if (aiMaterial.Get(AI_MATKEY_NAME, name) == AI_SUCCESS) {
+		materialData.Name = name.C_Str();
+	}
+	int twoSided = 0;
+	if (aiMaterial.Get(AI_MATKEY_TWOSIDED, twoSided) == AI_SUCCESS) {
+		materialData.TwoSided = twoSided != 0;
+	}
+
+	const TextureType textureTypes[] = { TextureType::DIFFUSE_MAP, TextureType::NORMAL_MAP, TextureType::SPECULAR_MAP };
+	for (TextureType textureType : textureTypes) {
+		aiString path;
+		if (aiMaterial.GetTexture(getTextureType(textureType), 0, &path) == AI_SUCCESS) {
+			materialData.TextureNames[textureType] = path.C_Str();
+		}
+	}
+}
+
+bool SceneImporter::import(const std::string& fileName, SceneData& scene)
+{
+	scene.clear();
+	mCacheStatisticsBefore = VertexCacheStatistics();
+	mCacheStatisticsAfter = VertexCacheStatistics();
+
+	Assimp::Importer importer;
+	const aiScene* const pScene = 
+		importer.ReadFile(fileName, aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_FixInfacingNormals);
+	if (!pScene || !pScene->mRootNode) {
+		mErrorString = importer.GetErrorString();
+		return false;
+	}
+
+	scene.Materials.resize(pScene->mNumMaterials);
+	for (unsigned int i=0; i < pScene->mNumMaterials; ++i) {
+		importMaterial(*pScene->mMaterials[i], scene.Materials[i]);
+	}
+
+	scene.Meshes.resize(pScene->mNumMeshes);
+	for (unsigned int i=0; i < pScene->mNumMeshes; ++i) {
+		const aiMesh& aiMesh = *pScene->mMeshes[i];
+		if (!aiMesh.HasPositions() || !aiMesh.HasNormals() || !aiMesh.HasTangentsAndBitangents() || 
+			!aiMesh.HasTextureCoords(0) || !aiMesh.HasFaces()) {
+			mErrorString = std::string("Mesh is missing required vertex attributes: ") + aiMesh.mName.C_Str();
+			return false;
+		}
+		importMesh(aiMesh, scene.Meshes[i]);
+	}
+
+	importNode(*pScene->mRootNode, -1, scene);
+	return true;
+}
+
+void SceneImporter::importNode(const aiNode& aiNode, int parentIndex, SceneData& scene) const
+{
+	const int nodeIndex = static_cast<int>(scene.Nodes.size());
+	scene.Nodes.push_back(NodeData());
+	NodeData& node = scene.Nodes.back();
+	node.Name = aiNode.mName.C_Str();
+	node.ParentIndex = parentIndex;
+	node.MeshIndices.assign(aiNode.mMeshes, aiNode.mMeshes + aiNode.mNumMeshes);
+
+	aiMatrix4x4 aiTransform = aiNode.mTransformation;
+	aiTransform.Transpose();
+	node.Transform = glm::make_mat4(aiTransform[0]);
+
+	for (unsigned int n=0; n < aiNode.mNumChildren; ++n) {
+		importNode(*aiNode.mChildren[n], nodeIndex, scene);
+	}
+}
+
+void SceneImporter::getVertexLayout(VertexLayout& layout) const
+{
+	// The bitangent is rebuilt in the vertex shader from cross(normal, tangent)
+	layout.clear();
+	if (mVertexFormat == VertexFormat::COMPACT) {
+		// 20 bytes per vertex, the 4th position component keeps the stream 4-byte aligned
+		layout.addAttribute(VertexAttribute::POSITION, 4, GL_UNSIGNED_SHORT, GL_TRUE);
+		layout.addAttribute(VertexAttribute::TEX_COORDS, 2, GL_UNSIGNED_SHORT, GL_TRUE);
+		layout.addAttribute(VertexAttribute::NORMAL, 2, GL_SHORT, GL_TRUE);
+		layout.addAttribute(VertexAttribute::TANGENT, 4, GL_INT_2_10_10_10_REV, GL_TRUE);
+	}
+	else {
+		layout.addAttribute(VertexAttribute::POSITION, 3, GL_FLOAT);
+		layout.addAttribute(VertexAttribute::TEX_COORDS, 2, GL_FLOAT);
+		layout.addAttribute(VertexAttribute::NORMAL, 3, GL_FLOAT);
+		layout.addAttribute(VertexAttribute::TANGENT, 3, GL_FLOAT);
+	}
+}
+
+static const aiVector3D* getAttributeData(const aiMesh& aiMesh, VertexAttribute attribute)
+{
+	switch (attribute) {
+		case VertexAttribute::POSITION:
+			return aiMesh.mVertices;
+		case VertexAttribute::TEX_COORDS:
+			return aiMesh.mTextureCoords[0];
+		case VertexAttribute::NORMAL:
+			return aiMesh.mNormals;
+		case VertexAttribute::TANGENT:
+			return aiMesh.mTangents;
+		case VertexAttribute::BITANGENT:
+			return aiMesh.mBitangents;
+		case VertexAttribute::DRAW_INDEX:
+			// Supplied per instance by the renderer, never part of a mesh
+			assert(false && "DRAW_INDEX is not an imported attribute");
+			break;
+	}
+	return nullptr;
+}
+
+static glm::vec3 toVec3(const aiVector3D& v)
+{
+	return glm::vec3(v.x, v.y, v.z);
+}
+
+static void computeQuantization(const aiMesh& aiMesh, VertexQuantization& quantization)
+{
+	glm::vec3 minPosition(toVec3(aiMesh.mVertices[0])), maxPosition(minPosition);
+	glm::vec2 minTexCoord(aiMesh.mTextureCoords[0][0].x, aiMesh.mTextureCoords[0][0].y), maxTexCoord(minTexCoord);
+	for (unsigned int i=1; i < aiMesh.mNumVertices; ++i) {
+		const glm::vec3 position = toVec3(aiMesh.mVertices[i]);
+		minPosition = glm::min(minPosition, position);
+		maxPosition = glm::max(maxPosition, position);
+		const glm::vec2 texCoord(aiMesh.mTextureCoords[0][i].x, aiMesh.mTextureCoords[0][i].y);
+		minTexCoord = glm::min(minTexCoord, texCoord);
+		maxTexCoord = glm::max(maxTexCoord, texCoord);
+	}
+	quantization.PositionOffset = minPosition;
+	quantization.PositionScale = maxPosition - minPosition;
+	quantization.TexCoordOffset = minTexCoord;
+	quantization.TexCoordScale = maxTexCoord - minTexCoord;
+}
+
+// The sphere is centered on the box, its radius reaches the farthest vertex
+static void computeBounds(const aiMesh& aiMesh, BoundingBox& bounds, BoundingSphere& sphere)
+{
+	bounds.Min = bounds.Max = toVec3(aiMesh.mVertices[0]);
+	for (unsigned int i=1; i < aiMesh.mNumVertices; ++i) {
+		const glm::vec3 position = toVec3(aiMesh.mVertices[i]);
+		bounds.Min = glm::min(bounds.Min, position);
+		bounds.Max = glm::max(bounds.Max, position);
+	}
+
+	sphere.Center = bounds.getCenter();
+	float radiusSquared = 0.0f;
+	for (unsigned int i=0; i < aiMesh.mNumVertices; ++i) {
+		const glm::vec3 offset = toVec3(aiMesh.mVertices[i]) - sphere.Center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	sphere.Radius = sqrtf(radiusSquared);
+}
+
+static void packAttribute(const aiMesh& aiMesh, unsigned int vertex, const VertexAttributeFormat& format, 
+						  const VertexQuantization& quantization, unsigned char* pDest)
+{
+	const aiVector3D* const pSource = getAttributeData(aiMesh, format.Attribute);
+	assert(pSource);
+	const glm::vec3 value = toVec3(pSource[vertex]);
+
+	switch (format.Type) {
+		case GL_FLOAT:
+			assert(format.ComponentCount <= 3);
+			memcpy(pDest, &value.x, format.ComponentCount * sizeof(float));
+			break;
+
+		case GL_UNSIGNED_SHORT: {
+			assert(format.Normalized);
+			glm::uint16* const pQuantized = reinterpret_cast<glm::uint16*>(pDest);
+			if (format.Attribute == VertexAttribute::POSITION) {
+				for (int c=0; c < 3; ++c) {
+					pQuantized[c] = quantizeUnorm16(value[c], quantization.PositionOffset[c], quantization.PositionScale[c]);
+				}
+				if (format.ComponentCount > 3) {
+					pQuantized[3] = 0xFFFF;
+				}
+			}
+			else {
+				assert(format.Attribute == VertexAttribute::TEX_COORDS);
+				for (int c=0; c < 2; ++c) {
+					pQuantized[c] = quantizeUnorm16(value[c], quantization.TexCoordOffset[c], quantization.TexCoordScale[c]);
+				}
+			}
+			break;
+		}
+
+		case GL_SHORT: {
+			assert(format.Normalized && format.ComponentCount == 2);
+			const glm::vec2 encoded = encodeOctahedral(value);
+			glm::uint16* const pEncoded = reinterpret_cast<glm::uint16*>(pDest);
+			pEncoded[0] = glm::packSnorm1x16(encoded.x);
+			pEncoded[1] = glm::packSnorm1x16(encoded.y);
+			break;
+		}
+
+		case GL_INT_2_10_10_10_REV: {
+			assert(format.Attribute == VertexAttribute::TANGENT);
+			const float handedness = computeHandedness(toVec3(aiMesh.mNormals[vertex]), value, toVec3(aiMesh.mBitangents[vertex]));
+			const glm::uint32 packed = packTangent(value, handedness);
+			memcpy(pDest, &packed, sizeof(packed));
+			break;
+		}
+
+		default:
+			assert(false && "Unsupported vertex attribute type");
+	}
+}
+
+template<typename IndexType>
+static void packIndices(const std::vector<unsigned int>& indices, DataBlob& indexData)
+{
+	std::vector<unsigned char> bytes(indices.size() * sizeof(IndexType));
+	IndexType* const pDest = reinterpret_cast<IndexType*>(&bytes[0]);
+	for (size_t i=0; i < indices.size(); ++i) {
+		pDest[i] = static_cast<IndexType>(indices[i]);
+	}
+	indexData.setStorage(bytes);
+}
+
+// Every level targets half the triangles of the previous one and is simplified from it, so its error is
+// the sum of the errors along the way. The levels share the vertices and follow LOD 0 in indices.
+void SceneImporter::generateLods(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+								 std::vector<MeshLod>& lods)
+{
+	MeshLod lod;
+	lod.FirstIndex = 0;
+	lod.IndexCount = static_cast<unsigned int>(indices.size());
+	lod.Error = 0.0f;
+	lods.assign(1, lod);
+
+	if (mGenerateLods) {
+		const unsigned int vertexCount = static_cast<unsigned int>(positions.size());
+		std::vector<unsigned int> lodIndices(indices);
+		while (lods.size() < MeshData::kMaxLodCount && lodIndices.size() / 3 >= kMinLodTriangleCount) {
+			const size_t previousIndexCount = lodIndices.size();
+			float error = 0.0f;
+			MeshOptimizer::simplify(lodIndices, positions, static_cast<unsigned int>(previousIndexCount / 6 * 3), error);
+			// Locked seams and borders can leave too little to remove for another level to pay off
+			if (lodIndices.empty() || lodIndices.size() > previousIndexCount * kMaxLodIndexRatio) {
+				break;
+			}
+			if (mOptimizeMeshes) {
+				MeshOptimizer::optimizeVertexCache(lodIndices, vertexCount);
+			}
+
+			lod.FirstIndex = static_cast<unsigned int>(indices.size());
+			lod.IndexCount = static_cast<unsigned int>(lodIndices.size());
+			lod.Error = lods.back().Error + error;
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+			lods.push_back(lod);
+		}
+	}
+
+	mLodTriangleCounts.resize(MeshData::kMaxLodCount, 0);
+	for (unsigned int level=0; level < MeshData::kMaxLodCount; ++level) {
+		mLodTriangleCounts[level] += lods[std::min<size_t>(level, lods.size() - 1)].IndexCount / 3;
+	}
+}
+
+void SceneImporter::importMesh(const aiMesh& aiMesh, MeshData& meshData)
+{
+	meshData.MaterialIndex = aiMesh.mMaterialIndex;
+
+	std::vector<unsigned int> indices(aiMesh.mNumFaces * 3);
+	unsigned int index = 0;
+	for (unsigned int i=0; i < aiMesh.mNumFaces; ++i) {
+		assert(aiMesh.mFaces[i].mNumIndices == 3);
+		indices[index++] = aiMesh.mFaces[i].mIndices[0];
+		indices[index++] = aiMesh.mFaces[i].mIndices[1];
+		indices[index++] = aiMesh.mFaces[i].mIndices[2];
+	}
+
+	std::vector<glm::vec3> positions(aiMesh.mNumVertices);
+	for (unsigned int i=0; i < aiMesh.mNumVertices; ++i) {
+		positions[i] = toVec3(aiMesh.mVertices[i]);
+	}
+
+	// vertexOrder maps output vertices to aiMesh vertices, an empty order keeps the aiMesh order
+	std::vector<unsigned int> vertexOrder;
+	if (mOptimizeMeshes) {
+		mCacheStatisticsBefore.add(MeshOptimizer::analyzeVertexCache(indices, aiMesh.mNumVertices));
+		MeshOptimizer::optimizeVertexCache(indices, aiMesh.mNumVertices);
+		MeshOptimizer::optimizeOverdraw(indices, positions);
+		MeshOptimizer::optimizeVertexFetch(indices, aiMesh.mNumVertices, vertexOrder);
+		mCacheStatisticsAfter.add(MeshOptimizer::analyzeVertexCache(indices, static_cast<unsigned int>(vertexOrder.size())));
+
+		std::vector<glm::vec3> orderedPositions(vertexOrder.size());
+		for (unsigned int i=0; i < vertexOrder.size(); ++i) {
+			orderedPositions[i] = positions[vertexOrder[i]];
+		}
+		positions.swap(orderedPositions);
+	}
+	// Meshlets only cover the full detail level, coarser levels are drawn whole
+	if (mGenerateMeshlets && indices.size() > Meshlet::kMaxTriangles * 3) {
+		MeshOptimizer::buildMeshlets(indices, positions, meshData.Meshlets);
+		mMeshletCount += static_cast<unsigned int>(meshData.Meshlets.size());
+		mMeshletTriangleCount += static_cast<unsigned int>(indices.size() / 3);
+	}
+	generateLods(indices, positions, meshData.Lods);
+
+	getVertexLayout(meshData.Layout);
+	const VertexLayout& layout = meshData.Layout;
+	assert(layout.Stride > 0);
+
+	meshData.VertexCount = vertexOrder.empty() ? aiMesh.mNumVertices : static_cast<unsigned int>(vertexOrder.size());
+	computeBounds(aiMesh, meshData.Bounds, meshData.Sphere);
+	meshData.Quantization = VertexQuantization();
+	const VertexAttributeFormat* const pPosition = layout.findAttribute(VertexAttribute::POSITION);
+	if (pPosition && pPosition->Type != GL_FLOAT) {
+		computeQuantization(aiMesh, meshData.Quantization);
+	}
+
+	// Interleave all attributes into a single stream
+	std::vector<unsigned char> vertexBytes(meshData.VertexCount * layout.Stride, 0);
+	for (const VertexAttributeFormat& format : layout.Attributes) {
+		unsigned char* pDest = &vertexBytes[format.Offset];
+		for (unsigned int i=0; i < meshData.VertexCount; ++i, pDest += layout.Stride) {
+			const unsigned int sourceVertex = vertexOrder.empty() ? i : vertexOrder[i];
+			packAttribute(aiMesh, sourceVertex, format, meshData.Quantization, pDest);
+		}
+	}
+	meshData.VertexData.setStorage(vertexBytes);
+
+	meshData.IndexCount = static_cast<unsigned int>(indices.size());
+	meshData.IndexType = IndexBuffer::selectIndexType(meshData.VertexCount);
+	if (meshData.IndexType == GL_UNSIGNED_SHORT) {
+		packIndices<GLushort>(indices, meshData.IndexData);
+	}
+	else {
+		packIndices<GLuint>(indices, meshData.IndexData);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "GPUBuffers.h"
+#include "MeshOptimizer.h"
+
+struct SceneData;
+struct MeshData;
+struct MeshLod;
+struct aiScene;
+struct aiMesh;
+struct aiNode;
+
+// Converts a model file into GPU-ready SceneData through Assimp. Only the scene cooker links this.
+class SceneImporter
+{
+public:
+	SceneImporter();
+
+	bool import(const std::string& fileName, SceneData& scene);
+	const std::string& getErrorString() const { return mErrorString; }
+
+	void setVertexFormat(VertexFormat format) { mVertexFormat = format; }
+	void setOptimizeMeshes(bool optimize) { mOptimizeMeshes = optimize; }
+	void setGenerateLods(bool generate) { mGenerateLods = generate; }
+	void setGenerateMeshlets(bool generate) { mGenerateMeshlets = generate; }
+
+	const VertexCacheStatistics& getCacheStatisticsBefore() const { return mCacheStatisticsBefore; }
+	const VertexCacheStatistics& getCacheStatisticsAfter() const { return mCacheStatisticsAfter; }
+	// Triangles of all meshes at each level of detail, meshes without a level count their coarsest one
+	const std::vector<unsigned int>& getLodTriangleCounts() const { return mLodTriangleCounts; }
+	unsigned int getMeshletCount() const { return mMeshletCount; }
+	unsigned int getMeshletTriangleCount() const { return mMeshletTriangleCount; }
+
+private:
+	VertexFormat mVertexFormat;
+	bool mOptimizeMeshes;
+	bool mGenerateLods;
+	bool mGenerateMeshlets;
+	std::string mErrorString;
+	VertexCacheStatistics mCacheStatisticsBefore;
+	VertexCacheStatistics mCacheStatisticsAfter;
+	std::vector<unsigned int> mLodTriangleCounts;
+	unsigned int mMeshletCount;
+	unsigned int mMeshletTriangleCount;
+
+	void importNode(const aiNode& aiNode, int parentIndex, SceneData& scene) const;
+	void importMesh(const aiMesh& aiMesh, MeshData& meshData);
+	void generateLods(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		std::vector<MeshLod>& lods);
+	void getVertexLayout(VertexLayout& layout) const;
+};
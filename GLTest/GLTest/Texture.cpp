@@ -1,24 +1,143 @@
 #include "Texture.h"
-#include <FreeImage.h>
 #include <assert.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <map>
+#include "TextureData.h"
+#include "TextureCompressor.h"
+#include "TextureLoader.h"
+#include "GLState.h"
 
 std::unordered_map<std::string, Texture> Texture::sTextureMap;
 std::string Texture::sBasePath;
-const Texture* Texture::sDefaultTexture = nullptr;
+TextureLoader Texture::sLoader;
+size_t Texture::sMemoryBudget = static_cast<size_t>(-1);
+TextureHandle Texture::sDefaultTexture;
+std::list<TextureArray> Texture::sTextureArrays;
+bool Texture::sPackingNeeded = false;
+bool Texture::sResidencySettled = false;
+std::unordered_set<std::string> Texture::sFailedPaths;
 
-GLenum getGLFormat(FREE_IMAGE_COLOR_TYPE type)
+// Bounds the upload work streaming adds to a single frame
+const unsigned int kMaxStreamRequestsPerFrame = 4;
+
+// Forward slashes without "." and ".." segments, lower case on Windows where paths are case-insensitive
+static std::string normalizePath(const std::string& path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	for (size_t i=0; i <= path.size(); ++i) {
+		const char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\') {
+#if defined(_WIN32)
+			segment += static_cast<char>(tolower(c));
+#else
+			segment += c;
+#endif
+			continue;
+		}
+		if (segment == ".." && !segments.empty() && segments.back() != "..") {
+			segments.pop_back();
+		}
+		else if (!segment.empty() && segment != ".") {
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	std::string result = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+	for (size_t i=0; i < segments.size(); ++i) {
+		result += i ? "/" + segments[i] : segments[i];
+	}
+	return result;
+}
+
+static std::string makePathKey(const std::string& path, TextureType type)
+{
+	return path + '|' + static_cast<char>('0' + static_cast<int>(type));
+}
+
+// Everything the storage of a texture array depends on
+struct TextureArrayKey
+{
+	GLenum InternalFormat;
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int LevelCount;
+
+	bool operator<(const TextureArrayKey& rhs) const
+	{
+		if (InternalFormat != rhs.InternalFormat) return InternalFormat < rhs.InternalFormat;
+		if (Width != rhs.Width) return Width < rhs.Width;
+		if (Height != rhs.Height) return Height < rhs.Height;
+		return LevelCount < rhs.LevelCount;
+	}
+};
+
+static void setSamplerParameters(GLint maxLevel)
 {
-	assert(type == FIC_MINISBLACK || type == FIC_RGB || type == FIC_RGBALPHA);
-	switch (type) {
-		case FIC_MINISBLACK: return GL_RED;
-		case FIC_RGB: return GL_RGB;
-		case FIC_RGBALPHA: return GL_RGBA;
-	};
-	return GL_RGB;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, maxLevel);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+// Uninitialized storage for a whole mip chain of layerCount layers. levelSizes holds the size of one layer per level.
+static GLuint createArrayStorage(const TextureArrayKey& key, const std::vector<size_t>& levelSizes, unsigned int layerCount)
+{
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	GLState::bindTexture(GLState::kScratchTextureUnit, GL_TEXTURE_2D_ARRAY, id);
+	if (GLEW_ARB_texture_storage) {
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, key.LevelCount, key.InternalFormat, key.Width, key.Height, layerCount);
+	}
+	else {
+		const bool compressed = key.InternalFormat != GL_RGBA8;
+		unsigned int width = key.Width, height = key.Height;
+		for (unsigned int level=0; level < key.LevelCount; ++level) {
+			if (compressed) {
+				const GLsizei size = static_cast<GLsizei>(levelSizes[level] * layerCount);
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, key.InternalFormat, width, height, layerCount, 0, size, nullptr);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, key.InternalFormat, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+	}
+	setSamplerParameters(static_cast<GLint>(key.LevelCount - 1));
+	return id;
+}
+
+static void copyLayer(const TextureArrayKey& key, GLuint sourceId, GLint sourceLayer, GLuint destinationId, GLint destinationLayer)
+{
+	unsigned int width = key.Width, height = key.Height;
+	for (unsigned int level=0; level < key.LevelCount; ++level) {
+		glCopyImageSubData(sourceId, GL_TEXTURE_2D_ARRAY, level, 0, 0, sourceLayer,
+			destinationId, GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer, width, height, 1);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
 }
 
 Texture::Texture() :
-	mId(0)
+	mId(0),
+	mType(TextureType::DIFFUSE_MAP),
+	mContentKey(0),
+	mpSource(nullptr),
+	mRefCount(0),
+	mInternalFormat(GL_RGBA8),
+	mWidth(0),
+	mHeight(0),
+	mLayer(0),
+	mpArray(nullptr),
+	mResidentLevel(0),
+	mRequestedLevel(0),
+	mLoading(false),
+	mLastUsedFrame(0)
 {
 }
 
@@ -28,76 +147,212 @@ Texture::~Texture()
 	mId = 0;
 }
 
-const Texture* Texture::load(const std::string& fileName)
+TextureHandle Texture::load(const std::string& fileName, TextureType type)
+{
+	bool created = false;
+	Texture* const pTexture = acquire(fileName, type, created);
+	if (created) {
+		const std::string duplicatePath = sLoader.findDuplicate(pTexture->mName, type, pTexture->mContentKey);
+		if (!duplicatePath.empty() && pTexture->shareWith(duplicatePath)) {
+			return TextureHandle(pTexture);
+		}
+
+		TextureData textureData;
+		if (!TextureLoader::decode(pTexture->mName, type, TextureCompressor::isSupported(), textureData)) {
+			pTexture->onLoadFailed();
+			// Nothing references it yet, let the next collection drop the entry
+			return TextureHandle();
+		}
+		pTexture->create(textureData, 0, false);
+	}
+	return TextureHandle(pTexture);
+}
+
+TextureHandle Texture::loadAsync(const std::string& fileName, TextureType type)
 {
-	if (sTextureMap.find(fileName) != sTextureMap.end()) {
-		unload(sTextureMap[fileName]);
+	bool created = false;
+	Texture* const pTexture = acquire(fileName, type, created);
+	if (created) {
+		pTexture->requestLevel(0);
 	}
+	return TextureHandle(pTexture);
+}
 
-	const std::string path = sBasePath + fileName;
+// Finds the cache entry for a file or adds an empty one. Files with the same contents are only matched once
+// the loader has read them, see shareWith().
+Texture* Texture::acquire(const std::string& fileName, TextureType type, bool& created)
+{
+	const std::string path = normalizePath(sBasePath + fileName);
+	const std::string pathKey = makePathKey(path, type);
+	const auto& textureIt = sTextureMap.find(pathKey);
+	if (textureIt != sTextureMap.end()) {
+		created = false;
+		return &textureIt->second;
+	}
+
+	// Map nodes are stable, the loader fills this entry in place once the data is ready
+	Texture& texture = sTextureMap[pathKey];
+	texture.mName = path;
+	texture.mType = type;
+	created = true;
+	return &texture;
+}
 
-	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(path.c_str(), 0);
-	if (fif == FIF_UNKNOWN) {
-		fif = FreeImage_GetFIFFromFilename(path.c_str());
+// Shows the texture of an earlier file with the same contents instead of loading a copy. Fails when that
+// texture has been dropped from the cache since the loader found it.
+bool Texture::shareWith(const std::string& sourcePath)
+{
+	const auto& sourceIt = sTextureMap.find(makePathKey(sourcePath, mType));
+	if (sourceIt == sTextureMap.end() || &sourceIt->second == this) {
+		return false;
 	}
-	if (fif == FIF_UNKNOWN) {
-		return nullptr;
+	assert(!sourceIt->second.mpSource);
+	mpSource = &sourceIt->second;
+	++mpSource->mRefCount;
+	mLoading = false;
+	return true;
+}
+
+void Texture::collectUnused()
+{
+	// A texture shown by others goes once they are gone, which may take another call
+	for (auto it = sTextureMap.begin(); it != sTextureMap.end();) {
+		if (it->second.mRefCount == 0 && !it->second.mLoading) {
+			unload(it->second);
+			it = sTextureMap.erase(it);
+		}
+		else {
+			++it;
+		}
 	}
+}
 
-	FIBITMAP* dib = nullptr;
-	if (FreeImage_FIFSupportsReading(fif)) {
-		dib = FreeImage_Load(fif, path.c_str());
+size_t Texture::getChainSize(unsigned int firstLevel) const
+{
+	size_t size = 0;
+	for (size_t i=firstLevel; i < mLevelSizes.size(); ++i) {
+		size += mLevelSizes[i];
 	}
-	if (!dib) {
-		return nullptr;
+	return size;
+}
+
+void Texture::requestLevel(unsigned int firstLevel)
+{
+	assert(!mLoading);
+	mLoading = true;
+	mRequestedLevel = firstLevel;
+	sLoader.request(this, mName, mType, firstLevel);
+}
+
+// Uploads the levels from firstLevel on, either from client memory or from the bound pixel unpack buffer
+// where they are stored back to back. Replaces the current GL texture if there is one.
+void Texture::create(const TextureData& textureData, unsigned int firstLevel, bool fromPixelBuffer)
+{
+	assert(firstLevel < textureData.Levels.size() && !mpArray);
+	if (mLevelSizes.empty()) {
+		for (const MipLevel& level : textureData.Levels) {
+			mLevelSizes.push_back(level.Data.size());
+		}
 	}
 
-	BYTE* bits = FreeImage_GetBits(dib);
-	unsigned int width = FreeImage_GetWidth(dib);
-	unsigned int height = FreeImage_GetHeight(dib);
-	if (bits == 0 || width == 0 || height == 0) {
-		return nullptr;
+	if (mId) {
+		glDeleteTextures(1, &mId);
+		GLState::forgetTexture(mId);
 	}
+	glGenTextures(1, &mId);
+	assert(mId);
+	GLState::bindTexture(GLState::kScratchTextureUnit, GL_TEXTURE_2D_ARRAY, mId);
+	mInternalFormat = textureData.isCompressed() ? textureData.InternalFormat : GL_RGBA8;
+	mWidth = textureData.getWidth();
+	mHeight = textureData.getHeight();
+	mLayer = 0;
+	mResidentLevel = firstLevel;
+	mRequestedLevel = firstLevel;
+	mLoading = false;
+	sPackingNeeded = true;
 
-	FREE_IMAGE_COLOR_TYPE colorType = FreeImage_GetColorType(dib);
-	FREE_IMAGE_TYPE imageType = FreeImage_GetImageType(dib);
-	GLenum glFormat = getGLFormat(colorType);
+	// Immutable storage for the whole chain lets the driver allocate it once and skip completeness checks
+	const bool immutableStorage = GLEW_ARB_texture_storage != 0;
+	if (immutableStorage) {
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLsizei>(textureData.Levels.size() - firstLevel), mInternalFormat,
+			textureData.Levels[firstLevel].Width, textureData.Levels[firstLevel].Height, 1);
+	}
 
-	Texture tex;
-	tex.mName = fileName;
-	glGenTextures(1, &tex.mId);
-	assert(tex.mId);
-	glBindTexture(GL_TEXTURE_2D, tex.mId);
-	glTexImage2D(GL_TEXTURE_2D, 0, glFormat, width, height, 0, glFormat, GL_UNSIGNED_BYTE, bits);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	size_t offset = 0;
+	for (size_t i=firstLevel; i < textureData.Levels.size(); ++i) {
+		const MipLevel& level = textureData.Levels[i];
+		const GLint levelIndex = static_cast<GLint>(i - firstLevel);
+		const void* const pPixels = fromPixelBuffer ? reinterpret_cast<const void*>(offset) : &level.Data[0];
+		if (textureData.isCompressed()) {
+			const GLsizei size = static_cast<GLsizei>(level.Data.size());
+			if (immutableStorage) {
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, 0, 0, level.Width, level.Height, 1, mInternalFormat, size, pPixels);
+			}
+			else {
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, mInternalFormat, level.Width, level.Height, 1, 0, size, pPixels);
+			}
+		}
+		else if (immutableStorage) {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, 0, 0, level.Width, level.Height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+		}
+		else {
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, mInternalFormat, level.Width, level.Height, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+		}
+		offset += level.Data.size();
+	}
+	setSamplerParameters(static_cast<GLint>(textureData.Levels.size() - firstLevel - 1));
+}
 
-	sTextureMap[fileName] = tex;
+void Texture::onLoadFailed()
+{
+	if (sFailedPaths.insert(mName).second) {
+		fprintf(stderr, "Error loading texture: %s\n", mName.c_str());
+	}
+	mLoading = false;
+	mRequestedLevel = mResidentLevel;
+}
 
-	FreeImage_Unload(dib);
-	return &sTextureMap[fileName];
+// First entry of the file in any type, or null
+Texture* Texture::find(const char* textureName)
+{
+	const std::string path = normalizePath(sBasePath + textureName);
+	for (int type=0; type <= static_cast<int>(TextureType::SPECULAR_MAP); ++type) {
+		const auto& it = sTextureMap.find(makePathKey(path, static_cast<TextureType>(type)));
+		if (it != sTextureMap.end()) {
+			return &it->second;
+		}
+	}
+	return nullptr;
 }
 
 bool Texture::hasTexture(const char* textureName)
 {
-	return sTextureMap.find(textureName) != sTextureMap.end();
+	return find(textureName) != nullptr;
 }
 
 const Texture& Texture::get(const char* textureName)
 {
-	assert(hasTexture(textureName));
-	return sTextureMap[textureName];
+	const Texture* const pTexture = find(textureName);
+	assert(pTexture);
+	return pTexture ? *pTexture : *sDefaultTexture;
 }
 
 void Texture::unloadAll()
 {
+	sLoader.stop();
+	sDefaultTexture.reset();
+	for (auto& it : sTextureMap) {
+		if (it.second.mpSource) {
+			--it.second.mpSource->mRefCount;
+			it.second.mpSource = nullptr;
+		}
+	}
 	for (const auto& it : sTextureMap) {
+		assert(it.second.mRefCount == 0);
 		unload(it.second);
 	}
 	sTextureMap.clear();
+	assert(sTextureArrays.empty());
 }
 
 void Texture::setBasePath(const std::string& basePath)
@@ -105,20 +360,200 @@ void Texture::setBasePath(const std::string& basePath)
 	sBasePath = basePath;
 }
 
-void Texture::setDefaultTexture(const Texture* pTexture)
+void Texture::setDefaultTexture(const TextureHandle& texture)
+{
+	sDefaultTexture = texture;
+}
+
+TextureLoader& Texture::getLoader()
+{
+	return sLoader;
+}
+
+void Texture::setMemoryBudget(size_t budget)
+{
+	sMemoryBudget = budget;
+}
+
+void Texture::updateResidency(unsigned int frameIndex)
+{
+	collectUnused();
+
+	// GPU memory once every pending load has landed
+	size_t requestedSize = 0;
+	for (const auto& it : sTextureMap) {
+		requestedSize += it.second.getChainSize(it.second.mRequestedLevel);
+	}
+
+	unsigned int streamRequests = 0;
+	unsigned int evictions = 0;
+	for (auto& it : sTextureMap) {
+		Texture& texture = it.second;
+		if (streamRequests == kMaxStreamRequestsPerFrame) {
+			break;
+		}
+		if (texture.mLoading || texture.mpArray || texture.mResidentLevel == 0 || texture.mLastUsedFrame + 1 < frameIndex) {
+			continue;
+		}
+		const size_t growth = texture.mLevelSizes[texture.mResidentLevel - 1];
+		if (requestedSize + growth <= sMemoryBudget) {
+			texture.requestLevel(texture.mResidentLevel - 1);
+			requestedSize += growth;
+			++streamRequests;
+		}
+	}
+
+	while (requestedSize > sMemoryBudget) {
+		Texture* pVictim = nullptr;
+		for (auto& it : sTextureMap) {
+			Texture& texture = it.second;
+			const bool canShrink = !texture.mLoading && texture.mRequestedLevel + 1 < texture.mLevelSizes.size();
+			if (canShrink && &texture != sDefaultTexture.get() && (!pVictim || texture.mLastUsedFrame < pVictim->mLastUsedFrame)) {
+				pVictim = &texture;
+			}
+		}
+		if (!pVictim) {
+			// Everything is either loading or down to its last level, try again next frame
+			break;
+		}
+		if (pVictim->mpArray) {
+			unpackArray(pVictim->mpArray);
+		}
+		requestedSize -= pVictim->mLevelSizes[pVictim->mRequestedLevel];
+		pVictim->requestLevel(pVictim->mRequestedLevel + 1);
+		++evictions;
+	}
+	sResidencySettled = streamRequests == 0 && evictions == 0;
+}
+
+unsigned int Texture::packArrays()
+{
+	// Layers are filled with GPU copies from the existing textures
+	if (!sPackingNeeded || !sResidencySettled || (!GLEW_VERSION_4_3 && !GLEW_ARB_copy_image)) {
+		return 0;
+	}
+	sPackingNeeded = false;
+
+	std::map<TextureArrayKey, std::vector<Texture*> > groups;
+	for (auto& it : sTextureMap) {
+		Texture& texture = it.second;
+		if (texture.mId && !texture.mLoading && !texture.mpArray && texture.mResidentLevel == 0) {
+			TextureArrayKey key;
+			key.InternalFormat = texture.mInternalFormat;
+			key.Width = texture.mWidth;
+			key.Height = texture.mHeight;
+			key.LevelCount = static_cast<unsigned int>(texture.mLevelSizes.size());
+			groups[key].push_back(&texture);
+		}
+	}
+
+	unsigned int packedCount = 0;
+	for (const auto& groupIt : groups) {
+		const TextureArrayKey& key = groupIt.first;
+		const std::vector<Texture*>& textures = groupIt.second;
+		if (textures.size() < 2) {
+			continue;
+		}
+
+		TextureArray array;
+		array.LayerCount = static_cast<unsigned int>(textures.size());
+		array.LiveLayerCount = array.LayerCount;
+		array.Id = createArrayStorage(key, textures[0]->mLevelSizes, array.LayerCount);
+		sTextureArrays.push_back(array);
+		TextureArray* const pArray = &sTextureArrays.back();
+
+		for (GLint layer=0; layer < static_cast<GLint>(textures.size()); ++layer) {
+			Texture& texture = *textures[layer];
+			copyLayer(key, texture.mId, 0, pArray->Id, layer);
+			glDeleteTextures(1, &texture.mId);
+			GLState::forgetTexture(texture.mId);
+			texture.mId = pArray->Id;
+			texture.mLayer = layer;
+			texture.mpArray = pArray;
+			++packedCount;
+		}
+	}
+	return packedCount;
+}
+
+// Copies every layer of a shared array into a texture of its own, so each can be evicted on its own again
+void Texture::unpackArray(TextureArray* pArray)
+{
+	for (auto& it : sTextureMap) {
+		Texture& texture = it.second;
+		if (texture.mpArray != pArray) {
+			continue;
+		}
+		TextureArrayKey key;
+		key.InternalFormat = texture.mInternalFormat;
+		key.Width = texture.mWidth;
+		key.Height = texture.mHeight;
+		key.LevelCount = static_cast<unsigned int>(texture.mLevelSizes.size());
+		texture.mId = createArrayStorage(key, texture.mLevelSizes, 1);
+		copyLayer(key, pArray->Id, texture.mLayer, texture.mId, 0);
+		texture.mLayer = 0;
+		texture.mpArray = nullptr;
+	}
+	destroyArray(pArray);
+	sPackingNeeded = true;
+}
+
+void Texture::destroyArray(TextureArray* pArray)
+{
+	glDeleteTextures(1, &pArray->Id);
+	GLState::forgetTexture(pArray->Id);
+	for (auto it = sTextureArrays.begin(); it != sTextureArrays.end(); ++it) {
+		if (&*it == pArray) {
+			sTextureArrays.erase(it);
+			break;
+		}
+	}
+}
+
+size_t Texture::getTotalResidentSize()
 {
-	sDefaultTexture = pTexture;
+	size_t size = 0;
+	for (const auto& it : sTextureMap) {
+		size += it.second.getResidentSize();
+	}
+	return size;
 }
 
 void Texture::unload(const Texture& texture)
 {
-	assert(texture.mId);
-	glDeleteTextures(1, &texture.mId);
+	if (texture.mContentKey) {
+		sLoader.forgetContent(texture.mContentKey, texture.mName);
+	}
+	if (texture.mpSource) {
+		assert(texture.mpSource->mRefCount > 0);
+		--texture.mpSource->mRefCount;
+		return;
+	}
+
+	if (!texture.mpArray) {
+		if (texture.mId) {
+			glDeleteTextures(1, &texture.mId);
+			GLState::forgetTexture(texture.mId);
+		}
+		return;
+	}
+
+	// Shared arrays go away with their last layer
+	assert(texture.mpArray->LiveLayerCount > 0);
+	if (--texture.mpArray->LiveLayerCount == 0) {
+		destroyArray(texture.mpArray);
+	}
 }
 
 void Texture::bind(GLenum textureUnit) const
 {
-	assert(mId);
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, mId);
+	const GLuint id = getId();
+	assert(id || (sDefaultTexture.isValid() && sDefaultTexture->mId));
+	GLState::bindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, id ? id : sDefaultTexture->mId);
+}
+
+GLint Texture::getLayer() const
+{
+	const Texture& texture = mpSource ? *mpSource : *this;
+	return texture.mId ? texture.mLayer : sDefaultTexture->mLayer;
 }
@@ -1,7 +1,11 @@
 #pragma once
+#include <assert.h>
 #include <GL/glew.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <vector>
+#include <list>
 
 enum class TextureType
 {
@@ -10,31 +14,184 @@ enum class TextureType
 	SPECULAR_MAP
 };
 
+struct TextureData;
+class TextureLoader;
+class TextureHandle;
+
+// GL_TEXTURE_2D_ARRAY shared by textures of the same format, size and mip count
+struct TextureArray
+{
+	GLuint Id;
+	unsigned int LayerCount;
+	// Layers whose texture has not been unloaded yet
+	unsigned int LiveLayerCount;
+};
+
 class Texture
 {
 public:
 	Texture();
 	~Texture();
 
+	// Every texture is a GL_TEXTURE_2D_ARRAY, either of its own with a single layer or shared after packArrays().
+	// Binds the default texture instead while the texture is still loading, binding the array already
+	// bound to the unit is skipped.
 	void bind(GLenum textureUnit) const;
-	GLuint getId() const { return mId; }
+	GLuint getId() const { return mpSource ? mpSource->mId : mId; }
+	// Layer to sample, matching whatever bind() bound
+	GLint getLayer() const;
+	bool isLoaded() const { return getId() != 0; }
+	// Usage feeds the LRU eviction in updateResidency
+	void markUsed(unsigned int frameIndex) const { (mpSource ? mpSource : this)->mLastUsedFrame = frameIndex; }
+	size_t getResidentSize() const { return getChainSize(mResidentLevel); }
+
+	// Textures are cached by normalized path. The loader hashes the contents of every new file, and one with the
+	// same contents and type as a file already loaded shares its texture, so an image is decoded and uploaded once
+	// however many materials or paths refer to it.
 
-	static const Texture* load(const std::string& fileName);
+	// Loads synchronously, preferring a block-compressed mip chain cached next to the source as <fileName>.dds, rebuilding it
+	// when the source is newer. The type selects the compression format.
+	static TextureHandle load(const std::string& fileName, TextureType type = TextureType::DIFFUSE_MAP);
+	// Returns right away, the texture is decoded by the loader threads and uploaded by getLoader().update()
+	static TextureHandle loadAsync(const std::string& fileName, TextureType type);
+	// Every handle other than the default texture must have been released
 	static void unloadAll();
 	static bool hasTexture(const char* textureName);
 	static const Texture& get(const char* textureName);
 	static void setBasePath(const std::string& basePath);
-	static void setDefaultTexture(const Texture* pTexture);
+	static void setDefaultTexture(const TextureHandle& texture);
+	static TextureLoader& getLoader();
+
+	static void setMemoryBudget(size_t budget);
+	// Releases textures that are no longer referenced. While over budget, drops the top mip level of the least recently used textures,
+	// a packed one first copies its whole array back into separate textures. Textures used in the previous frame get their levels
+	// back one at a time when they fit. Call once per frame after the loader update.
+	static void updateResidency(unsigned int frameIndex);
+	static size_t getTotalResidentSize();
 
-	static const Texture* sDefaultTexture;
+	// Copies fully resident textures of the same format, size and mip count into shared texture arrays, so
+	// materials using them bind the same objects. Call every frame the loader is idle, it only packs once
+	// textures were uploaded or unpacked and updateResidency() stopped changing levels. Returns the number of textures packed.
+	static unsigned int packArrays();
+
+	static TextureHandle sDefaultTexture;
 
 private:
 	GLuint mId;
+	// Normalized path including the base path
 	std::string mName;
+	TextureType mType;
+	// Key of the file in the loader's index of contents, 0 when not indexed
+	unsigned long long mContentKey;
+	// Texture of an earlier file with the same contents, shown instead of this one
+	Texture* mpSource;
+	unsigned int mRefCount;
+	GLenum mInternalFormat;
+	unsigned int mWidth;
+	unsigned int mHeight;
+	GLint mLayer;
+	TextureArray* mpArray;
+	// Sizes of the full chain, empty until the first upload
+	std::vector<size_t> mLevelSizes;
+	// First level currently in GPU memory, and the one it will be once the pending load lands
+	unsigned int mResidentLevel;
+	unsigned int mRequestedLevel;
+	bool mLoading;
+	mutable unsigned int mLastUsedFrame;
 
+	// Textures by normalized path and type
 	static std::unordered_map<std::string, Texture> sTextureMap;
 	static std::string sBasePath;
+	static TextureLoader sLoader;
+	static size_t sMemoryBudget;
+	static std::list<TextureArray> sTextureArrays;
+	// Set when textures were uploaded or unpacked, and when the last updateResidency() changed no levels
+	static bool sPackingNeeded;
+	static bool sResidencySettled;
+	// Paths of files that failed to load, each is reported once whatever its type or how often it is requested
+	static std::unordered_set<std::string> sFailedPaths;
 
+	size_t getChainSize(unsigned int firstLevel) const;
+	void requestLevel(unsigned int firstLevel);
+	void create(const TextureData& textureData, unsigned int firstLevel, bool fromPixelBuffer);
+	// Reports the file the first time it fails
+	void onLoadFailed();
+	bool shareWith(const std::string& sourcePath);
+	static Texture* find(const char* textureName);
+	static Texture* acquire(const std::string& fileName, TextureType type, bool& created);
+	static void collectUnused();
 	static void unload(const Texture& texture);
+	static void unpackArray(TextureArray* pArray);
+	static void destroyArray(TextureArray* pArray);
+
+	friend class TextureLoader;
+	friend class TextureHandle;
+};
+
+// Counted reference to a cached texture. Only used from the thread owning the GL context.
+class TextureHandle
+{
+public:
+	TextureHandle() :
+		mpTexture(nullptr)
+	{
+	}
+
+	explicit TextureHandle(Texture* pTexture) :
+		mpTexture(pTexture)
+	{
+		addRef();
+	}
+
+	TextureHandle(const TextureHandle& rhs) :
+		mpTexture(rhs.mpTexture)
+	{
+		addRef();
+	}
+
+	~TextureHandle()
+	{
+		release();
+	}
+
+	TextureHandle& operator=(const TextureHandle& rhs)
+	{
+		if (mpTexture != rhs.mpTexture) {
+			release();
+			mpTexture = rhs.mpTexture;
+			addRef();
+		}
+		return *this;
+	}
+
+	void reset()
+	{
+		release();
+		mpTexture = nullptr;
+	}
+
+	bool isValid() const { return mpTexture != nullptr; }
+	const Texture* get() const { return mpTexture; }
+	const Texture* operator->() const { assert(mpTexture); return mpTexture; }
+	const Texture& operator*() const { assert(mpTexture); return *mpTexture; }
+
+private:
+	Texture* mpTexture;
+
+	void addRef()
+	{
+		if (mpTexture) {
+			++mpTexture->mRefCount;
+		}
+	}
+
+	// Unreferenced textures are destroyed by Texture::updateResidency, not here, since one may still be loading
+	void release()
+	{
+		if (mpTexture) {
+			assert(mpTexture->mRefCount > 0);
+			--mpTexture->mRefCount;
+		}
+	}
 };
 
@@ -0,0 +1,297 @@
+#include "TextureCompressor.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "TextureData.h"
+#include "JobPool.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TEXTURE_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// Endpoint selection follows van Waveren, "Real-Time DXT Compression": the color bounding box inset by
+// 1/16th of its extent, with every texel then mapped to the nearest palette entry.
+
+// Levels with fewer blocks than this are not worth a thread each
+const unsigned int kMinBlocksPerThread = 256;
+
+static void fetchBlock(const unsigned char* pRGBA, unsigned int width, unsigned int height, unsigned int blockX,
+					   unsigned int blockY, unsigned char* pBlock)
+{
+	// Texels past the edge of small levels replicate the last row and column
+	for (unsigned int y=0; y < 4; ++y) {
+		const unsigned int sourceY = std::min(blockY * 4 + y, height - 1);
+		for (unsigned int x=0; x < 4; ++x) {
+			const unsigned int sourceX = std::min(blockX * 4 + x, width - 1);
+			memcpy(pBlock + (y * 4 + x) * 4, pRGBA + (sourceY * width + sourceX) * 4, 4);
+		}
+	}
+}
+
+static void getColorBounds(const unsigned char* pBlock, unsigned char* pMinColor, unsigned char* pMaxColor)
+{
+#if defined(TEXTURE_COMPRESSOR_SSE2)
+	const __m128i* const pRows = reinterpret_cast<const __m128i*>(pBlock);
+	const __m128i row0 = _mm_loadu_si128(pRows), row1 = _mm_loadu_si128(pRows + 1);
+	const __m128i row2 = _mm_loadu_si128(pRows + 2), row3 = _mm_loadu_si128(pRows + 3);
+	__m128i minColor = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	__m128i maxColor = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+	minColor = _mm_min_epu8(minColor, _mm_shuffle_epi32(minColor, _MM_SHUFFLE(2, 3, 0, 1)));
+	minColor = _mm_min_epu8(minColor, _mm_shuffle_epi32(minColor, _MM_SHUFFLE(1, 0, 3, 2)));
+	maxColor = _mm_max_epu8(maxColor, _mm_shuffle_epi32(maxColor, _MM_SHUFFLE(2, 3, 0, 1)));
+	maxColor = _mm_max_epu8(maxColor, _mm_shuffle_epi32(maxColor, _MM_SHUFFLE(1, 0, 3, 2)));
+	const int minPacked = _mm_cvtsi128_si32(minColor);
+	const int maxPacked = _mm_cvtsi128_si32(maxColor);
+	memcpy(pMinColor, &minPacked, 4);
+	memcpy(pMaxColor, &maxPacked, 4);
+#else
+	memcpy(pMinColor, pBlock, 4);
+	memcpy(pMaxColor, pBlock, 4);
+	for (unsigned int i=1; i < 16; ++i) {
+		for (unsigned int c=0; c < 4; ++c) {
+			pMinColor[c] = std::min(pMinColor[c], pBlock[i * 4 + c]);
+			pMaxColor[c] = std::max(pMaxColor[c], pBlock[i * 4 + c]);
+		}
+	}
+#endif
+}
+
+static unsigned short packColor565(const unsigned char* pColor)
+{
+	return static_cast<unsigned short>(((pColor[0] >> 3) << 11) | ((pColor[1] >> 2) << 5) | (pColor[2] >> 3));
+}
+
+static void unpackColor565(unsigned short packed, unsigned char* pColor)
+{
+	const unsigned int r = (packed >> 11) & 0x1F, g = (packed >> 5) & 0x3F, b = packed & 0x1F;
+	pColor[0] = static_cast<unsigned char>((r << 3) | (r >> 2));
+	pColor[1] = static_cast<unsigned char>((g << 2) | (g >> 4));
+	pColor[2] = static_cast<unsigned char>((b << 3) | (b >> 2));
+	pColor[3] = 0;
+}
+
+// Writes the nearest palette index (0-3) of each of the 16 texels, ignoring alpha
+static void selectColorIndices(const unsigned char* pBlock, const unsigned char (*palette)[4], unsigned int* pIndices)
+{
+#if defined(TEXTURE_COMPRESSOR_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i paletteColors[4];
+	for (unsigned int i=0; i < 4; ++i) {
+		int packed;
+		memcpy(&packed, palette[i], 4);
+		paletteColors[i] = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32(packed), rgbMask), zero);
+	}
+
+	for (unsigned int row=0; row < 4; ++row) {
+		const __m128i texels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlock) + row), rgbMask);
+		const __m128i texels01 = _mm_unpacklo_epi8(texels, zero);
+		const __m128i texels23 = _mm_unpackhi_epi8(texels, zero);
+
+		__m128i bestDistance = _mm_set1_epi32(0x7FFFFFFF);
+		__m128i bestIndex = zero;
+		for (unsigned int i=0; i < 4; ++i) {
+			// Squared distances as (r*r + g*g, b*b) pairs, then summed per texel
+			const __m128i delta01 = _mm_sub_epi16(texels01, paletteColors[i]);
+			const __m128i delta23 = _mm_sub_epi16(texels23, paletteColors[i]);
+			__m128i distance01 = _mm_madd_epi16(delta01, delta01);
+			__m128i distance23 = _mm_madd_epi16(delta23, delta23);
+			distance01 = _mm_add_epi32(distance01, _mm_shuffle_epi32(distance01, _MM_SHUFFLE(2, 3, 0, 1)));
+			distance23 = _mm_add_epi32(distance23, _mm_shuffle_epi32(distance23, _MM_SHUFFLE(2, 3, 0, 1)));
+			const __m128i distance = _mm_unpacklo_epi64(_mm_shuffle_epi32(distance01, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_epi32(distance23, _MM_SHUFFLE(2, 0, 2, 0)));
+
+			const __m128i closer = _mm_cmplt_epi32(distance, bestDistance);
+			bestDistance = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, bestDistance));
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pIndices + row * 4), bestIndex);
+	}
+#else
+	for (unsigned int t=0; t < 16; ++t) {
+		int bestDistance = 0x7FFFFFFF;
+		for (unsigned int i=0; i < 4; ++i) {
+			int distance = 0;
+			for (unsigned int c=0; c < 3; ++c) {
+				const int delta = static_cast<int>(pBlock[t * 4 + c]) - palette[i][c];
+				distance += delta * delta;
+			}
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				pIndices[t] = i;
+			}
+		}
+	}
+#endif
+}
+
+static void encodeColorBlock(const unsigned char* pBlock, unsigned char* pOut)
+{
+	unsigned char minColor[4], maxColor[4];
+	getColorBounds(pBlock, minColor, maxColor);
+	for (unsigned int c=0; c < 3; ++c) {
+		const unsigned char inset = static_cast<unsigned char>((maxColor[c] - minColor[c]) >> 4);
+		minColor[c] = static_cast<unsigned char>(std::min(255, minColor[c] + inset));
+		maxColor[c] = static_cast<unsigned char>(std::max(0, maxColor[c] - inset));
+	}
+
+	unsigned short color0 = packColor565(maxColor);
+	unsigned short color1 = packColor565(minColor);
+	unsigned int indices = 0;
+	if (color0 != color1) {
+		// color0 > color1 selects the opaque four color mode
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+		unsigned char palette[4][4];
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		for (unsigned int c=0; c < 3; ++c) {
+			palette[2][c] = static_cast<unsigned char>((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = static_cast<unsigned char>((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		palette[2][3] = palette[3][3] = 0;
+
+		unsigned int texelIndices[16];
+		selectColorIndices(pBlock, palette, texelIndices);
+		for (unsigned int t=0; t < 16; ++t) {
+			indices |= texelIndices[t] << (t * 2);
+		}
+	}
+
+	memcpy(pOut, &color0, 2);
+	memcpy(pOut + 2, &color1, 2);
+	memcpy(pOut + 4, &indices, 4);
+}
+
+// BC4 block for one 8-bit channel of the 16 texels
+static void encodeChannelBlock(const unsigned char* pBlock, unsigned int channel, unsigned char* pOut)
+{
+	unsigned char minValue = 255, maxValue = 0;
+	for (unsigned int t=0; t < 16; ++t) {
+		minValue = std::min(minValue, pBlock[t * 4 + channel]);
+		maxValue = std::max(maxValue, pBlock[t * 4 + channel]);
+	}
+
+	unsigned long long indices = 0;
+	if (minValue != maxValue) {
+		// value0 > value1 selects the eight value mode
+		int palette[8];
+		palette[0] = maxValue;
+		palette[1] = minValue;
+		for (int i=2; i < 8; ++i) {
+			palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+		}
+
+		for (unsigned int t=0; t < 16; ++t) {
+			const int value = pBlock[t * 4 + channel];
+			unsigned long long bestIndex = 0;
+			int bestDistance = 256;
+			for (unsigned int i=0; i < 8; ++i) {
+				const int distance = abs(value - palette[i]);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					bestIndex = i;
+				}
+			}
+			indices |= bestIndex << (t * 3);
+		}
+	}
+
+	pOut[0] = maxValue;
+	pOut[1] = minValue;
+	for (unsigned int i=0; i < 6; ++i) {
+		pOut[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+	}
+}
+
+static void encodeBlock(const unsigned char* pBlock, BlockFormat format, unsigned char* pOut)
+{
+	switch (format) {
+		case BlockFormat::BC1:
+			encodeColorBlock(pBlock, pOut);
+			break;
+		case BlockFormat::BC3:
+			encodeChannelBlock(pBlock, 3, pOut);
+			encodeColorBlock(pBlock, pOut + 8);
+			break;
+		case BlockFormat::BC4:
+			encodeChannelBlock(pBlock, 0, pOut);
+			break;
+		case BlockFormat::BC5:
+			encodeChannelBlock(pBlock, 0, pOut);
+			encodeChannelBlock(pBlock, 1, pOut + 8);
+			break;
+	}
+}
+
+static void compressBlockRows(const unsigned char* pRGBA, unsigned int width, unsigned int height, BlockFormat format,
+							  unsigned int firstRow, unsigned int endRow, unsigned char* pOut)
+{
+	const unsigned int blocksX = (width + 3) / 4;
+	const unsigned int blockSize = TextureCompressor::getBlockSize(format);
+	unsigned char block[64];
+	for (unsigned int blockY=firstRow; blockY < endRow; ++blockY) {
+		unsigned char* pRowOut = pOut + blockY * blocksX * blockSize;
+		for (unsigned int blockX=0; blockX < blocksX; ++blockX) {
+			fetchBlock(pRGBA, width, height, blockX, blockY, block);
+			encodeBlock(block, format, pRowOut + blockX * blockSize);
+		}
+	}
+}
+
+void TextureCompressor::compressLevel(const unsigned char* pRGBA, unsigned int width, unsigned int height, BlockFormat format,
+									  std::vector<unsigned char>& result)
+{
+	assert(pRGBA && width && height);
+	const unsigned int blocksX = (width + 3) / 4;
+	const unsigned int blocksY = (height + 3) / 4;
+	result.resize(getCompressedSize(width, height, format));
+
+	// Rows of blocks per thread so that each gets at least kMinBlocksPerThread
+	unsigned char* const pOut = &result[0];
+	JobPool::getShared().parallelFor(blocksY, (kMinBlocksPerThread + blocksX - 1) / blocksX, [&](unsigned int firstRow, unsigned int endRow) {
+		compressBlockRows(pRGBA, width, height, format, firstRow, endRow, pOut);
+	});
+}
+
+void TextureCompressor::compress(const TextureData& source, BlockFormat format, TextureData& result)
+{
+	assert(!source.isCompressed());
+	result.InternalFormat = getGLFormat(format);
+	result.Levels.resize(source.Levels.size());
+	for (size_t i=0; i < source.Levels.size(); ++i) {
+		const MipLevel& sourceLevel = source.Levels[i];
+		MipLevel& level = result.Levels[i];
+		level.Width = sourceLevel.Width;
+		level.Height = sourceLevel.Height;
+		compressLevel(&sourceLevel.Data[0], level.Width, level.Height, format, level.Data);
+	}
+}
+
+GLenum TextureCompressor::getGLFormat(BlockFormat format)
+{
+	switch (format) {
+		case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+		case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	}
+	return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+unsigned int TextureCompressor::getBlockSize(BlockFormat format)
+{
+	return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t TextureCompressor::getCompressedSize(unsigned int width, unsigned int height, BlockFormat format)
+{
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+bool TextureCompressor::isSupported()
+{
+	return GLEW_EXT_texture_compression_s3tc && (GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc);
+}
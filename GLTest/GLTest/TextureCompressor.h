@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+struct TextureData;
+
+enum class BlockFormat
+{
+	BC1,	// RGB, 4 bits per pixel
+	BC3,	// RGBA, 8 bits per pixel
+	BC4,	// Single channel, 4 bits per pixel
+	BC5		// Two channels, 8 bits per pixel, used for tangent-space normal maps
+};
+
+// CPU block compressor for S3TC/RGTC formats. Blocks are encoded with SSE2 where available and
+// block rows are spread over the shared JobPool.
+class TextureCompressor
+{
+public:
+	// Compresses every level of an RGBA8 mip chain
+	static void compress(const TextureData& source, BlockFormat format, TextureData& result);
+	static void compressLevel(const unsigned char* pRGBA, unsigned int width, unsigned int height, BlockFormat format,
+		std::vector<unsigned char>& result);
+
+	static GLenum getGLFormat(BlockFormat format);
+	static unsigned int getBlockSize(BlockFormat format);
+	static size_t getCompressedSize(unsigned int width, unsigned int height, BlockFormat format);
+	static bool isSupported();
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+// CPU-side image with its full mip chain, either raw RGBA8 or block-compressed
+
+struct MipLevel
+{
+public:
+	MipLevel() :
+		Width(0), Height(0)
+	{
+	}
+
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<unsigned char> Data;
+};
+
+struct TextureData
+{
+public:
+	TextureData() :
+		InternalFormat(GL_RGBA8)
+	{
+	}
+
+	bool isCompressed() const { return InternalFormat != GL_RGBA8; }
+	unsigned int getWidth() const { return Levels.empty() ? 0 : Levels[0].Width; }
+	unsigned int getHeight() const { return Levels.empty() ? 0 : Levels[0].Height; }
+
+	size_t getSize() const
+	{
+		size_t size = 0;
+		for (const MipLevel& level : Levels) {
+			size += level.Data.size();
+		}
+		return size;
+	}
+
+	static unsigned int getMipLevelCount(unsigned int width, unsigned int height)
+	{
+		unsigned int count = 1;
+		while (width > 1 || height > 1) {
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			++count;
+		}
+		return count;
+	}
+
+	GLenum InternalFormat;
+	std::vector<MipLevel> Levels;
+};
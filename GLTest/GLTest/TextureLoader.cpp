@@ -0,0 +1,416 @@
+#include "TextureLoader.h"
+#include <FreeImage.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "Texture.h"
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "MappedFile.h"
+#include "JobPool.h"
+#include "DDSFile.h"
+#include "GLState.h"
+
+const size_t TextureLoader::kDefaultUploadBudget = 8 * 1024 * 1024;
+
+const unsigned long long kFNVOffsetBasis = 14695981039346656037ULL;
+const unsigned long long kFNVPrime = 1099511628211ULL;
+
+// FNV-1a
+static unsigned long long hashBytes(const void* pData, size_t size, unsigned long long hash)
+{
+	const unsigned char* const pBytes = static_cast<const unsigned char*>(pData);
+	for (size_t i=0; i < size; ++i) {
+		hash = (hash ^ pBytes[i]) * kFNVPrime;
+	}
+	return hash;
+}
+
+// Hash of the file contents and the type, since the type decides the compressed format
+static unsigned long long computeContentKey(const MappedFile& file, TextureType type)
+{
+	const unsigned long long key = hashBytes(file.getData(), file.getSize(), kFNVOffsetBasis);
+	const int typeValue = static_cast<int>(type);
+	return hashBytes(&typeValue, sizeof(typeValue), key);
+}
+
+static bool hasSameContents(const MappedFile& file, const std::string& otherPath)
+{
+	MappedFile otherFile;
+	return otherFile.open(otherPath) && otherFile.getSize() == file.getSize() &&
+		memcmp(otherFile.getData(), file.getData(), file.getSize()) == 0;
+}
+
+// Decodes any FreeImage-supported file into a single RGBA8 level, rows bottom to top as GL expects
+static bool loadImage(const std::string& path, TextureData& texture)
+{
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(path.c_str(), 0);
+	if (fif == FIF_UNKNOWN) {
+		fif = FreeImage_GetFIFFromFilename(path.c_str());
+	}
+	if (fif == FIF_UNKNOWN) {
+		return false;
+	}
+
+	FIBITMAP* dib = nullptr;
+	if (FreeImage_FIFSupportsReading(fif)) {
+		dib = FreeImage_Load(fif, path.c_str());
+	}
+	if (!dib) {
+		return false;
+	}
+
+	FIBITMAP* const dib32 = FreeImage_ConvertTo32Bits(dib);
+	FreeImage_Unload(dib);
+	if (!dib32) {
+		return false;
+	}
+
+	const BYTE* const bits = FreeImage_GetBits(dib32);
+	const unsigned int width = FreeImage_GetWidth(dib32);
+	const unsigned int height = FreeImage_GetHeight(dib32);
+	const unsigned int pitch = FreeImage_GetPitch(dib32);
+	if (bits == 0 || width == 0 || height == 0) {
+		FreeImage_Unload(dib32);
+		return false;
+	}
+
+	texture.InternalFormat = GL_RGBA8;
+	texture.Levels.resize(1);
+	MipLevel& level = texture.Levels[0];
+	level.Width = width;
+	level.Height = height;
+	level.Data.resize(width * height * 4);
+	for (unsigned int y=0; y < height; ++y) {
+		const BYTE* pSource = bits + y * pitch;
+		unsigned char* pDest = &level.Data[y * width * 4];
+		for (unsigned int x=0; x < width; ++x, pSource += 4, pDest += 4) {
+			pDest[0] = pSource[FI_RGBA_RED];
+			pDest[1] = pSource[FI_RGBA_GREEN];
+			pDest[2] = pSource[FI_RGBA_BLUE];
+			pDest[3] = pSource[FI_RGBA_ALPHA];
+		}
+	}
+
+	FreeImage_Unload(dib32);
+	return true;
+}
+
+static MipFilter selectMipFilter(TextureType type)
+{
+	// Only color maps are sRGB encoded
+	return type == TextureType::DIFFUSE_MAP ? MipFilter::GAMMA_CORRECT : MipFilter::KAISER;
+}
+
+static bool hasTransparency(const TextureData& texture)
+{
+	const std::vector<unsigned char>& data = texture.Levels[0].Data;
+	for (size_t i=3; i < data.size(); i += 4) {
+		if (data[i] != 255) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static BlockFormat selectBlockFormat(TextureType type, const TextureData& texture)
+{
+	switch (type) {
+		case TextureType::NORMAL_MAP: return BlockFormat::BC5;
+		case TextureType::SPECULAR_MAP: return BlockFormat::BC4;
+		default: return hasTransparency(texture) ? BlockFormat::BC3 : BlockFormat::BC1;
+	}
+}
+
+// The cache is stale when the source image was modified after it
+static bool isCacheValid(const std::string& sourcePath, const std::string& cachePath)
+{
+	struct stat sourceStat, cacheStat;
+	if (stat(cachePath.c_str(), &cacheStat) != 0) {
+		return false;
+	}
+	return stat(sourcePath.c_str(), &sourceStat) != 0 || cacheStat.st_mtime >= sourceStat.st_mtime;
+}
+
+// Bump when the mip filters or the block encoder change, so caches built by older versions get rebuilt
+const unsigned int kCacheVersion = 2;
+
+// Identifies what a cache was built with: the cache version, the texture type and the mip filter it selects
+static unsigned int getCacheTag(TextureType type)
+{
+	return (kCacheVersion << 16) | (static_cast<unsigned int>(type) << 8) | static_cast<unsigned int>(selectMipFilter(type));
+}
+
+// Loads the compressed mip chain from the DDS cache next to the source image, building it first when needed
+static bool loadCompressed(const std::string& path, TextureType type, TextureData& texture)
+{
+	const std::string cachePath = path + ".dds";
+	unsigned int cacheTag = 0;
+	if (isCacheValid(path, cachePath) && DDSFile::load(cachePath, texture, cacheTag) && cacheTag == getCacheTag(type)) {
+		return true;
+	}
+	texture.Levels.clear();
+
+	TextureData image;
+	if (!loadImage(path, image)) {
+		return false;
+	}
+	MipGenerator::generate(image, selectMipFilter(type));
+	TextureCompressor::compress(image, selectBlockFormat(type, image), texture);
+	if (!DDSFile::save(cachePath, texture, getCacheTag(type))) {
+		fprintf(stderr, "Error writing texture cache: %s\n", cachePath.c_str());
+	}
+	return true;
+}
+
+TextureLoader::TextureLoader() :
+	mJobsInFlight(0),
+	mCompress(false),
+	mStopping(false),
+	mPixelBuffer(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	assert(mThreads.empty());
+}
+
+void TextureLoader::start(unsigned int threadCount)
+{
+	assert(mThreads.empty() && threadCount > 0);
+	mCompress = TextureCompressor::isSupported();
+	glGenBuffers(1, &mPixelBuffer);
+	for (unsigned int i=0; i < threadCount; ++i) {
+		mThreads.push_back(std::thread(&TextureLoader::workerMain, this));
+	}
+}
+
+void TextureLoader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mJobAvailable.notify_all();
+	for (std::thread& thread : mThreads) {
+		thread.join();
+	}
+	mThreads.clear();
+
+	for (Job* pJob : mPendingJobs) {
+		delete pJob;
+	}
+	for (Job* pJob : mFinishedJobs) {
+		delete pJob;
+	}
+	mPendingJobs.clear();
+	mFinishedJobs.clear();
+	mJobsInFlight = 0;
+	mStopping = false;
+
+	if (mPixelBuffer) {
+		glDeleteBuffers(1, &mPixelBuffer);
+		GLState::forgetBuffer(mPixelBuffer);
+		mPixelBuffer = 0;
+	}
+}
+
+void TextureLoader::request(Texture* pTexture, const std::string& path, TextureType type, unsigned int firstLevel)
+{
+	assert(pTexture);
+	Job* const pJob = new Job();
+	pJob->pTexture = pTexture;
+	pJob->Path = path;
+	pJob->Type = type;
+	pJob->FirstLevel = firstLevel;
+	pJob->Deduplicate = pTexture->mLevelSizes.empty();
+	pJob->ContentKey = 0;
+	pJob->Succeeded = false;
+
+	if (mThreads.empty()) {
+		// Not started, load right away
+		process(*pJob, TextureCompressor::isSupported());
+		upload(*pJob);
+		delete pJob;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPendingJobs.push_back(pJob);
+		++mJobsInFlight;
+	}
+	mJobAvailable.notify_one();
+}
+
+void TextureLoader::update(size_t uploadBudget)
+{
+	size_t uploadedSize = 0;
+	while (uploadedSize < uploadBudget) {
+		Job* pJob = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFinishedJobs.empty()) {
+				break;
+			}
+			pJob = mFinishedJobs.front();
+			mFinishedJobs.pop_front();
+		}
+
+		upload(*pJob);
+		uploadedSize += pJob->Data.getSize();
+		delete pJob;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		--mJobsInFlight;
+	}
+}
+
+bool TextureLoader::isIdle() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mJobsInFlight == 0;
+}
+
+bool TextureLoader::decode(const std::string& path, TextureType type, bool compress, TextureData& texture)
+{
+	if (compress) {
+		return loadCompressed(path, type, texture);
+	}
+	if (!loadImage(path, texture)) {
+		return false;
+	}
+	MipGenerator::generate(texture, selectMipFilter(type));
+	return true;
+}
+
+std::string TextureLoader::findDuplicate(const std::string& path, TextureType type, unsigned long long& contentKey)
+{
+	MappedFile file;
+	if (!file.open(path)) {
+		contentKey = 0;
+		return std::string();
+	}
+	contentKey = computeContentKey(file, type);
+
+	// The comparisons read whole files, so they run on a copy of the candidates
+	std::vector<std::string> candidates;
+	{
+		std::lock_guard<std::mutex> lock(mContentMutex);
+		const auto& range = mContentPaths.equal_range(contentKey);
+		for (auto it = range.first; it != range.second; ++it) {
+			candidates.push_back(it->second);
+		}
+	}
+	for (const std::string& candidate : candidates) {
+		if (candidate != path && hasSameContents(file, candidate)) {
+			return candidate;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	mContentPaths.insert(std::make_pair(contentKey, path));
+	return std::string();
+}
+
+void TextureLoader::forgetContent(unsigned long long contentKey, const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mContentMutex);
+	const auto& range = mContentPaths.equal_range(contentKey);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == path) {
+			mContentPaths.erase(it);
+			return;
+		}
+	}
+}
+
+// Hashes the file of a first load before decoding it, a duplicate of a loaded file is not decoded at all
+void TextureLoader::process(Job& job, bool compress)
+{
+	if (job.Deduplicate) {
+		job.DuplicatePath = findDuplicate(job.Path, job.Type, job.ContentKey);
+	}
+	job.Succeeded = !job.DuplicatePath.empty() || decode(job.Path, job.Type, compress, job.Data);
+}
+
+void TextureLoader::workerMain()
+{
+	// The loader threads already cover the cores, so each one compresses and filters its own texture single-threaded
+	JobPool::markWorkerThread();
+	for (;;) {
+		Job* pJob = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (!mStopping && mPendingJobs.empty()) {
+				mJobAvailable.wait(lock);
+			}
+			if (mStopping) {
+				return;
+			}
+			pJob = mPendingJobs.front();
+			mPendingJobs.pop_front();
+		}
+
+		process(*pJob, mCompress);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFinishedJobs.push_back(pJob);
+	}
+}
+
+void TextureLoader::upload(Job& job)
+{
+	if (!job.DuplicatePath.empty()) {
+		if (!job.pTexture->shareWith(job.DuplicatePath)) {
+			// The other file was unloaded in the meantime, which also dropped it from the index
+			job.pTexture->mLoading = false;
+			job.pTexture->requestLevel(job.FirstLevel);
+		}
+		return;
+	}
+
+	if (job.Deduplicate) {
+		job.pTexture->mContentKey = job.ContentKey;
+	}
+	if (!job.Succeeded) {
+		job.pTexture->onLoadFailed();
+		return;
+	}
+
+	// The source may have been rebuilt with fewer levels since the request
+	const unsigned int firstLevel = std::min(job.FirstLevel, static_cast<unsigned int>(job.Data.Levels.size() - 1));
+
+	if (!mPixelBuffer) {
+		job.pTexture->create(job.Data, firstLevel, false);
+		return;
+	}
+
+	// The copy into the PBO returns immediately, the texture transfer itself is done by the driver
+	size_t size = 0;
+	for (size_t i=firstLevel; i < job.Data.Levels.size(); ++i) {
+		size += job.Data.Levels[i].Data.size();
+	}
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, mPixelBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	unsigned char* const pMapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if (pMapped) {
+		size_t offset = 0;
+		for (size_t i=firstLevel; i < job.Data.Levels.size(); ++i) {
+			const MipLevel& level = job.Data.Levels[i];
+			memcpy(pMapped + offset, &level.Data[0], level.Data.size());
+			offset += level.Data.size();
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		job.pTexture->create(job.Data, firstLevel, true);
+	}
+	else {
+		GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		job.pTexture->create(job.Data, firstLevel, false);
+	}
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+#include "TextureData.h"
+
+enum class TextureType;
+class Texture;
+
+// Decodes textures on a pool of worker threads and uploads the results from the main thread through
+// pixel buffer objects, a bounded number of bytes per frame
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	void start(unsigned int threadCount);
+	void stop();
+
+	// The texture keeps showing its placeholder, or its current levels, until update() uploads the chain
+	// from firstLevel on
+	void request(Texture* pTexture, const std::string& path, TextureType type, unsigned int firstLevel = 0);
+	// Uploads finished textures, at least one per call. Must be called from the thread owning the GL context.
+	void update(size_t uploadBudget);
+	bool isIdle() const;
+
+	// Loads the compressed mip chain or, when compression is unsupported, the RGBA8 mip chain of an image.
+	// Safe to call from any thread.
+	static bool decode(const std::string& path, TextureType type, bool compress, TextureData& texture);
+
+	// Returns an earlier file with the same contents and type, or an empty string after recording path as the
+	// first one. Hashes are confirmed by comparing the files. contentKey receives the key to pass to forgetContent()
+	// when the texture goes away, 0 when the file cannot be read. Safe to call from any thread.
+	std::string findDuplicate(const std::string& path, TextureType type, unsigned long long& contentKey);
+	void forgetContent(unsigned long long contentKey, const std::string& path);
+
+	static const size_t kDefaultUploadBudget;
+
+private:
+	struct Job
+	{
+		Texture* pTexture;
+		std::string Path;
+		TextureType Type;
+		unsigned int FirstLevel;
+		// Set for the first load of a texture, DuplicatePath then names the file it can share instead
+		bool Deduplicate;
+		unsigned long long ContentKey;
+		std::string DuplicatePath;
+		TextureData Data;
+		bool Succeeded;
+	};
+
+	std::vector<std::thread> mThreads;
+	std::deque<Job*> mPendingJobs;
+	std::deque<Job*> mFinishedJobs;
+	mutable std::mutex mMutex;
+	std::condition_variable mJobAvailable;
+	unsigned int mJobsInFlight;
+	bool mCompress;
+	bool mStopping;
+
+	// Files by content key, the first one with a given content that is still loaded
+	std::unordered_multimap<unsigned long long, std::string> mContentPaths;
+	std::mutex mContentMutex;
+
+	// Orphaned and refilled for every upload so the driver can keep earlier transfers in flight
+	GLuint mPixelBuffer;
+
+	void workerMain();
+	void process(Job& job, bool compress);
+	void upload(Job& job);
+
+	TextureLoader(const TextureLoader& rhs);
+	TextureLoader& operator=(const TextureLoader& rhs);
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+// Binding points match the glUniformBlockBinding calls made after linking
+enum class UniformBlock
+{
+	FRAME = 0,
+	DRAW = 1,
+	INSTANCE = 2
+};
+
+// std140 mirror of the FrameData block in basic.vert and basic.frag, written once per frame
+struct FrameUniforms
+{
+	glm::mat4 ViewProjectionMatrix;
+	glm::vec4 CameraPosition;		// w unused
+	glm::vec4 LightDirection;		// Towards the light, w unused
+	float Time;
+	float Padding[3];
+};
+
+// std140 mirror of the DrawData block, written for every draw. With multi-draw the same bytes are read as
+// RGBA32F texels from a buffer texture, see loadDrawData in basic.vert.
+struct DrawUniforms
+{
+	glm::mat4 WorldMatrix;
+	glm::mat4 WVPMatrix;
+	glm::vec4 PositionOffset;		// w unused
+	glm::vec4 PositionScale;		// w unused
+	glm::vec4 TexCoordTransform;	// xy offset, zw scale
+	int DiffuseLayer;
+	int NormalLayer;
+	int SpecularLayer;
+	int OctahedralNormals;
+};
+
+// std140 mirror of the InstanceData block. Instanced draws fill one world matrix per instance and leave
+// the DrawUniforms world matrix at identity, every other draw uses an identity block shared for the frame.
+struct InstanceUniforms
+{
+	static const unsigned int kMaxInstances = 32;
+	glm::mat4 WorldMatrices[kMaxInstances];
+};
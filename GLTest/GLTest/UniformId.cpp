@@ -0,0 +1,53 @@
+#include "UniformId.h"
+#include <assert.h>
+#include <vector>
+#include <unordered_map>
+
+struct UniformRegistry
+{
+	std::unordered_map<std::string, unsigned int> Indices;
+	std::vector<std::string> Names;
+};
+
+// Constructed on first use since ids are interned during static initialization of other files
+static UniformRegistry& getRegistry()
+{
+	static UniformRegistry registry;
+	return registry;
+}
+
+UniformId::UniformId(const char* name) :
+	mIndex(intern(name))
+{
+}
+
+UniformId::UniformId(const std::string& name) :
+	mIndex(intern(name))
+{
+}
+
+const std::string& UniformId::getName() const
+{
+	const UniformRegistry& registry = getRegistry();
+	assert(mIndex < registry.Names.size());
+	return registry.Names[mIndex];
+}
+
+unsigned int UniformId::getCount()
+{
+	return static_cast<unsigned int>(getRegistry().Names.size());
+}
+
+unsigned int UniformId::intern(const std::string& name)
+{
+	assert(!name.empty());
+	UniformRegistry& registry = getRegistry();
+	const auto& it = registry.Indices.find(name);
+	if (it != registry.Indices.end()) {
+		return it->second;
+	}
+	const unsigned int index = static_cast<unsigned int>(registry.Names.size());
+	registry.Indices[name] = index;
+	registry.Names.push_back(name);
+	return index;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+// Uniform name interned to a small index. Declare ids once, e.g. as file-scope constants, so the per-draw
+// path looks locations up by index instead of hashing strings in the driver.
+class UniformId
+{
+public:
+	explicit UniformId(const char* name);
+	explicit UniformId(const std::string& name);
+
+	unsigned int getIndex() const { return mIndex; }
+	const std::string& getName() const;
+
+	bool operator==(const UniformId& rhs) const { return mIndex == rhs.mIndex; }
+	bool operator!=(const UniformId& rhs) const { return mIndex != rhs.mIndex; }
+
+	// Number of names interned so far
+	static unsigned int getCount();
+
+private:
+	unsigned int mIndex;
+
+	static unsigned int intern(const std::string& name);
+};
@@ -0,0 +1,122 @@
+#include "UniformRing.h"
+#include <assert.h>
+#include <string.h>
+#include "GLState.h"
+
+// One second, in nanoseconds
+const GLuint64 kFenceTimeout = 1000000000;
+
+UniformRing::UniformRing() :
+	mBuffer(0),
+	mpMappedData(nullptr),
+	mRegionSize(0),
+	mAlignment(256),
+	mRegion(0),
+	mRegionOffset(0)
+{
+	for (unsigned int i=0; i < kRegionCount; ++i) {
+		mFences[i] = 0;
+	}
+}
+
+UniformRing::~UniformRing()
+{
+	assert(!mBuffer);
+}
+
+bool UniformRing::create(GLsizeiptr regionSize, GLint alignment)
+{
+	assert(!mBuffer && regionSize > 0 && alignment >= 0);
+	mAlignment = alignment;
+	if (!mAlignment) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &mAlignment);
+	}
+	mRegionSize = (regionSize + mAlignment - 1) / mAlignment * mAlignment;
+	const GLsizeiptr size = mRegionSize * kRegionCount;
+
+	glGenBuffers(1, &mBuffer);
+	if (!mBuffer) {
+		return false;
+	}
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+	if (GLEW_ARB_buffer_storage) {
+		const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		// Dynamic storage keeps glBufferSubData available in case mapping fails
+		glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT);
+		mpMappedData = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, mapFlags));
+	}
+	else {
+		glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+	return true;
+}
+
+void UniformRing::destroy()
+{
+	for (unsigned int i=0; i < kRegionCount; ++i) {
+		if (mFences[i]) {
+			glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+	}
+	if (mBuffer) {
+		if (mpMappedData) {
+			GLState::bindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+			mpMappedData = nullptr;
+		}
+		glDeleteBuffers(1, &mBuffer);
+		GLState::forgetBuffer(mBuffer);
+		mBuffer = 0;
+	}
+}
+
+void UniformRing::beginFrame()
+{
+	mRegion = (mRegion + 1) % kRegionCount;
+	mRegionOffset = 0;
+	GLsync& fence = mFences[mRegion];
+	if (fence) {
+		GLenum result = GL_TIMEOUT_EXPIRED;
+		while (result == GL_TIMEOUT_EXPIRED) {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+		}
+		assert(result != GL_WAIT_FAILED);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+void UniformRing::endFrame()
+{
+	assert(!mFences[mRegion]);
+	mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr UniformRing::allocate(const void* pData, GLsizeiptr size)
+{
+	assert(mBuffer && pData);
+	if (!canAllocate(size)) {
+		assert(!"Uniform ring region is full, create it with a larger region size");
+		return -1;
+	}
+
+	const GLintptr offset = mRegion * mRegionSize + mRegionOffset;
+	if (mpMappedData) {
+		memcpy(mpMappedData + offset, pData, size);
+	}
+	else {
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, pData);
+	}
+	mRegionOffset += (size + mAlignment - 1) / mAlignment * mAlignment;
+	return offset;
+}
+
+void UniformRing::bind(GLuint binding, GLintptr offset, GLsizeiptr size) const
+{
+	assert(offset >= 0);
+	GLState::bindUniformBufferRange(binding, mBuffer, offset, size);
+}
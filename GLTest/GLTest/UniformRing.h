@@ -0,0 +1,41 @@
+#pragma once
+#include <GL/glew.h>
+
+// Uniform buffer split into one region per frame in flight. With ARB_buffer_storage it stays persistently
+// mapped and allocations are plain copies, a fence per region keeps the CPU from overwriting data the GPU
+// has not consumed yet. Otherwise every allocation is uploaded with glBufferSubData.
+// Also streams other per-draw data, the renderer keeps its indirect commands and multi-draw DrawUniforms in rings.
+class UniformRing
+{
+public:
+	UniformRing();
+	~UniformRing();
+
+	// Allocations start at multiples of alignment, 0 takes the uniform buffer offset alignment
+	bool create(GLsizeiptr regionSize, GLint alignment = 0);
+	void destroy();
+
+	// Waits until the GPU is done with the region about to be reused
+	void beginFrame();
+	void endFrame();
+
+	// Copies the data into the current region and returns its offset in the buffer, or -1 when the region is full
+	GLintptr allocate(const void* pData, GLsizeiptr size);
+	bool canAllocate(GLsizeiptr size) const { return mRegionOffset + size <= mRegionSize; }
+	void bind(GLuint binding, GLintptr offset, GLsizeiptr size) const;
+	GLuint getBuffer() const { return mBuffer; }
+
+	static const unsigned int kRegionCount = 3;
+
+private:
+	GLuint mBuffer;
+	unsigned char* mpMappedData;
+	GLsizeiptr mRegionSize;
+	GLint mAlignment;
+	unsigned int mRegion;
+	GLsizeiptr mRegionOffset;
+	GLsync mFences[kRegionCount];
+
+	UniformRing(const UniformRing& rhs);
+	UniformRing& operator=(const UniformRing& rhs);
+};
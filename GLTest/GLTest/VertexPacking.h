@@ -0,0 +1,90 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <string.h>
+#include "GPUBuffers.h"
+
+// Encoding helpers for the compact vertex format, decoded in basic.vert
+
+inline glm::vec2 encodeOctahedral(const glm::vec3& v)
+{
+	// Degenerate normals, e.g. of collapsed triangles, encode as +Z. The negated test also catches NaN.
+	const float length = glm::abs(v.x) + glm::abs(v.y) + glm::abs(v.z);
+	if (!(length > 1e-20f)) {
+		return glm::vec2(0.0f);
+	}
+	const glm::vec3 n = v / length;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return e;
+}
+
+inline glm::vec3 decodeOctahedral(const glm::vec2& e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+	const float t = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+// Handedness is +1 when the bitangent matches cross(normal, tangent)
+inline float computeHandedness(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+{
+	return glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+}
+
+inline glm::uint32 packTangent(const glm::vec3& tangent, float handedness)
+{
+	return glm::packSnorm3x10_1x2(glm::vec4(glm::normalize(tangent), handedness));
+}
+
+inline glm::uint16 quantizeUnorm16(float value, float offset, float scale)
+{
+	return glm::packUnorm1x16(scale > 0.0f ? (value - offset) / scale : 0.0f);
+}
+
+// CPU-side decode of a single vertex attribute, w is 1 when the format has no fourth component
+inline glm::vec4 decodeAttribute(const VertexAttributeFormat& format, const VertexQuantization& quantization, 
+								 const unsigned char* pSource)
+{
+	glm::vec4 value(0.0f, 0.0f, 0.0f, 1.0f);
+	switch (format.Type) {
+		case GL_FLOAT:
+			memcpy(&value.x, pSource, format.ComponentCount * sizeof(float));
+			break;
+
+		case GL_UNSIGNED_SHORT: {
+			const glm::uint16* const pQuantized = reinterpret_cast<const glm::uint16*>(pSource);
+			if (format.Attribute == VertexAttribute::POSITION) {
+				for (int c=0; c < 3; ++c) {
+					value[c] = glm::unpackUnorm1x16(pQuantized[c]) * quantization.PositionScale[c] + quantization.PositionOffset[c];
+				}
+			}
+			else {
+				for (int c=0; c < 2; ++c) {
+					value[c] = glm::unpackUnorm1x16(pQuantized[c]) * quantization.TexCoordScale[c] + quantization.TexCoordOffset[c];
+				}
+			}
+			break;
+		}
+
+		case GL_SHORT: {
+			const glm::uint16* const pEncoded = reinterpret_cast<const glm::uint16*>(pSource);
+			const glm::vec2 encoded(glm::unpackSnorm1x16(pEncoded[0]), glm::unpackSnorm1x16(pEncoded[1]));
+			value = glm::vec4(decodeOctahedral(encoded), 1.0f);
+			break;
+		}
+
+		case GL_INT_2_10_10_10_REV: {
+			glm::uint32 packed;
+			memcpy(&packed, pSource, sizeof(packed));
+			value = glm::unpackSnorm3x10_1x2(packed);
+			break;
+		}
+	}
+	return value;
+}
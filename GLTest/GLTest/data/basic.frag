@@ -4,27 +4,39 @@ in vec3 ViewDirection;
 in vec3 Tangent;
 in vec3 Bitangent;
 in vec3 Normal;
+flat in ivec3 TextureLayers;	// Diffuse, normal and specular layer
 
-uniform sampler2D DiffuseMap;
-uniform sampler2D NormalMap;
-uniform sampler2D SpecularMap;
-uniform float Time;
+// Textures are packed into arrays, TextureLayers selects the material's slices
+uniform sampler2DArray DiffuseMap;
+uniform sampler2DArray NormalMap;
+uniform sampler2DArray SpecularMap;
+
+// Must match basic.vert
+layout(std140) uniform FrameData
+{
+	mat4 ViewProjectionMatrix;
+	vec4 CameraPosition;
+	vec4 LightDirection;
+	float Time;
+};
 
 layout(location = 0) out vec4 oFragColor;
 
 void main()
 {
-	vec3 L = -normalize(vec3(cos(Time), -1.0, sin(Time)));
+	vec3 L = LightDirection.xyz;
 
 	mat3 tangentToWorldMatrix = mat3(normalize(Tangent), normalize(Bitangent), normalize(Normal));
-	vec3 N = texture(NormalMap, TexCoords).rgb;
-	N = normalize(N * 2.0 - 1.0);
+	// BC5 normal maps only store x and y
+	vec3 N;
+	N.xy = texture(NormalMap, vec3(TexCoords, TextureLayers.y)).rg * 2.0 - 1.0;
+	N.z = sqrt(max(1.0 - dot(N.xy, N.xy), 0.0));
 	N = normalize(tangentToWorldMatrix * N);
 	//vec3 N = normalize(Normal);
 
-	vec3 diffuseColor = texture(DiffuseMap, TexCoords).rgb;
+	vec3 diffuseColor = texture(DiffuseMap, vec3(TexCoords, TextureLayers.x)).rgb;
 	
-	float specularPower = texture(SpecularMap, TexCoords).r;
+	float specularPower = texture(SpecularMap, vec3(TexCoords, TextureLayers.z)).r;
 	float shininess = 4.0;
 	vec3 H = normalize(ViewDirection + L);
 	
@@ -1,36 +1,125 @@
 #version 400
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec2 aTexCoords;
-layout(location = 2) in vec3 aNormal;
-layout(location = 3) in vec3 aTangent;
-layout(location = 4) in vec3 aBitangent;
+layout(location = 2) in vec3 aNormal;		// xy holds the octahedral encoding in the compact format
+layout(location = 3) in vec4 aTangent;		// w holds the bitangent handedness
 
 out vec2 TexCoords;
 out vec3 ViewDirection;
 out vec3 Tangent;
 out vec3 Bitangent;
 out vec3 Normal;
+flat out ivec3 TextureLayers;	// Diffuse, normal and specular layer of the material's texture arrays
 
-uniform mat4 WorldMatrix;
-uniform mat4 WVPMatrix;
-uniform vec3 CameraPosition;
+// Must match FrameUniforms and DrawUniforms in UniformBlocks.h, FrameData also the declaration in basic.frag
+layout(std140) uniform FrameData
+{
+	mat4 ViewProjectionMatrix;
+	vec4 CameraPosition;
+	vec4 LightDirection;
+	float Time;
+};
+
+#if defined(MULTI_DRAW)
+// Merged geometry drawn with glMultiDrawElementsIndirect. The draw index is a per-instance attribute, the
+// base instance of every indirect command selects that draw's DrawUniforms in the buffer texture.
+layout(location = 5) in int aDrawIndex;
+uniform samplerBuffer DrawDataBuffer;
+
+mat4 WorldMatrix;
+mat4 WVPMatrix;
+vec4 PositionOffset;
+vec4 PositionScale;
+vec4 TexCoordTransform;
+int DiffuseLayer;
+int NormalLayer;
+int SpecularLayer;
+int OctahedralNormals;
+
+void loadDrawData()
+{
+	int texel = aDrawIndex * 12;
+	WorldMatrix = mat4(texelFetch(DrawDataBuffer, texel), texelFetch(DrawDataBuffer, texel + 1),
+		texelFetch(DrawDataBuffer, texel + 2), texelFetch(DrawDataBuffer, texel + 3));
+	WVPMatrix = mat4(texelFetch(DrawDataBuffer, texel + 4), texelFetch(DrawDataBuffer, texel + 5),
+		texelFetch(DrawDataBuffer, texel + 6), texelFetch(DrawDataBuffer, texel + 7));
+	PositionOffset = texelFetch(DrawDataBuffer, texel + 8);
+	PositionScale = texelFetch(DrawDataBuffer, texel + 9);
+	TexCoordTransform = texelFetch(DrawDataBuffer, texel + 10);
+	ivec4 layers = floatBitsToInt(texelFetch(DrawDataBuffer, texel + 11));
+	DiffuseLayer = layers.x;
+	NormalLayer = layers.y;
+	SpecularLayer = layers.z;
+	OctahedralNormals = layers.w;
+}
+
+// Every instance has its own DrawUniforms
+mat4 getInstanceMatrix()
+{
+	return mat4(1.0);
+}
+#else
+layout(std140) uniform DrawData
+{
+	mat4 WorldMatrix;
+	mat4 WVPMatrix;
+	vec4 PositionOffset;
+	vec4 PositionScale;
+	vec4 TexCoordTransform;		// xy offset, zw scale
+	int DiffuseLayer;
+	int NormalLayer;
+	int SpecularLayer;
+	int OctahedralNormals;
+};
+
+// Must match InstanceUniforms in UniformBlocks.h. Instanced draws leave WorldMatrix at identity and put the
+// world matrices here, other draws get an identity block.
+layout(std140) uniform InstanceData
+{
+	mat4 InstanceWorldMatrices[32];
+};
+
+void loadDrawData()
+{
+}
+
+mat4 getInstanceMatrix()
+{
+	return InstanceWorldMatrices[gl_InstanceID];
+}
+#endif
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
 
 void main()
 {
-	TexCoords = aTexCoords;
+	loadDrawData();
+	TexCoords = aTexCoords * TexCoordTransform.zw + TexCoordTransform.xy;
+	vec3 normal = OctahedralNormals != 0 ? decodeOctahedral(aNormal.xy) : aNormal;
+	vec3 tangent = aTangent.xyz;
 
 	//Tangent = aTangent;
 	//Bitangent = aBitangent;
 	//Normal = aNormal;
 
-	Tangent = normalize(vec3(WorldMatrix * vec4(aTangent, 0.0)));
-	//Bitangent = normalize(vec3(WorldMatrix * vec4(aBitangent, 0.0)));
-	Bitangent = normalize(vec3(WorldMatrix * vec4(cross(aNormal, aTangent), 0.0)));
-	Normal = normalize(vec3(WorldMatrix * vec4(aNormal, 0.0)));
+	mat4 instanceMatrix = getInstanceMatrix();
+	mat4 worldMatrix = WorldMatrix * instanceMatrix;
+	Tangent = normalize(vec3(worldMatrix * vec4(tangent, 0.0)));
+	Bitangent = normalize(vec3(worldMatrix * vec4(cross(normal, tangent) * aTangent.w, 0.0)));
+	Normal = normalize(vec3(worldMatrix * vec4(normal, 0.0)));
 	
-	vec4 posV4 = vec4(aPosition, 1.0);
+	vec4 posV4 = instanceMatrix * vec4(aPosition * PositionScale.xyz + PositionOffset.xyz, 1.0);
 	vec4 worldPos = WorldMatrix * posV4;
-	ViewDirection = normalize(CameraPosition - worldPos.xyz);
+	ViewDirection = normalize(CameraPosition.xyz - worldPos.xyz);
+
+	TextureLayers = ivec3(DiffuseLayer, NormalLayer, SpecularLayer);
 
 	gl_Position = WVPMatrix * posV4;
 }
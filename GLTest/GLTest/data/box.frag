@@ -0,0 +1,6 @@
+#version 400
+// Occlusion query boxes are drawn with color and depth writes off, only the samples passed matter
+
+void main()
+{
+}
@@ -0,0 +1,10 @@
+#version 400
+layout(location = 0) in vec3 aPosition;
+
+// Maps the unit cube [-1, 1] onto the queried bounding box in clip space
+uniform mat4 BoxMatrix;
+
+void main()
+{
+	gl_Position = BoxMatrix * vec4(aPosition, 1.0);
+}
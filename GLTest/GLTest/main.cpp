@@ -1,35 +1,79 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "GPUProgram.h"
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureLoader.h"
+#include "JobPool.h"
 #include "Material.h"
 #include "FirstPersonCamera.h"
 #include "Renderer.h"
 #include "Input.h"
+#include "SceneData.h"
+#include "SceneFile.h"
+#include "SceneGraph.h"
+#include "Frustum.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "LodSelector.h"
+#include "MeshletCuller.h"
+#include "UniformBlocks.h"
+#include "GLState.h"
 
 using glm::mat4;
 using glm::vec3;
 using glm::vec2;
 
 //#define DEBUG_DRAW
+//#define PRINT_GL_STATISTICS
+//#define PRINT_CULLING_STATISTICS
+
+// Merges static meshes into shared buffers drawn with glMultiDrawElementsIndirect, where supported
+const bool kMultiDraw = true;
+// Frustum culls through a bounding volume hierarchy over the instances instead of testing every instance box
+const bool kHierarchicalCulling = true;
+enum class OcclusionCulling
+{
+	NONE,
+	SOFTWARE,		// Rasterizes the largest meshes on the CPU and skips instances hidden behind them
+	QUERIES			// GPU occlusion queries on instance boxes, hidden instances are drawn with conditional rendering
+};
+const OcclusionCulling kOcclusionCulling = OcclusionCulling::SOFTWARE;
+// Draws distant instances with the simplified levels of detail the scene cooker generates
+const bool kLevelsOfDetail = true;
+// Culls the meshlets of instances drawn at full detail against the frustum and their normal cones
+const bool kMeshletCulling = true;
+
+// GPU memory textures may use before their top mip levels get evicted
+const size_t kTextureMemoryBudget = 256 * 1024 * 1024;
 
 class GLTest
 {
 	GLFWwindow* mpWindow;
 	GPUProgram mGPUProgram;
+	GPUProgram mMultiDrawProgram;
+	GPUProgram mBoxProgram;
 	FirstPersonCamera mCamera;
-	std::unordered_map<const aiMesh*, Mesh> mMeshMap;
-	std::unordered_map<const aiMaterial*, Material> mMaterialMap;
+	SceneData mScene;
+	SceneGraph mSceneGraph;
+	BoundingVolumeHierarchy mInstanceHierarchy;
+	OcclusionCuller mOcclusionCuller;
+	OcclusionQueries mOcclusionQueries;
+	LodSelector mLodSelector;
+	MeshletCuller mMeshletCuller;
+	std::vector<IndexRange> mMeshletRanges;
+	std::vector<unsigned int> mHiddenInstances;
+	std::vector<unsigned int> mVisibleInstances;
+	std::vector<Material> mMaterials;
+	std::vector<Mesh> mMeshes;
 	Renderer mRenderer;
 
 	int printOglError(char *file, int line)
@@ -48,81 +92,140 @@ class GLTest
 
 	#define printOpenGLError() printOglError(__FILE__, __LINE__)
 
-	void processSceneNode(const aiScene* const pScene, const aiNode* const pNode)
+	void processScene()
 	{
-		assert(pNode);
-		for (unsigned int m=0; m < pNode->mNumMeshes; ++m) {
-			const aiMesh* const pAiMesh = pScene->mMeshes[pNode->mMeshes[m]];
-			assert(pAiMesh);
-
-			if (mMeshMap.find(pAiMesh) == mMeshMap.end()) {
-				const aiMaterial* const pAiMaterial = pScene->mMaterials[pAiMesh->mMaterialIndex];
-				assert(pAiMaterial);
-
-				Material* pMaterial = nullptr;
-				auto& matIt = mMaterialMap.find(pAiMaterial);
-				if (matIt != mMaterialMap.end()) {
-					pMaterial = &matIt->second;
-				}
-				else {
-					mMaterialMap.insert(std::make_pair(pAiMaterial, Material(*pAiMaterial, mGPUProgram)));
-					pMaterial = &mMaterialMap.at(pAiMaterial);
-					pMaterial->init();
-				}
-
-				assert(pMaterial);
-				mMeshMap.insert(std::make_pair(pAiMesh, Mesh(*pAiMesh, *pMaterial)));
-				Mesh* pMesh = &mMeshMap.at(pAiMesh);
-				pMesh->createBuffers();
-			}
+		// Meshes keep references to their material, reserve so neither vector reallocates
+		mMaterials.reserve(mScene.Materials.size());
+		for (const MaterialData& materialData : mScene.Materials) {
+			mMaterials.push_back(Material(materialData, mGPUProgram));
+			mMaterials.back().init();
 		}
 
-		for (unsigned int n=0; n < pNode->mNumChildren; ++n) {
-			processSceneNode(pScene, pNode->mChildren[n]);
+		mMeshes.reserve(mScene.Meshes.size());
+		for (const MeshData& meshData : mScene.Meshes) {
+			assert(meshData.MaterialIndex < mMaterials.size());
+			mMeshes.push_back(Mesh(meshData, mMaterials[meshData.MaterialIndex]));
+		}
+		mRenderer.createGeometry(mMeshes);
+		mSceneGraph.build(mScene.Nodes, mScene.Meshes);
+		// Places the instance bounds, the matrices passed here are replaced in the first frame
+		mSceneGraph.update(glm::mat4());
+		mInstanceHierarchy.build(mSceneGraph.getInstanceBounds());
+		if (kOcclusionCulling == OcclusionCulling::SOFTWARE) {
+			mOcclusionCuller.selectOccluders(mScene.Meshes);
 		}
 	}
 
-	void renderSceneNode(const aiScene* const pScene, const aiNode* const pNode)
+	void renderScene()
 	{
-		assert(pNode);
-		mRenderer.getRenderContext().pAiNode = pNode;
-
-		for (unsigned int m=0; m < pNode->mNumMeshes; ++m) {
-			const aiMesh* const pAiMesh = pScene->mMeshes[pNode->mMeshes[m]];
-			assert(pAiMesh);
-			mRenderer.render(mMeshMap.at(pAiMesh));
+		const glm::mat4& viewProjection = mCamera.getViewProjectionMatrix();
+		if (mSceneGraph.update(viewProjection) && kHierarchicalCulling) {
+			mInstanceHierarchy.refit(mSceneGraph.getInstanceBounds());
+		}
+		if (kLevelsOfDetail) {
+			mLodSelector.beginFrame(mCamera, mSceneGraph.getInstanceCount());
+		}
+		if (kMeshletCulling) {
+			mMeshletCuller.beginFrame(mCamera.getPosition());
+		}
+		const Frustum frustum(viewProjection);
+		if (kHierarchicalCulling) {
+			mInstanceHierarchy.queryFrustum(frustum, mVisibleInstances);
+		}
+		else {
+			frustum.cullBoxes(mSceneGraph.getInstanceBounds(), mVisibleInstances);
+		}
+		if (kOcclusionCulling == OcclusionCulling::SOFTWARE) {
+			mOcclusionCuller.render(mSceneGraph, mVisibleInstances, viewProjection);
+			mOcclusionCuller.cullInstances(mSceneGraph.getInstanceBounds(), mVisibleInstances);
+		}
+		if (mOcclusionQueries.isInitialized()) {
+			renderSceneWithQueries(viewProjection);
+			return;
 		}
+		for (unsigned int instance : mVisibleInstances) {
+			submitInstance(instance);
+		}
+		mRenderer.flush();
+	}
 
-		for (unsigned int n=0; n < pNode->mNumChildren; ++n) {
-			renderSceneNode(pScene, pNode->mChildren[n]);
+	void submitInstance(unsigned int instance, GLuint occlusionQuery = 0)
+	{
+		const Mesh& mesh = mMeshes[mSceneGraph.getInstanceMesh(instance)];
+		const unsigned int lod = kLevelsOfDetail ? mLodSelector.select(mSceneGraph, mesh, instance) : 0;
+		if (kMeshletCulling && lod == 0 && mesh.getMeshletCount()) {
+			mMeshletRanges.clear();
+			mMeshletCuller.cull(mSceneGraph, mesh, instance, mMeshletRanges);
+			mRenderer.submit(mesh, mSceneGraph.getInstanceNode(instance), mMeshletRanges, RenderPass::SOLID, occlusionQuery);
+		}
+		else {
+			mRenderer.submit(mesh, mSceneGraph.getInstanceNode(instance), lod, RenderPass::SOLID, occlusionQuery);
 		}
 	}
 
-	void renderSceneNodeDebug(const aiScene* const pScene, const aiNode* const pNode)
+	// Draws the instances last seen visible, then queries the boxes of the hidden ones against that depth and
+	// draws each of them conditionally on its query
+	void renderSceneWithQueries(const glm::mat4& viewProjection)
 	{
-#if defined(DEBUG_DRAW)
-		assert(pNode);
-		mRenderer.getRenderContext().pAiNode = pNode;
+		const BoundingBoxArray& bounds = mSceneGraph.getInstanceBounds();
+		const unsigned int frameIndex = mRenderer.getRenderContext().FrameIndex;
+		mOcclusionQueries.collectResults(mSceneGraph.getInstanceCount());
+		mHiddenInstances.clear();
+		for (unsigned int instance : mVisibleInstances) {
+			if (mOcclusionQueries.isHidden(instance)) {
+				mHiddenInstances.push_back(instance);
+			}
+			else {
+				submitInstance(instance);
+			}
+		}
+		mRenderer.flush();
 
-		for (unsigned int m=0; m < pNode->mNumMeshes; ++m) {
-			const aiMesh* const pAiMesh = pScene->mMeshes[pNode->mMeshes[m]];
-			assert(pAiMesh);
-			mRenderer.renderDebug(mMeshMap.at(pAiMesh));
+		mOcclusionQueries.beginQueries(viewProjection);
+		for (unsigned int instance : mVisibleInstances) {
+			if (!mOcclusionQueries.isHidden(instance) && mOcclusionQueries.isQueryDue(instance, frameIndex)) {
+				mOcclusionQueries.issueQuery(instance, bounds.get(instance));
+			}
+		}
+		for (unsigned int instance : mHiddenInstances) {
+			submitInstance(instance, mOcclusionQueries.issueQuery(instance, bounds.get(instance)));
 		}
+		mOcclusionQueries.endQueries();
+		mRenderer.flush();
+	}
 
-		for (unsigned int n=0; n < pNode->mNumChildren; ++n) {
-			renderSceneNodeDebug(pScene, pNode->mChildren[n]);
+	void renderSceneDebug()
+	{
+#if defined(DEBUG_DRAW)
+		for (unsigned int node=0; node < mSceneGraph.getNodeCount(); ++node) {
+			for (unsigned int i=0; i < mSceneGraph.getMeshCount(node); ++i) {
+				mRenderer.renderDebug(mMeshes[mSceneGraph.getMeshIndex(node, i)], node);
+			}
 		}
 #endif
 	}
 
 	void destroyMeshes()
 	{
-		for (auto& meshMapIt : mMeshMap) {
-			meshMapIt.second.destroy();
+		for (Mesh& mesh : mMeshes) {
+			mesh.destroy();
 		}
 	}
 
+	// Worker threads must be joined before their static owners are destroyed
+	void shutdown()
+	{
+		// Materials hold texture handles, release them before the texture cache goes away
+		destroyMeshes();
+		mMeshes.clear();
+		mMaterials.clear();
+		Texture::unloadAll();
+		JobPool::getShared().stop();
+		mOcclusionQueries.destroy();
+		mRenderer.destroy();
+		glfwTerminate();
+	}
+
 	static void errorCallback(int error, const char* description)
 	{
 		fprintf(stderr, "GLFW error: %s\n", description);
@@ -173,30 +276,68 @@ public:
 		int width, height;
 		glfwGetFramebufferSize(mpWindow, &width, &height);
 		glViewport(0, 0, width, height);
+		mLodSelector.setViewportHeight(static_cast<unsigned int>(height));
 		glfwSwapInterval(1);
 
+		// Scene files are built from the source models by SceneCooker, the GLTest project runs
+		// "SceneCooker data/cube/cube.obj data/cube/cube.scene" after every build
 		std::string modelBasePath = "data/cube/";
-		Assimp::Importer importer;
-		const struct aiScene* pScene = 
-			importer.ReadFile(modelBasePath + "cube.obj", aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_FixInfacingNormals);
-
-		if (!pScene) {
-			fprintf(stderr, "Failed to import scene: %s", importer.GetErrorString());
+		const std::string sceneFileName = modelBasePath + "cube.scene";
+		if (!SceneFile::load(sceneFileName, mScene)) {
+			fprintf(stderr, "Failed to load scene: %s, cook it with SceneCooker %scube.obj %s\n", sceneFileName.c_str(),
+				modelBasePath.c_str(), sceneFileName.c_str());
 			glfwTerminate();
 			return -1;
 		}
 
+		// Workers for compression, mip generation and occlusion rasterization, the render thread is the last one
+		JobPool::getShared().start(std::max(2u, std::thread::hardware_concurrency()) - 1);
 		Texture::setBasePath(modelBasePath);
 		Texture::setDefaultTexture(Texture::load("textures/white.png"));
+		// One core stays free for the render thread
+		Texture::getLoader().start(std::max(2u, std::thread::hardware_concurrency()) - 1);
+		Texture::setMemoryBudget(kTextureMemoryBudget);
 
 		mGPUProgram.compileShader("data/basic.vert", ShaderType::VERTEX);
 		mGPUProgram.compileShader("data/basic.frag", ShaderType::FRAGMENT);		
 		mGPUProgram.link();
+		mGPUProgram.bindUniformBlock("FrameData", static_cast<GLuint>(UniformBlock::FRAME));
+		mGPUProgram.bindUniformBlock("DrawData", static_cast<GLuint>(UniformBlock::DRAW));
+		mGPUProgram.bindUniformBlock("InstanceData", static_cast<GLuint>(UniformBlock::INSTANCE));
 		std::cout << "Shader compilation log: " << mGPUProgram.getLog() << std::endl;
 		mGPUProgram.printActiveAttribs();
 		mGPUProgram.printActiveUniforms();
 
-		processSceneNode(pScene, pScene->mRootNode);
+		if (kMultiDraw) {
+			mMultiDrawProgram.compileShader("data/basic.vert", ShaderType::VERTEX, "#define MULTI_DRAW\n");
+			mMultiDrawProgram.compileShader("data/basic.frag", ShaderType::FRAGMENT);
+			mMultiDrawProgram.link();
+			mMultiDrawProgram.bindUniformBlock("FrameData", static_cast<GLuint>(UniformBlock::FRAME));
+			if (!mMultiDrawProgram.isLinked()) {
+				std::cout << "Multi-draw shader compilation log: " << mMultiDrawProgram.getLog() << std::endl;
+			}
+			else if (!mRenderer.enableMultiDraw(mMultiDrawProgram)) {
+				printf("Multi-draw indirect is not supported, meshes are drawn one by one\n");
+			}
+		}
+
+		if (kOcclusionCulling == OcclusionCulling::QUERIES) {
+			mBoxProgram.compileShader("data/box.vert", ShaderType::VERTEX);
+			mBoxProgram.compileShader("data/box.frag", ShaderType::FRAGMENT);
+			mBoxProgram.link();
+			if (!mBoxProgram.isLinked()) {
+				std::cout << "Occlusion query shader compilation log: " << mBoxProgram.getLog() << std::endl;
+			}
+			else if (!mOcclusionQueries.init(mBoxProgram)) {
+				fprintf(stderr, "Failed to create the occlusion query box\n");
+			}
+		}
+
+		processScene();
+#if !defined(DEBUG_DRAW)
+		// Geometry now lives in GPU buffers, unmap the scene file
+		mScene.releaseGeometry();
+#endif
 
 		mCamera.setInput(Input(mpWindow));
 		mCamera.setFieldOfView(45.0f);
@@ -207,6 +348,12 @@ public:
 		mCamera.setMovementRate(0.001f);
 		mCamera.initialize();
 		mRenderer.getRenderContext().pCamera = &mCamera;
+		mRenderer.getRenderContext().pSceneGraph = &mSceneGraph;
+		if (!mRenderer.init()) {
+			fprintf(stderr, "Failed to create the uniform ring buffer\n");
+			shutdown();
+			return -1;
+		}
 
 		glClearColor(0.f, 0.f, 0.f, 1.f);
 		glClearDepth(1.0f);
@@ -226,11 +373,60 @@ public:
 			mCamera.update(elapsedTime);
 
 			mRenderer.getRenderContext().Time = static_cast<float>(totalTime);
+			Texture::getLoader().update(TextureLoader::kDefaultUploadBudget);
+			Texture::updateResidency(mRenderer.getRenderContext().FrameIndex);
+			if (Texture::getLoader().isIdle()) {
+				const unsigned int packedCount = Texture::packArrays();
+#if defined(PRINT_GL_STATISTICS)
+				if (packedCount) {
+					printf("Packed %u textures into texture arrays\n", packedCount);
+				}
+#else
+				(void)packedCount;
+#endif
+			}
 
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-			renderSceneNode(pScene, pScene->mRootNode);
-			renderSceneNodeDebug(pScene, pScene->mRootNode);
+			mRenderer.beginFrame();
+			renderScene();
+			mRenderer.endFrame();
+			renderSceneDebug();
 			glfwSwapBuffers(mpWindow);
+			++mRenderer.getRenderContext().FrameIndex;
+#if defined(PRINT_GL_STATISTICS)
+			const GLStateStatistics& stateStatistics = GLState::getStatistics();
+			printf("Draw calls: %u (conditional: %u), GL state calls issued: %u, elided: %u, GPU time: %.3f ms\n",
+				mRenderer.getDrawCallCount(), mRenderer.getConditionalDrawCount(), stateStatistics.IssuedCalls,
+				stateStatistics.ElidedCalls, mRenderer.getGPUFrameTime());
+			printf("Triangles: %u", mRenderer.getTriangleCount());
+			if (kLevelsOfDetail) {
+				printf(", instances per level of detail:");
+				for (unsigned int lod=0; lod < MeshData::kMaxLodCount; ++lod) {
+					printf(" %u", mLodSelector.getSelectedCount(lod));
+				}
+			}
+			printf("\n");
+#endif
+#if defined(PRINT_CULLING_STATISTICS)
+			const unsigned int instanceCount = mSceneGraph.getInstanceCount();
+			const unsigned int visibleCount = static_cast<unsigned int>(mVisibleInstances.size());
+			const unsigned int occludedCount = kOcclusionCulling == OcclusionCulling::SOFTWARE ? mOcclusionCuller.getOccludedCount() : 0;
+			printf("Instances: %u, visible: %u, frustum culled: %u, hierarchy nodes visited: %u\n", instanceCount, visibleCount,
+				instanceCount - visibleCount - occludedCount, kHierarchicalCulling ? mInstanceHierarchy.getVisitedNodeCount() : 0);
+			if (kOcclusionCulling == OcclusionCulling::SOFTWARE) {
+				printf("Occluded: %u, occluder triangles: %u, occlusion rasterizer: %.3f ms\n", occludedCount,
+					mOcclusionCuller.getRasterizedTriangleCount(), mOcclusionCuller.getRasterizationTime());
+			}
+			else if (mOcclusionQueries.isInitialized()) {
+				printf("Hidden by queries: %u, queries issued: %u, pending: %u\n", static_cast<unsigned int>(mHiddenInstances.size()),
+					mOcclusionQueries.getIssuedCount(), mOcclusionQueries.getPendingCount());
+			}
+			if (kMeshletCulling) {
+				printf("Meshlets tested: %u, frustum culled: %u, backface culled: %u\n", mMeshletCuller.getTestedCount(),
+					mMeshletCuller.getFrustumCulledCount(), mMeshletCuller.getBackfaceCulledCount());
+			}
+#endif
+			GLState::resetStatistics();
 
 			const double currentTime = glfwGetTime();
 			elapsedTime = (currentTime - totalTime) * 1000.0;
@@ -240,9 +436,7 @@ public:
 			//std::cout << "Elapsed time: " << elapsedTime << std::endl;
 		}
 
-		Texture::unloadAll();
-		destroyMeshes();
-		glfwTerminate();
+		shutdown();
 		return 0;
 	}
 };
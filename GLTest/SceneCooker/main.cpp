@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "SceneData.h"
+#include "SceneFile.h"
+#include "SceneImporter.h"
+
+// Imports a model through Assimp once and writes the binary scene file loaded by GLTest.
+// Usage: SceneCooker <model file> <scene file> [-float] [-no-optimize] [-no-lods] [-no-meshlets]
+
+static void printUsage()
+{
+	printf("Usage: SceneCooker <model file> <scene file> [-float] [-no-optimize] [-no-lods] [-no-meshlets]\n");
+	printf("  -float        Keep 32-bit float vertex attributes instead of the compact format\n");
+	printf("  -no-optimize  Skip the vertex cache, overdraw and vertex fetch optimizations\n");
+	printf("  -no-lods      Skip generating simplified levels of detail\n");
+	printf("  -no-meshlets  Skip splitting meshes into meshlets for cluster culling\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		printUsage();
+		return -1;
+	}
+
+	const std::string modelFileName = argv[1];
+	const std::string sceneFileName = argv[2];
+
+	SceneImporter importer;
+	for (int i=3; i < argc; ++i) {
+		if (strcmp(argv[i], "-float") == 0) {
+			importer.setVertexFormat(VertexFormat::FLOAT);
+		}
+		else if (strcmp(argv[i], "-no-optimize") == 0) {
+			importer.setOptimizeMeshes(false);
+		}
+		else if (strcmp(argv[i], "-no-lods") == 0) {
+			importer.setGenerateLods(false);
+		}
+		else if (strcmp(argv[i], "-no-meshlets") == 0) {
+			importer.setGenerateMeshlets(false);
+		}
+		else {
+			printUsage();
+			return -1;
+		}
+	}
+
+	SceneData scene;
+	if (!importer.import(modelFileName, scene)) {
+		fprintf(stderr, "Failed to import scene: %s\n", importer.getErrorString().c_str());
+		return -1;
+	}
+
+	const VertexCacheStatistics& before = importer.getCacheStatisticsBefore();
+	const VertexCacheStatistics& after = importer.getCacheStatisticsAfter();
+	if (before.TriangleCount) {
+		printf("Vertex cache optimization (FIFO %u): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", MeshOptimizer::kDefaultCacheSize,
+			before.getACMR(), after.getACMR(), before.getATVR(), after.getATVR());
+	}
+
+	const std::vector<unsigned int>& lodTriangleCounts = importer.getLodTriangleCounts();
+	if (lodTriangleCounts.size() > 1 && lodTriangleCounts[1] < lodTriangleCounts[0]) {
+		printf("Levels of detail, triangles:");
+		for (unsigned int triangleCount : lodTriangleCounts) {
+			printf(" %u", triangleCount);
+		}
+		printf("\n");
+	}
+
+	if (importer.getMeshletCount()) {
+		printf("Meshlets: %u, %.1f triangles each on average\n", importer.getMeshletCount(),
+			static_cast<float>(importer.getMeshletTriangleCount()) / importer.getMeshletCount());
+	}
+
+	if (!SceneFile::save(sceneFileName, scene)) {
+		fprintf(stderr, "Failed to write scene file: %s\n", sceneFileName.c_str());
+		return -1;
+	}
+
+	printf("Cooked %s: %u nodes, %u meshes, %u materials\n", sceneFileName.c_str(), static_cast<unsigned int>(scene.Nodes.size()),
+		static_cast<unsigned int>(scene.Meshes.size()), static_cast<unsigned int>(scene.Materials.size()));
+	return 0;
+}